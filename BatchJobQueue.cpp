@@ -0,0 +1,245 @@
+#include "BatchJobQueue.h"
+#include "SencArchive.h"
+#include "SencWriter.h"
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <atomic>
+#include <filesystem>
+#include <openssl/crypto.h>
+
+namespace fs = std::filesystem;
+
+struct BatchJobQueue::Batch {
+  Operation operation = Operation::Encrypt;
+  std::string password;
+  SencWriter writer;
+  std::atomic<bool> cancelled{false};
+  std::atomic<int> total{-1};
+  std::atomic<int> done{0};
+  std::atomic<qint64> bytesDone{0};
+  std::atomic<qint64> bytesTotal{0};
+  QElapsedTimer elapsed;
+
+  QMutex mutex;
+  QStringList created;
+  QStringList failures;
+
+  ~Batch() {
+    if (!password.empty()) {
+      OPENSSL_cleanse(&password[0], password.size());
+    }
+  }
+
+  void fail(const QString &path, const std::string &reason) {
+    QMutexLocker lock(&mutex);
+    failures << path + ": " + QString::fromStdString(reason);
+  }
+};
+
+BatchJobQueue::BatchJobQueue(SencKeyCache &keyCache, QObject *parent)
+    : QObject(parent), keyCache(keyCache) {
+  setWorkerCount(QThread::idealThreadCount());
+  progressTimer = new QTimer(this);
+  progressTimer->setInterval(PROGRESS_INTERVAL_MS);
+  connect(progressTimer, &QTimer::timeout, this,
+          &BatchJobQueue::reportProgress);
+}
+
+BatchJobQueue::~BatchJobQueue() {
+  cancel();
+  pool.waitForDone();
+}
+
+void BatchJobQueue::setWorkerCount(int count) {
+  // One more thread for listing the inputs while jobs already run
+  pool.setMaxThreadCount(qBound(1, count, MAX_WORKERS) + 1);
+}
+
+bool BatchJobQueue::start(Operation operation, const QStringList &paths,
+                          const QString &password) {
+  if (activeBatch) {
+    return false;
+  }
+  auto batch = std::make_shared<Batch>();
+  batch->operation = operation;
+  batch->password = password.toStdString();
+  batch->elapsed.start();
+  activeBatch = batch;
+  progressTimer->start();
+  reportProgress();
+
+  pool.start([this, batch, paths]() { list(batch, paths); });
+  return true;
+}
+
+void BatchJobQueue::cancel() {
+  if (activeBatch) {
+    activeBatch->cancelled = true;
+  }
+}
+
+void BatchJobQueue::list(const std::shared_ptr<Batch> &batch,
+                         const QStringList &paths) {
+  bool encrypting = batch->operation == Operation::Encrypt;
+  QStringList files;
+  qint64 bytes = 0;
+  auto take = [&](const QFileInfo &info) {
+    if (info.fileName().endsWith(".senc") != encrypting) {
+      files << info.absoluteFilePath();
+      bytes += info.size();
+    }
+  };
+  for (const QString &path : paths) {
+    QFileInfo info(path);
+    if (info.isSymLink()) {
+      continue;
+    }
+    if (info.isDir()) {
+      QDirIterator it(path, QDir::Files | QDir::NoSymLinks,
+                      QDirIterator::Subdirectories);
+      while (it.hasNext() && !batch->cancelled) {
+        it.next();
+        take(it.fileInfo());
+      }
+    } else if (info.isFile()) {
+      take(info);
+    }
+  }
+
+  // PBKDF2 once for the batch, on this thread rather than the GUI's
+  std::string error;
+  if (encrypting && !files.isEmpty() && !batch->cancelled &&
+      !batch->writer.shareKey(batch->password, error)) {
+    for (const QString &file : files) {
+      batch->fail(file, error);
+    }
+    files.clear();
+  }
+
+  batch->bytesTotal = bytes;
+  batch->total = static_cast<int>(files.size());
+  if (files.isEmpty()) {
+    QMetaObject::invokeMethod(this, [this, batch]() { finish(batch); });
+    return;
+  }
+  for (const QString &file : files) {
+    pool.start([this, batch, file]() { runJob(batch, file); });
+  }
+}
+
+void BatchJobQueue::runJob(const std::shared_ptr<Batch> &batch,
+                           const QString &path) {
+  if (!batch->cancelled) {
+    if (batch->operation == Operation::Encrypt) {
+      encryptFile(*batch, path);
+    } else {
+      decryptFile(*batch, path);
+    }
+  }
+  jobDone(batch);
+}
+
+void BatchJobQueue::encryptFile(Batch &batch, const QString &path) {
+  fs::path input = path.toStdString();
+  fs::path output = input.string() + ".senc";
+  std::error_code ec;
+  if (fs::exists(output, ec)) {
+    batch.fail(path, "'" + output.filename().string() + "' already exists");
+    return;
+  }
+  qint64 size = QFileInfo(path).size();
+
+  SencMetadata metadata;
+  metadata.originalName = input.filename().string();
+  metadata.mimeType = SencWriter::mimeTypeFor(metadata.originalName);
+  std::string error;
+  if (!batch.writer.encryptV2(input, output, metadata, batch.password,
+                              error)) {
+    batch.fail(path, error);
+    return;
+  }
+  batch.bytesDone += size;
+  // Same contract as bin/senc: the original goes once the archive is whole
+  if (!fs::remove(input, ec)) {
+    batch.fail(path, "encrypted, but the original could not be removed: " +
+                         ec.message());
+  }
+  QMutexLocker lock(&batch.mutex);
+  batch.created << QString::fromStdString(output.string());
+}
+
+void BatchJobQueue::decryptFile(Batch &batch, const QString &path) {
+  SencArchive archive;
+  SencKey key;
+  SencLayout layout;
+  std::string error;
+  if (!archive.open(path.toStdString(), error)) {
+    batch.fail(path, error);
+    return;
+  }
+  if (archive.format() == SencArchive::Format::Unknown) {
+    batch.fail(path, "Unsupported archive format");
+    return;
+  }
+  archive.setCancelFlag(&batch.cancelled);
+  if (!keyCache.deriveKey(archive, batch.password, key, error) ||
+      !archive.readLayout(key, layout, error)) {
+    batch.fail(path, error);
+    return;
+  }
+  keyCache.insert(archive, batch.password, key);
+
+  fs::path name = fs::path(layout.originalName).filename();
+  if (name.empty()) {
+    name = archive.path().stem();
+  }
+  fs::path output = archive.path().parent_path() / name;
+  if (!archive.extract(key, output, error)) {
+    batch.fail(path, error);
+    return;
+  }
+  batch.bytesDone += static_cast<qint64>(layout.contentSize);
+  QMutexLocker lock(&batch.mutex);
+  batch.created << QString::fromStdString(output.string());
+}
+
+void BatchJobQueue::jobDone(const std::shared_ptr<Batch> &batch) {
+  // `total` is set before the first job starts
+  if (++batch->done == batch->total) {
+    QMetaObject::invokeMethod(this, [this, batch]() { finish(batch); });
+  }
+}
+
+void BatchJobQueue::reportProgress() {
+  if (!activeBatch) {
+    return;
+  }
+  const Batch &batch = *activeBatch;
+  double seconds = batch.elapsed.elapsed() / 1000.0;
+  qint64 bytes = batch.bytesDone;
+  emit progress(batch.done, batch.total, bytes, batch.bytesTotal,
+                seconds > 0 ? bytes / seconds : 0);
+}
+
+void BatchJobQueue::finish(const std::shared_ptr<Batch> &completed) {
+  if (completed != activeBatch) {
+    return;
+  }
+  reportProgress();
+  progressTimer->stop();
+  activeBatch.reset();
+
+  QStringList created;
+  QStringList failures;
+  {
+    QMutexLocker lock(&completed->mutex);
+    created = completed->created;
+    failures = completed->failures;
+  }
+  emit finished(completed->operation, created, failures,
+                completed->cancelled);
+}
@@ -0,0 +1,77 @@
+#ifndef BATCHJOBQUEUE_H
+#define BATCHJOBQUEUE_H
+
+#include "SencKeyCache.h"
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+#include <memory>
+
+// Encrypts or decrypts many files at once with the native engine, one job
+// per file on a pool of workers.
+//
+// Encrypting derives a single key for the whole batch (see
+// SencWriter::shareKey), writes <file>.senc next to each file and removes
+// the original once its archive is complete, like bin/senc. Decrypting
+// writes each archive's content next to it under its original name and
+// keeps the archive; archives written as one batch share a key, so the key
+// cache makes that one derivation too.
+//
+// Progress is reported at most every PROGRESS_INTERVAL_MS and the results
+// once, when the last job is done, so callers can update in a single pass.
+class BatchJobQueue : public QObject {
+  Q_OBJECT
+
+public:
+  enum class Operation { Encrypt, Decrypt };
+  Q_ENUM(Operation)
+
+  explicit BatchJobQueue(SencKeyCache &keyCache, QObject *parent = nullptr);
+  ~BatchJobQueue();
+
+  void setWorkerCount(int count);
+  int workerCount() const { return pool.maxThreadCount(); }
+  bool isRunning() const { return activeBatch != nullptr; }
+
+  // `paths` may name files and directories; directories are searched
+  // recursively, skipping hidden entries and symlinks. Encrypting takes
+  // everything except archives, decrypting takes archives only. Returns
+  // false if a batch is already running.
+  bool start(Operation operation, const QStringList &paths,
+             const QString &password);
+  // Jobs not yet started are skipped; a running decrypt stops between chunks
+  void cancel();
+
+  static constexpr int MAX_WORKERS = 8;
+  static constexpr int PROGRESS_INTERVAL_MS = 250;
+
+signals:
+  // `total` is -1 while the inputs are still being listed
+  void progress(int done, int total, qint64 bytesDone, qint64 bytesTotal,
+                double bytesPerSecond);
+  // `created` lists the new files; `failures` has one "path: reason" line
+  // per file that was left as it was
+  void finished(BatchJobQueue::Operation operation,
+                const QStringList &created, const QStringList &failures,
+                bool cancelled);
+
+private:
+  struct Batch;
+
+  void list(const std::shared_ptr<Batch> &batch, const QStringList &paths);
+  void runJob(const std::shared_ptr<Batch> &batch, const QString &path);
+  void encryptFile(Batch &batch, const QString &path);
+  void decryptFile(Batch &batch, const QString &path);
+  void jobDone(const std::shared_ptr<Batch> &batch);
+  void reportProgress();
+  void finish(const std::shared_ptr<Batch> &completed);
+
+  SencKeyCache &keyCache;
+  QThreadPool pool;
+  std::shared_ptr<Batch> activeBatch;
+  QTimer *progressTimer;
+};
+
+#endif // BATCHJOBQUEUE_H
@@ -0,0 +1,497 @@
+// SecureViewerBench: timings for the decrypt, scan and render hot paths,
+// printed as one JSON document so results can be compared across releases.
+//
+//   SecureViewerBench [--content-mb N] [--files N] [--repeat N]
+//                     [--no-subprocess] [--output results.json]
+//
+// Everything runs against a synthetic corpus in a temporary directory that
+// is removed afterwards. The file index lives in Qt's test locations, so the
+// user's own index is never touched. Each figure is the best of --repeat
+// runs; PBKDF2 is timed on its own and left out of the decrypt figures.
+#include "EncryptedFileModel.h"
+#include "FileCache.h"
+#include "ImagePyramid.h"
+#include "ProcessRunner.h"
+#include "SencArchive.h"
+#include "SencCrypto.h"
+#include "SencWriter.h"
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLinearGradient>
+#include <QPainter>
+#include <QPdfDocument>
+#include <QPdfWriter>
+#include <QReadWriteLock>
+#include <QStandardPaths>
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <QThread>
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+const char PASSWORD[] = "senc-bench";
+// Window-sized target for the image and PDF timings
+const QSize VIEW_SIZE(1280, 800);
+const QSize SOURCE_IMAGE_SIZE(6000, 4000);
+constexpr int PDF_PAGES = 50;
+// Archives and other files per directory of the scan corpus
+constexpr int FILES_PER_DIRECTORY = 100;
+constexpr int ARCHIVE_EVERY = 4;
+// How the sidebar feeds the model
+constexpr int MODEL_BATCH_SIZE = 256;
+
+struct Options {
+  qint64 contentSize = 64LL * 1024 * 1024;
+  int files = 20000;
+  int repeat = 3;
+  bool subprocess = true;
+};
+
+// Best of `repeat` runs of `fn`, in seconds; a negative result means `fn`
+// failed and `error` says why
+double bestOf(int repeat, const std::function<bool(std::string &)> &fn,
+              std::string &error) {
+  double best = std::numeric_limits<double>::max();
+  for (int i = 0; i < repeat; ++i) {
+    QElapsedTimer timer;
+    timer.start();
+    if (!fn(error)) {
+      return -1;
+    }
+    best = std::min(best, timer.nsecsElapsed() / 1e9);
+  }
+  return best;
+}
+
+QJsonObject timing(const QString &name, double seconds,
+                   const std::string &error) {
+  QJsonObject result{{"name", name}};
+  if (seconds < 0) {
+    result["error"] = QString::fromStdString(error);
+  } else {
+    result["seconds"] = seconds;
+  }
+  return result;
+}
+
+QJsonObject throughput(const QString &name, double seconds, qint64 bytes,
+                       const std::string &error) {
+  QJsonObject result = timing(name, seconds, error);
+  result["bytes"] = bytes;
+  if (seconds > 0) {
+    result["megabytesPerSecond"] = bytes / seconds / (1024 * 1024);
+  }
+  return result;
+}
+
+bool writeRandomFile(const fs::path &path, qint64 size) {
+  std::ofstream out(path, std::ios::binary);
+  std::mt19937_64 random(42);
+  std::vector<uint64_t> block(1024 * 1024 / sizeof(uint64_t));
+  for (qint64 left = size; out && left > 0;) {
+    std::generate(block.begin(), block.end(), std::ref(random));
+    qint64 chunk = std::min<qint64>(left, block.size() * sizeof(uint64_t));
+    out.write(reinterpret_cast<const char *>(block.data()), chunk);
+    left -= chunk;
+  }
+  return static_cast<bool>(out);
+}
+
+// The fallback path as the viewer runs it: the archive's own script in a
+// directory of its own, password on stdin
+bool scriptDecrypt(const fs::path &archivePath, const fs::path &workDir,
+                   std::string &error) {
+  static int run = 0;
+  fs::path directory = workDir / ("script-" + std::to_string(run++));
+  fs::create_directories(directory);
+  fs::path copy = directory / archivePath.filename();
+  if (!SencArchive::cloneFile(archivePath, copy, error)) {
+    return false;
+  }
+  fs::permissions(copy, fs::perms::owner_all);
+
+  ProcessRunner runner;
+  ProcessRunner::Job job;
+  job.program = QString::fromStdString(copy.string());
+  job.workingDirectory = QString::fromStdString(directory.string());
+  job.input = QByteArray(PASSWORD) + '\n';
+  bool ok = false;
+  QEventLoop loop;
+  QObject::connect(&runner, &ProcessRunner::finished, &loop,
+                   [&](int, bool succeeded, const QString &output, bool) {
+                     ok = succeeded;
+                     error = output.toStdString();
+                     loop.quit();
+                   });
+  runner.start(std::move(job));
+  loop.exec();
+  fs::remove_all(directory);
+  return ok;
+}
+
+QJsonObject benchDecrypt(const Options &options, const fs::path &workDir) {
+  QJsonObject section;
+  fs::path content = workDir / "content.bin";
+  fs::path v1 = workDir / "content-v1.senc";
+  fs::path v2 = workDir / "content-v2.senc";
+  std::string error;
+  SencWriter writer;
+  SencMetadata metadata;
+  metadata.originalName = "content.bin";
+  if (!writeRandomFile(content, options.contentSize) ||
+      !writer.encryptV1(content, v1, "content.bin", PASSWORD, error) ||
+      !writer.encryptV2(content, v2, metadata, PASSWORD, error)) {
+    section["error"] = error.empty() ? QString("Failed to write corpus")
+                                     : QString::fromStdString(error);
+    return section;
+  }
+  fs::remove(content);
+
+  // Keys are derived once per archive and reused by the decrypt runs
+  struct Archive {
+    const char *name;
+    fs::path path;
+    SencKey key;
+  };
+  Archive archives[] = {{"v1", v1, {}}, {"v2", v2, {}}};
+  QJsonArray pbkdf2;
+  for (Archive &archive : archives) {
+    SencArchive reader;
+    double seconds =
+        reader.open(archive.path, error)
+            ? bestOf(
+                  options.repeat,
+                  [&](std::string &why) {
+                    return reader.deriveKey(PASSWORD, archive.key, why);
+                  },
+                  error)
+            : -1;
+    pbkdf2.append(timing(archive.name, seconds, error));
+  }
+  section["pbkdf2"] = pbkdf2;
+
+  QJsonArray runs;
+  unsigned cores = std::max(1, QThread::idealThreadCount());
+  for (const Archive &archive : archives) {
+    for (unsigned threads : {1u, cores}) {
+      double seconds = bestOf(
+          options.repeat,
+          [&](std::string &why) {
+            SencArchive reader;
+            SencPlaintext plaintext;
+            reader.setMaxThreads(threads);
+            return reader.open(archive.path, why) &&
+                   reader.decrypt(archive.key, plaintext, why);
+          },
+          error);
+      QJsonObject result = throughput(QString("native-%1").arg(archive.name),
+                                      seconds, options.contentSize, error);
+      result["threads"] = static_cast<int>(threads);
+      runs.append(result);
+    }
+  }
+  if (options.subprocess) {
+    double seconds = bestOf(
+        options.repeat,
+        [&](std::string &why) { return scriptDecrypt(v1, workDir, why); },
+        error);
+    runs.append(
+        throughput("subprocess-v1", seconds, options.contentSize, error));
+  }
+  section["decrypt"] = runs;
+  fs::remove(v1);
+  fs::remove(v2);
+  return section;
+}
+
+// FILES_PER_DIRECTORY files per directory, every ARCHIVE_EVERY-th an archive
+QStringList writeScanCorpus(const fs::path &root, int files) {
+  QStringList archives;
+  for (int i = 0; i < files; ++i) {
+    fs::path directory =
+        root / ("d" + std::to_string(i / FILES_PER_DIRECTORY));
+    if (i % FILES_PER_DIRECTORY == 0) {
+      fs::create_directories(directory);
+    }
+    bool archive = i % ARCHIVE_EVERY == 0;
+    fs::path file =
+        directory / ("f" + std::to_string(i) + (archive ? ".senc" : ".txt"));
+    std::ofstream(file) << i;
+    if (archive) {
+      archives.append(QString::fromStdString(file.string()));
+    }
+  }
+  return archives;
+}
+} // namespace
+
+// Friend of FileCache, for timing the index persistence directly
+class Bench {
+public:
+  static double saveCache(FileCache &cache) {
+    QWriteLocker lock(&cache.cacheLock);
+    QElapsedTimer timer;
+    timer.start();
+    cache.saveCache();
+    return timer.nsecsElapsed() / 1e9;
+  }
+  static qint64 cacheFileSize(const FileCache &cache) {
+    return QFileInfo(cache.cacheFilePath).size();
+  }
+};
+
+namespace {
+QJsonObject benchIndex(const Options &options, const fs::path &workDir) {
+  QJsonObject section;
+  fs::path root = workDir / "tree";
+  QStringList archives = writeScanCorpus(root, options.files);
+  QString rootPath = QString::fromStdString(root.string());
+  std::string error;
+
+  {
+    FileCache cache;
+    auto scan = [&](bool useCache) {
+      qsizetype found = 0;
+      double seconds = bestOf(
+          options.repeat,
+          [&](std::string &) {
+            if (!useCache) {
+              cache.clearCache();
+            }
+            found = cache.findEncryptedFiles(rootPath, useCache).size();
+            return true;
+          },
+          error);
+      QJsonObject result = timing(useCache ? "warm" : "cold", seconds, error);
+      result["files"] = options.files;
+      result["archivesFound"] = static_cast<qint64>(found);
+      result["filesPerSecond"] = options.files / seconds;
+      return result;
+    };
+    QJsonObject cold = scan(false);
+    section["scan"] = QJsonArray{cold, scan(true)};
+  }
+
+  // Persistence against entry count, by decades up to the whole corpus
+  QJsonArray persistence;
+  for (qsizetype entries = 1000;; entries *= 10) {
+    entries = std::min(entries, archives.size());
+    QJsonObject result{{"entries", static_cast<qint64>(entries)}};
+    {
+      FileCache cache;
+      cache.clearCache();
+      cache.addToCache(archives.mid(0, entries));
+      double best = std::numeric_limits<double>::max();
+      for (int i = 0; i < options.repeat; ++i) {
+        best = std::min(best, Bench::saveCache(cache));
+      }
+      result["saveSeconds"] = best;
+      result["fileBytes"] = Bench::cacheFileSize(cache);
+    }
+    // Construction replays the log
+    double seconds = bestOf(
+        options.repeat,
+        [](std::string &) {
+          FileCache cache;
+          return true;
+        },
+        error);
+    result["loadSeconds"] = seconds;
+    persistence.append(result);
+    if (entries == archives.size()) {
+      break;
+    }
+  }
+  section["persistence"] = persistence;
+
+  // Sidebar insertion, fed in the batches the scan delivers
+  double seconds = bestOf(
+      options.repeat,
+      [&](std::string &) {
+        EncryptedFileModel model;
+        for (qsizetype i = 0; i < archives.size(); i += MODEL_BATCH_SIZE) {
+          model.addPaths(archives.mid(i, MODEL_BATCH_SIZE));
+        }
+        return true;
+      },
+      error);
+  QJsonObject insert = timing("addPaths", seconds, error);
+  insert["rows"] = static_cast<qint64>(archives.size());
+  if (!archives.isEmpty()) {
+    insert["microsecondsPerRow"] = seconds * 1e6 / archives.size();
+  }
+  section["modelInsert"] = insert;
+
+  fs::remove_all(root);
+  return section;
+}
+
+QJsonObject benchRender(const Options &options, const fs::path &workDir) {
+  QJsonObject section;
+  std::string error;
+
+  QImage source(SOURCE_IMAGE_SIZE, QImage::Format_ARGB32_Premultiplied);
+  {
+    QPainter painter(&source);
+    QLinearGradient gradient(0, 0, source.width(), source.height());
+    gradient.setColorAt(0, Qt::darkBlue);
+    gradient.setColorAt(1, Qt::yellow);
+    painter.fillRect(source.rect(), gradient);
+  }
+
+  std::shared_ptr<ImagePyramid> pyramid;
+  QJsonArray image;
+  image.append(timing("pyramid-build",
+                      bestOf(
+                          options.repeat,
+                          [&](std::string &) {
+                            pyramid = std::make_shared<ImagePyramid>(source);
+                            return !pyramid->isNull();
+                          },
+                          error),
+                      error));
+  for (auto mode : {Qt::FastTransformation, Qt::SmoothTransformation}) {
+    bool smooth = mode == Qt::SmoothTransformation;
+    image.append(timing(smooth ? "pyramid-smooth" : "pyramid-fast",
+                        bestOf(
+                            options.repeat,
+                            [&](std::string &) {
+                              return !pyramid->render(VIEW_SIZE, mode)
+                                          .isNull();
+                            },
+                            error),
+                        error));
+    image.append(timing(smooth ? "original-smooth" : "original-fast",
+                        bestOf(
+                            options.repeat,
+                            [&](std::string &) {
+                              return !source
+                                          .scaled(VIEW_SIZE,
+                                                  Qt::KeepAspectRatio, mode)
+                                          .isNull();
+                            },
+                            error),
+                        error));
+  }
+  section["imageScale"] = image;
+
+  QString pdfPath = QString::fromStdString((workDir / "doc.pdf").string());
+  {
+    QPdfWriter writer(pdfPath);
+    QPainter painter(&writer);
+    for (int page = 0; page < PDF_PAGES; ++page) {
+      if (page > 0) {
+        writer.newPage();
+      }
+      painter.drawText(QRect(0, 0, writer.width(), writer.height()),
+                       Qt::AlignCenter | Qt::TextWordWrap,
+                       QString("Page %1\n").arg(page + 1).repeated(40));
+    }
+  }
+  double seconds = bestOf(
+      options.repeat,
+      [&](std::string &why) {
+        QPdfDocument document;
+        if (document.load(pdfPath) != QPdfDocument::Error::None) {
+          why = "Failed to load generated PDF";
+          return false;
+        }
+        QSizeF points = document.pagePointSize(0);
+        QSize size = points.scaled(VIEW_SIZE, Qt::KeepAspectRatio).toSize();
+        return !document.render(0, size).isNull();
+      },
+      error);
+  QJsonObject pdf = timing("pdf-first-page", seconds, error);
+  pdf["pages"] = PDF_PAGES;
+  section["pdf"] = pdf;
+  return section;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  QGuiApplication app(argc, argv);
+  QCoreApplication::setApplicationName("SecureViewerBench");
+  // Keeps FileCache's index out of the user's application data
+  QStandardPaths::setTestModeEnabled(true);
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(
+      "Times the SecureViewer hot paths and prints the results as JSON");
+  parser.addHelpOption();
+  QCommandLineOption contentOption(
+      "content-mb", "Archive content size for the decrypt timings.", "MiB",
+      "64");
+  QCommandLineOption filesOption(
+      "files", "Files in the scan corpus (a quarter are archives).", "count",
+      "20000");
+  QCommandLineOption repeatOption("repeat", "Runs per figure; the best counts.",
+                                  "count", "3");
+  QCommandLineOption noSubprocessOption(
+      "no-subprocess", "Skip the script fallback (needs zsh and openssl).");
+  QCommandLineOption outputOption(
+      "output", "Write the JSON here instead of stdout.", "file");
+  parser.addOptions({contentOption, filesOption, repeatOption,
+                     noSubprocessOption, outputOption});
+  parser.process(app);
+
+  Options options;
+  options.contentSize =
+      std::max(1LL, parser.value(contentOption).toLongLong()) * 1024 * 1024;
+  options.files = std::max(1, parser.value(filesOption).toInt());
+  options.repeat = std::max(1, parser.value(repeatOption).toInt());
+  options.subprocess = !parser.isSet(noSubprocessOption);
+
+  QTemporaryDir temp(QDir::tempPath() + "/senc-bench-XXXXXX");
+  if (!temp.isValid()) {
+    std::fprintf(stderr, "Failed to create a work directory\n");
+    return 1;
+  }
+  fs::path workDir = temp.path().toStdString();
+
+  QJsonObject report{
+      {"schema", 1},
+      {"platform", QSysInfo::prettyProductName()},
+      {"cpu", QSysInfo::currentCpuArchitecture()},
+      {"cores", QThread::idealThreadCount()},
+      {"aes", QString::fromStdString(SencCrypto::kernelDescription())},
+      {"parameters",
+       QJsonObject{{"contentBytes", options.contentSize},
+                   {"files", options.files},
+                   {"repeat", options.repeat}}},
+  };
+  report["crypto"] = benchDecrypt(options, workDir);
+  report["index"] = benchIndex(options, workDir);
+  report["render"] = benchRender(options, workDir);
+
+  QByteArray json = QJsonDocument(report).toJson();
+  if (parser.isSet(outputOption)) {
+    QFile file(parser.value(outputOption));
+    if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+      std::fprintf(stderr, "Failed to write %s\n",
+                   qPrintable(parser.value(outputOption)));
+      return 1;
+    }
+  } else {
+    std::fwrite(json.constData(), 1, json.size(), stdout);
+  }
+  return 0;
+}
@@ -0,0 +1,204 @@
+#include "DecryptPrefetcher.h"
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QThread>
+#include <openssl/crypto.h>
+
+namespace {
+void wipe(QString &text) {
+  if (!text.isEmpty()) {
+    text.detach();
+    OPENSSL_cleanse(text.data(), text.size() * sizeof(QChar));
+  }
+  text.clear();
+}
+} // namespace
+
+DecryptPrefetcher::DecryptPrefetcher(SencKeyCache &keyCache)
+    : keyCache(keyCache) {
+  pool.setMaxThreadCount(1);
+  pool.setThreadPriority(QThread::LowPriority);
+}
+
+DecryptPrefetcher::~DecryptPrefetcher() { clear(); }
+
+void DecryptPrefetcher::setMemoryBudget(qint64 bytes) {
+  QMutexLocker lock(&mutex);
+  memoryBudget = qMax<qint64>(0, bytes);
+  evictLocked();
+}
+
+qint64 DecryptPrefetcher::memoryUsed() const {
+  QMutexLocker lock(&mutex);
+  return bytesUsed;
+}
+
+void DecryptPrefetcher::setNameFilter(
+    std::function<bool(const QString &)> filter) {
+  QMutexLocker lock(&mutex);
+  nameFilter = std::move(filter);
+}
+
+void DecryptPrefetcher::prefetch(const QStringList &paths,
+                                 const QString &password) {
+  pool.clear();
+
+  QStringList toQueue;
+  quint64 currentGeneration = 0;
+  {
+    QMutexLocker lock(&mutex);
+    if (password != this->password) {
+      // Nothing decrypted under the old password may be handed out now
+      ++generation;
+      wipe(this->password);
+      this->password = password;
+      for (const QString &path : cache.keys()) {
+        removeLocked(path);
+      }
+    }
+    currentGeneration = generation;
+
+    wantedPaths.clear();
+    for (const QString &path : paths.mid(0, prefetchDepth)) {
+      wantedPaths.insert(path);
+      // A cancelled run of a path that is wanted again won't be kept
+      if (!cache.contains(path) && (path != runningPath || cancelRunning)) {
+        toQueue.append(path);
+      }
+    }
+    if (!runningPath.isEmpty() && !wantedPaths.contains(runningPath)) {
+      cancelRunning = true;
+    }
+  }
+
+  for (const QString &path : toQueue) {
+    pool.start([this, path, currentGeneration]() {
+      run(path, currentGeneration);
+    });
+  }
+}
+
+bool DecryptPrefetcher::take(const QString &path, const QString &password,
+                             SencPlaintext &plaintext) {
+  QMutexLocker lock(&mutex);
+  auto it = cache.find(path);
+  if (it == cache.end() || it->generation != generation ||
+      password != this->password) {
+    return false;
+  }
+
+  QFileInfo info(path);
+  bool unchanged = info.exists() &&
+                   info.lastModified().toMSecsSinceEpoch() ==
+                       it->lastModified &&
+                   info.size() == it->fileSize;
+  if (unchanged) {
+    plaintext = std::move(*it->plaintext);
+  }
+  removeLocked(path);
+  return unchanged;
+}
+
+void DecryptPrefetcher::cancel() {
+  pool.clear();
+  {
+    QMutexLocker lock(&mutex);
+    wantedPaths.clear();
+    cancelRunning = true;
+  }
+  pool.waitForDone();
+}
+
+void DecryptPrefetcher::clear() {
+  cancel();
+  QMutexLocker lock(&mutex);
+  for (const QString &path : cache.keys()) {
+    removeLocked(path);
+  }
+  ++generation;
+  wipe(password);
+}
+
+void DecryptPrefetcher::run(const QString &path, quint64 jobGeneration) {
+  std::string secret;
+  std::function<bool(const QString &)> filter;
+  qint64 budget = 0;
+  {
+    QMutexLocker lock(&mutex);
+    if (jobGeneration != generation || !wantedPaths.contains(path) ||
+        cache.contains(path)) {
+      return;
+    }
+    runningPath = path;
+    cancelRunning = false;
+    secret = password.toStdString();
+    filter = nameFilter;
+    budget = memoryBudget;
+  }
+
+  Entry entry;
+  entry.generation = jobGeneration;
+  QFileInfo info(path);
+  entry.lastModified = info.lastModified().toMSecsSinceEpoch();
+  entry.fileSize = info.size();
+
+  // Decrypting something that can never fit would only evict useful entries
+  bool ok = entry.fileSize <= budget;
+  SencArchive archive;
+  SencKey key;
+  SencLayout layout;
+  std::string error;
+  if (ok) {
+    ok = archive.open(path.toStdString(), error) &&
+         archive.format() != SencArchive::Format::Unknown &&
+         keyCache.deriveKey(archive, secret, key, error) &&
+         archive.readLayout(key, layout, error);
+  }
+  if (ok) {
+    keyCache.insert(archive, secret, key);
+    ok = !filter || filter(QString::fromStdString(layout.originalName));
+  }
+  OPENSSL_cleanse(&secret[0], secret.size());
+
+  if (ok) {
+    // One core, so the file on screen keeps the rest of the machine
+    archive.setMaxThreads(1);
+    archive.setCancelFlag(&cancelRunning);
+    entry.plaintext = std::make_shared<SencPlaintext>();
+    ok = archive.decrypt(key, *entry.plaintext, error);
+  }
+
+  QMutexLocker lock(&mutex);
+  runningPath.clear();
+  if (ok && !cancelRunning && jobGeneration == generation &&
+      wantedPaths.contains(path)) {
+    insert(path, std::move(entry));
+  }
+}
+
+void DecryptPrefetcher::insert(const QString &path, Entry entry) {
+  removeLocked(path);
+  entry.bytes = static_cast<qint64>(entry.plaintext->buffer.capacity());
+  bytesUsed += entry.bytes;
+  cache.insert(path, std::move(entry));
+  recentPaths.append(path);
+  evictLocked();
+}
+
+void DecryptPrefetcher::evictLocked() {
+  while (bytesUsed > memoryBudget && !recentPaths.isEmpty()) {
+    removeLocked(recentPaths.first());
+  }
+}
+
+void DecryptPrefetcher::removeLocked(const QString &path) {
+  auto it = cache.find(path);
+  if (it != cache.end()) {
+    bytesUsed -= it->bytes;
+    if (it->plaintext) {
+      it->plaintext->clear();
+    }
+    cache.erase(it);
+  }
+  recentPaths.removeOne(path);
+}
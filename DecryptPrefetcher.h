@@ -0,0 +1,84 @@
+#ifndef DECRYPTPREFETCHER_H
+#define DECRYPTPREFETCHER_H
+
+#include "SencArchive.h"
+#include "SencKeyCache.h"
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+// Speculatively decrypts the archives the user is likely to open next (the
+// sidebar entries after the current one) into a small LRU of locked
+// plaintexts, so stepping through a folder doesn't wait on PBKDF2 and a full
+// decrypt every time.
+//
+// Work runs on a single low-priority thread, one archive at a time. A new
+// prefetch() drops queued work that is no longer wanted and cancels the
+// running decrypt if its archive dropped out of the list. Cached plaintext
+// counts against a memory budget; clear() cancels everything and wipes it.
+class DecryptPrefetcher {
+public:
+  explicit DecryptPrefetcher(SencKeyCache &keyCache);
+  ~DecryptPrefetcher();
+  DecryptPrefetcher(const DecryptPrefetcher &) = delete;
+  DecryptPrefetcher &operator=(const DecryptPrefetcher &) = delete;
+
+  void setDepth(int entries) { prefetchDepth = qMax(0, entries); }
+  int depth() const { return prefetchDepth; }
+  void setMemoryBudget(qint64 bytes);
+  qint64 memoryUsed() const;
+  // Archives whose original name fails the filter are skipped (e.g. video,
+  // which is streamed rather than decrypted up front)
+  void setNameFilter(std::function<bool(const QString &)> filter);
+
+  // Replaces the wanted set with `paths` (nearest first)
+  void prefetch(const QStringList &paths, const QString &password);
+  // Moves out a finished plaintext for `path` if it was decrypted with
+  // `password` and the file hasn't changed since
+  bool take(const QString &path, const QString &password,
+            SencPlaintext &plaintext);
+  void cancel();
+  void clear();
+
+  static constexpr int DEFAULT_DEPTH = 3;
+  static constexpr qint64 DEFAULT_MEMORY_BUDGET = 256LL * 1024 * 1024;
+
+private:
+  struct Entry {
+    std::shared_ptr<SencPlaintext> plaintext;
+    qint64 lastModified = 0;
+    qint64 fileSize = 0;
+    qint64 bytes = 0; // locked memory charged to the budget
+    quint64 generation = 0;
+  };
+
+  void run(const QString &path, quint64 generation);
+  void insert(const QString &path, Entry entry);
+  void evictLocked();
+  void removeLocked(const QString &path);
+
+  SencKeyCache &keyCache;
+  QThreadPool pool;
+
+  mutable QMutex mutex;
+  QHash<QString, Entry> cache;
+  QList<QString> recentPaths; // least recently inserted first
+  QSet<QString> wantedPaths;
+  QString runningPath;
+  QString password;
+  quint64 generation = 0; // bumped whenever the password is forgotten
+  qint64 bytesUsed = 0;
+  qint64 memoryBudget = DEFAULT_MEMORY_BUDGET;
+  std::function<bool(const QString &)> nameFilter;
+  int prefetchDepth = DEFAULT_DEPTH;
+  std::atomic<bool> cancelRunning{false};
+};
+
+#endif // DECRYPTPREFETCHER_H
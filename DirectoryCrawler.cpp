@@ -0,0 +1,334 @@
+#include "DirectoryCrawler.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#include <sys/attr.h>
+#include <sys/vnode.h>
+#elif defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+namespace {
+enum class EntryType { Directory, File, Other, Unknown };
+
+// Bulk listing buffer per call; large enough for a few hundred entries
+constexpr size_t LIST_BUFFER_SIZE = 64 * 1024;
+
+EntryType typeFromStat(int directoryFd, const char *name) {
+  struct stat st;
+  if (fstatat(directoryFd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+    return EntryType::Other;
+  }
+  if (S_ISDIR(st.st_mode)) {
+    return EntryType::Directory;
+  }
+  return S_ISREG(st.st_mode) ? EntryType::File : EntryType::Other;
+}
+
+[[maybe_unused]] EntryType typeFromDirent(unsigned char type) {
+  switch (type) {
+  case DT_DIR:
+    return EntryType::Directory;
+  case DT_REG:
+    return EntryType::File;
+  case DT_UNKNOWN:
+    return EntryType::Unknown;
+  default:
+    return EntryType::Other;
+  }
+}
+
+bool statAt(int directoryFd, const char *name,
+            DirectoryCrawler::FileStat &stat) {
+  struct stat st;
+  if (fstatat(directoryFd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+    return false;
+  }
+  stat.lastModified = st.st_mtime;
+  stat.size = st.st_size;
+  return true;
+}
+
+// Portable fallback, also used if the bulk call isn't supported by the
+// filesystem. Takes ownership of `directoryFd`.
+// visit(name, type, stat) gets a null stat: the listing didn't carry one.
+template <typename Visit>
+void listWithReaddir(int directoryFd, const Visit &visit) {
+  DIR *dir = fdopendir(directoryFd);
+  if (!dir) {
+    close(directoryFd);
+    return;
+  }
+  while (dirent *entry = readdir(dir)) {
+#ifdef DT_UNKNOWN
+    EntryType type = typeFromDirent(entry->d_type);
+#else
+    EntryType type = EntryType::Unknown;
+#endif
+    if (type == EntryType::Unknown) {
+      type = typeFromStat(dirfd(dir), entry->d_name);
+    }
+    visit(entry->d_name, type, nullptr);
+  }
+  closedir(dir);
+}
+
+// Calls visit(name, type, stat) for every entry of the directory open on
+// `directoryFd`, and closes it. `stat` is null unless the listing itself
+// returned the entry's mtime and size.
+template <typename Visit>
+void listEntries(int directoryFd, const Visit &visit) {
+  thread_local std::vector<char> buffer(LIST_BUFFER_SIZE);
+
+#if defined(__APPLE__)
+  attrlist attributes{};
+  attributes.bitmapcount = ATTR_BIT_MAP_COUNT;
+  attributes.commonattr = ATTR_CMN_RETURNED_ATTRS | ATTR_CMN_NAME |
+                          ATTR_CMN_OBJTYPE | ATTR_CMN_MODTIME;
+  attributes.fileattr = ATTR_FILE_DATALENGTH;
+
+  for (;;) {
+    int count = getattrlistbulk(directoryFd, &attributes, buffer.data(),
+                                buffer.size(), FSOPT_PACK_INV_ATTRS);
+    if (count < 0) {
+      if (errno == ENOTSUP) {
+        listWithReaddir(directoryFd, visit);
+        return;
+      }
+      break;
+    }
+    if (count == 0) {
+      break;
+    }
+
+    // Each record: u32 length, returned attribute set, then the requested
+    // attributes in bit order (name reference, object type, modification
+    // time, data length). Invalid ones are packed with default values.
+    const char *record = buffer.data();
+    for (int i = 0; i < count; ++i) {
+      uint32_t length = 0;
+      std::memcpy(&length, record, sizeof(length));
+      const char *field = record + sizeof(length);
+
+      attribute_set_t returned;
+      std::memcpy(&returned, field, sizeof(returned));
+      field += sizeof(returned);
+
+      attrreference_t nameReference;
+      std::memcpy(&nameReference, field, sizeof(nameReference));
+      const char *name = field + nameReference.attr_dataoffset;
+      field += sizeof(nameReference);
+
+      fsobj_type_t objectType = VNON;
+      std::memcpy(&objectType, field, sizeof(objectType));
+      field += sizeof(objectType);
+
+      timespec modified{};
+      std::memcpy(&modified, field, sizeof(modified));
+      field += sizeof(modified);
+
+      off_t dataLength = 0;
+      std::memcpy(&dataLength, field, sizeof(dataLength));
+
+      DirectoryCrawler::FileStat stat{modified.tv_sec, dataLength};
+      bool hasStat = (returned.commonattr & ATTR_CMN_MODTIME) &&
+                     (returned.fileattr & ATTR_FILE_DATALENGTH);
+
+      EntryType type = EntryType::Other;
+      if (!(returned.commonattr & ATTR_CMN_OBJTYPE)) {
+        type = typeFromStat(directoryFd, name);
+      } else if (objectType == VDIR) {
+        type = EntryType::Directory;
+      } else if (objectType == VREG) {
+        type = EntryType::File;
+      }
+      visit(name, type, hasStat ? &stat : nullptr);
+      record += length;
+    }
+  }
+  close(directoryFd);
+#elif defined(__linux__)
+  struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+  };
+
+  for (;;) {
+    long bytes = syscall(SYS_getdents64, directoryFd, buffer.data(),
+                         buffer.size());
+    if (bytes < 0 && errno == ENOSYS) {
+      listWithReaddir(directoryFd, visit);
+      return;
+    }
+    if (bytes <= 0) {
+      break;
+    }
+    for (long offset = 0; offset < bytes;) {
+      auto *entry =
+          reinterpret_cast<const LinuxDirent64 *>(buffer.data() + offset);
+      EntryType type = typeFromDirent(entry->d_type);
+      if (type == EntryType::Unknown) {
+        type = typeFromStat(directoryFd, entry->d_name);
+      }
+      visit(entry->d_name, type, nullptr);
+      offset += entry->d_reclen;
+    }
+  }
+  close(directoryFd);
+#else
+  listWithReaddir(directoryFd, visit);
+#endif
+}
+} // namespace
+
+uint64_t DirectoryCrawler::crawl(const std::string &root,
+                                 const MatchFunction &onMatch) {
+  unsigned threads = threadCount;
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  queues.clear();
+  for (unsigned i = 0; i < threads; ++i) {
+    queues.push_back(std::make_unique<WorkQueue>());
+  }
+  listed = 0;
+  outstanding = 0;
+
+  std::string start = root;
+  while (start.size() > 1 && start.back() == '/') {
+    start.pop_back();
+  }
+  push(0, start);
+
+  // The calling thread is worker 0
+  std::vector<std::thread> workers;
+  for (unsigned i = 1; i < threads; ++i) {
+    workers.emplace_back([this, i, &onMatch]() { work(i, onMatch); });
+  }
+  work(0, onMatch);
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+
+  queues.clear();
+  return listed;
+}
+
+void DirectoryCrawler::work(unsigned self, const MatchFunction &onMatch) {
+  std::string directory;
+  while (nextDirectory(self, directory)) {
+    listDirectory(self, directory, onMatch);
+    outstanding.fetch_sub(1);
+  }
+}
+
+bool DirectoryCrawler::nextDirectory(unsigned self, std::string &directory) {
+  unsigned idleRounds = 0;
+  while (!cancelled) {
+    {
+      WorkQueue &own = *queues[self];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (!own.directories.empty()) {
+        directory = std::move(own.directories.back());
+        own.directories.pop_back();
+        return true;
+      }
+    }
+
+    for (size_t i = 1; i < queues.size(); ++i) {
+      WorkQueue &victim = *queues[(self + i) % queues.size()];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.directories.empty()) {
+        directory = std::move(victim.directories.front());
+        victim.directories.pop_front();
+        return true;
+      }
+    }
+
+    // Nothing to steal. Finished once no directory is queued or being
+    // listed anywhere, otherwise someone may still push more.
+    if (outstanding == 0) {
+      return false;
+    }
+    if (++idleRounds < 64) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  }
+  return false;
+}
+
+void DirectoryCrawler::push(unsigned self, std::string directory) {
+  outstanding.fetch_add(1);
+  WorkQueue &own = *queues[self];
+  std::lock_guard<std::mutex> lock(own.mutex);
+  own.directories.push_back(std::move(directory));
+}
+
+void DirectoryCrawler::listDirectory(unsigned self,
+                                     const std::string &directory,
+                                     const MatchFunction &onMatch) {
+  int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return; // unreadable: nothing below it is reachable anyway
+  }
+  uint64_t listedSoFar = listed.fetch_add(1) + 1;
+  if (onDirectory) {
+    onDirectory(directory);
+  }
+
+  std::string path;
+  listEntries(fd, [&](const char *name, EntryType type,
+                      const FileStat *listedStat) {
+    if (cancelled || !wanted(directory, name, path)) {
+      return;
+    }
+    if (type == EntryType::Directory) {
+      if (!skip || !skip(path)) {
+        push(self, path);
+      }
+    } else if (type == EntryType::File && path.size() > suffix.size() &&
+               path.compare(path.size() - suffix.size(), suffix.size(),
+                            suffix) == 0) {
+      // Only matches need the stat; `fd` stays open until listEntries is
+      // done with it
+      FileStat stat;
+      if (listedStat) {
+        stat = *listedStat;
+      } else if (!statAt(fd, name, stat)) {
+        return; // gone since it was listed
+      }
+      onMatch(path, stat);
+    }
+  });
+  if (progress) {
+    progress(listedSoFar);
+  }
+}
+
+bool DirectoryCrawler::wanted(const std::string &parent, const char *name,
+                              std::string &path) const {
+  // Also covers "." and ".."
+  if (name[0] == '.') {
+    return false;
+  }
+  path = parent;
+  if (path.empty() || path.back() != '/') {
+    path += '/';
+  }
+  path += name;
+  return true;
+}
@@ -0,0 +1,93 @@
+#ifndef DIRECTORYCRAWLER_H
+#define DIRECTORYCRAWLER_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Multi-threaded recursive search for files with a given suffix.
+//
+// Every worker owns a deque of directories still to list: it pushes the
+// subdirectories it finds and pops from the back (depth first, so it stays in
+// one part of the tree), and an idle worker steals from the front of someone
+// else's deque (the shallowest, largest remaining subtrees). Directories are
+// pruned before they are queued, so excluded and hidden trees are never
+// opened. Listings come from getdents64 on Linux and getattrlistbulk on
+// macOS, which return names and types in bulk without a stat per entry.
+//
+// Symlinks are never followed, and hidden entries are skipped.
+class DirectoryCrawler {
+public:
+  // What a match looked like when it was listed
+  struct FileStat {
+    int64_t lastModified = 0; // seconds since the epoch
+    int64_t size = 0;
+  };
+
+  // Returns true for a directory (absolute path) that shouldn't be entered
+  using SkipFunction = std::function<bool(const std::string &)>;
+  // Called from worker threads, once per matching regular file. The stat
+  // comes with the bulk listing on macOS and from an fstatat against the
+  // open directory elsewhere, so callers needn't stat the path again.
+  using MatchFunction =
+      std::function<void(const std::string &path, const FileStat &stat)>;
+  // Called from worker threads after each directory has been listed
+  using ProgressFunction = std::function<void(uint64_t directoriesListed)>;
+  // Called from worker threads for each directory (absolute path) just
+  // before it is listed
+  using DirectoryFunction = std::function<void(const std::string &)>;
+
+  DirectoryCrawler() = default;
+  DirectoryCrawler(const DirectoryCrawler &) = delete;
+  DirectoryCrawler &operator=(const DirectoryCrawler &) = delete;
+
+  void setThreadCount(unsigned count) { threadCount = count; }
+  void setSuffix(const std::string &value) { suffix = value; }
+  void setSkipFunction(SkipFunction function) { skip = std::move(function); }
+  void setProgressFunction(ProgressFunction function) {
+    progress = std::move(function);
+  }
+  void setDirectoryFunction(DirectoryFunction function) {
+    onDirectory = std::move(function);
+  }
+
+  // Blocks until the tree under `root` has been searched or cancel() is
+  // called; returns the number of directories listed
+  uint64_t crawl(const std::string &root, const MatchFunction &onMatch);
+  // Safe from any thread; the running crawl() returns soon after
+  void cancel() { cancelled = true; }
+  bool isCancelled() const { return cancelled; }
+
+private:
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<std::string> directories;
+  };
+
+  void work(unsigned self, const MatchFunction &onMatch);
+  bool nextDirectory(unsigned self, std::string &directory);
+  void push(unsigned self, std::string directory);
+  void listDirectory(unsigned self, const std::string &directory,
+                     const MatchFunction &onMatch);
+  bool wanted(const std::string &parent, const char *name,
+              std::string &path) const;
+
+  unsigned threadCount = 0;
+  std::string suffix = ".senc";
+  SkipFunction skip;
+  ProgressFunction progress;
+  DirectoryFunction onDirectory;
+
+  std::vector<std::unique_ptr<WorkQueue>> queues;
+  // Directories queued or being listed; the crawl is done when it hits zero
+  std::atomic<uint64_t> outstanding{0};
+  std::atomic<uint64_t> listed{0};
+  std::atomic<bool> cancelled{false};
+};
+
+#endif // DIRECTORYCRAWLER_H
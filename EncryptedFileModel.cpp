@@ -0,0 +1,199 @@
+#include "EncryptedFileModel.h"
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QLocale>
+#include <QPalette>
+#include <algorithm>
+
+EncryptedFileModel::EncryptedFileModel(QObject *parent)
+    : QAbstractListModel(parent) {}
+
+int EncryptedFileModel::rowCount(const QModelIndex &parent) const {
+  return parent.isValid() ? 0 : static_cast<int>(entries.size());
+}
+
+QVariant EncryptedFileModel::data(const QModelIndex &index, int role) const {
+  if (!index.isValid() || index.row() >= entries.size()) {
+    return QVariant();
+  }
+
+  const Entry &entry = entries[index.row()];
+  const Metadata &metadata = entry.metadata;
+  switch (role) {
+  case Qt::DisplayRole:
+    return displayName(entry);
+  case Qt::ToolTipRole:
+    if (metadata.mimeType.isEmpty() && metadata.originalSize < 0) {
+      return entry.path;
+    }
+    return QString("%1\n%2, %3")
+        .arg(entry.path,
+             metadata.mimeType.isEmpty() ? QString("unknown type")
+                                         : metadata.mimeType,
+             QLocale().formattedDataSize(qMax<qint64>(metadata.originalSize,
+                                                      0)));
+  case Qt::DecorationRole:
+    if (thumbnails) {
+      QPixmap preview = thumbnails(entry.path);
+      if (!preview.isNull()) {
+        return preview;
+      }
+    }
+    return QVariant();
+  case PathRole:
+    return entry.path;
+  case NameSortRole:
+    return entry.nameKey;
+  case SizeRole:
+    return metadata.originalSize;
+  case MimeTypeRole:
+    return metadata.mimeType;
+  case GroupSortRole:
+    return entry.groupKey;
+  case Qt::ForegroundRole:
+    // Greyed out until background validation confirms the file is there
+    if (entry.stale) {
+      return QGuiApplication::palette().color(QPalette::Disabled,
+                                              QPalette::Text);
+    }
+    return QVariant();
+  default:
+    return QVariant();
+  }
+}
+
+void EncryptedFileModel::addPaths(const QStringList &paths, bool stale) {
+  QVector<Entry> added;
+  for (const QString &path : paths) {
+    if (rows.contains(path)) {
+      continue;
+    }
+    // Reserve the row now so duplicates within `paths` are dropped too
+    rows.insert(path, static_cast<int>(entries.size() + added.size()));
+    Entry entry{path, QFileInfo(path).fileName(), stale};
+    updateSortKeys(entry);
+    added.append(entry);
+  }
+  if (added.isEmpty()) {
+    return;
+  }
+
+  int first = static_cast<int>(entries.size());
+  beginInsertRows(QModelIndex(), first,
+                  first + static_cast<int>(added.size()) - 1);
+  entries += added;
+  endInsertRows();
+}
+
+void EncryptedFileModel::removePaths(const QStringList &paths) {
+  QVector<int> doomed;
+  for (const QString &path : paths) {
+    int row = rows.value(path, -1);
+    if (row >= 0) {
+      doomed.append(row);
+    }
+  }
+  if (doomed.isEmpty()) {
+    return;
+  }
+
+  // Remove contiguous runs from the bottom up so earlier rows keep their
+  // indices until their own run is removed
+  std::sort(doomed.begin(), doomed.end());
+  doomed.erase(std::unique(doomed.begin(), doomed.end()), doomed.end());
+  int lowest = doomed.first();
+  int end = static_cast<int>(doomed.size()) - 1;
+  while (end >= 0) {
+    int start = end;
+    while (start > 0 && doomed[start - 1] == doomed[start] - 1) {
+      --start;
+    }
+    int firstRow = doomed[start];
+    int lastRow = doomed[end];
+    beginRemoveRows(QModelIndex(), firstRow, lastRow);
+    for (int row = firstRow; row <= lastRow; ++row) {
+      rows.remove(entries[row].path);
+    }
+    entries.remove(firstRow, lastRow - firstRow + 1);
+    endRemoveRows();
+    end = start - 1;
+  }
+  reindexFrom(lowest);
+}
+
+void EncryptedFileModel::setStale(const QStringList &paths, bool stale) {
+  for (const QString &path : paths) {
+    int row = rows.value(path, -1);
+    if (row >= 0 && entries[row].stale != stale) {
+      entries[row].stale = stale;
+      QModelIndex changed = index(row);
+      emit dataChanged(changed, changed, {Qt::ForegroundRole});
+    }
+  }
+}
+
+void EncryptedFileModel::setMetadata(const QHash<QString, Metadata> &updates) {
+  int first = -1;
+  int last = -1;
+  for (auto it = updates.cbegin(); it != updates.cend(); ++it) {
+    int row = rows.value(it.key(), -1);
+    if (row < 0) {
+      continue;
+    }
+    entries[row].metadata = it.value();
+    updateSortKeys(entries[row]);
+    first = first < 0 ? row : qMin(first, row);
+    last = qMax(last, row);
+  }
+  if (first >= 0) {
+    emit dataChanged(index(first), index(last));
+  }
+}
+
+const QString &EncryptedFileModel::displayName(const Entry &entry) {
+  return entry.metadata.originalName.isEmpty() ? entry.name
+                                               : entry.metadata.originalName;
+}
+
+void EncryptedFileModel::updateSortKeys(Entry &entry) {
+  entry.nameKey = displayName(entry).toLower();
+  // "image/png" groups as "image"; unknown types sort after every group
+  const QString &mimeType = entry.metadata.mimeType;
+  QString group = mimeType.isEmpty() ? QStringLiteral("~")
+                                     : mimeType.section('/', 0, 0);
+  entry.groupKey = group + '\n' + entry.nameKey;
+}
+
+void EncryptedFileModel::thumbnailsChanged(const QStringList &paths) {
+  if (paths.isEmpty()) {
+    if (!entries.isEmpty()) {
+      emit dataChanged(index(0), index(static_cast<int>(entries.size()) - 1),
+                       {Qt::DecorationRole});
+    }
+    return;
+  }
+  for (const QString &path : paths) {
+    int row = rows.value(path, -1);
+    if (row >= 0) {
+      QModelIndex changed = index(row);
+      emit dataChanged(changed, changed, {Qt::DecorationRole});
+    }
+  }
+}
+
+void EncryptedFileModel::clear() {
+  beginResetModel();
+  entries.clear();
+  rows.clear();
+  endResetModel();
+}
+
+QString EncryptedFileModel::pathAt(int row) const {
+  return row >= 0 && row < entries.size() ? entries[row].path : QString();
+}
+
+void EncryptedFileModel::reindexFrom(int row) {
+  for (int i = row; i < entries.size(); ++i) {
+    rows[entries[i].path] = i;
+  }
+}
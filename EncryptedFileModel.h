@@ -0,0 +1,86 @@
+#ifndef ENCRYPTEDFILEMODEL_H
+#define ENCRYPTEDFILEMODEL_H
+
+#include <QAbstractListModel>
+#include <QHash>
+#include <QPixmap>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <functional>
+
+// Flat list of archive paths behind the sidebar's QListView. Rows are looked
+// up by path through a hash, so adding, removing and updating entries never
+// scans the list, and changes are applied as row inserts/removals rather
+// than model resets.
+//
+// Rows show the archive's file name until its metadata (original name, MIME
+// type, size) is known. The sort roles let a proxy order or group the list
+// without anything being decrypted.
+class EncryptedFileModel : public QAbstractListModel {
+  Q_OBJECT
+
+public:
+  enum Roles {
+    PathRole = Qt::UserRole,
+    NameSortRole,
+    SizeRole, // original size, -1 if unknown
+    MimeTypeRole,
+    GroupSortRole // type group, then name
+  };
+
+  struct Metadata {
+    QString originalName;
+    QString mimeType;
+    qint64 originalSize = -1;
+  };
+
+  // Supplies Qt::DecorationRole; asked only for rows being drawn, so it may
+  // decrypt on demand. A null pixmap means "no preview".
+  using ThumbnailFunction = std::function<QPixmap(const QString &path)>;
+
+  explicit EncryptedFileModel(QObject *parent = nullptr);
+
+  int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+  QVariant data(const QModelIndex &index,
+                int role = Qt::DisplayRole) const override;
+
+  // Appends the paths not already listed; `stale` rows are drawn greyed out
+  void addPaths(const QStringList &paths, bool stale = false);
+  void removePaths(const QStringList &paths);
+  void setStale(const QStringList &paths, bool stale);
+  // One dataChanged for the whole batch
+  void setMetadata(const QHash<QString, Metadata> &updates);
+  void setThumbnailFunction(ThumbnailFunction function) {
+    thumbnails = std::move(function);
+  }
+  // Repaints previews; with no paths, every row's
+  void thumbnailsChanged(const QStringList &paths = {});
+  void clear();
+
+  bool contains(const QString &path) const { return rows.contains(path); }
+  int rowOf(const QString &path) const { return rows.value(path, -1); }
+  QString pathAt(int row) const;
+
+private:
+  struct Entry {
+    QString path;
+    QString name;
+    bool stale = false;
+    Metadata metadata;
+    // Precomputed: a sorting proxy asks for these O(n log n) times
+    QString nameKey;
+    QString groupKey;
+  };
+
+  static const QString &displayName(const Entry &entry);
+  static void updateSortKeys(Entry &entry);
+
+  void reindexFrom(int row);
+
+  QVector<Entry> entries;
+  QHash<QString, int> rows; // path -> row
+  ThumbnailFunction thumbnails;
+};
+
+#endif // ENCRYPTEDFILEMODEL_H
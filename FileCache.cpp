@@ -1,17 +1,26 @@
 #include "FileCache.h"
+#include "DirectoryCrawler.h"
+#include "PerfTrace.h"
+#include "RecursiveWatcher.h"
+#include <QDataStream>
 #include <QDir>
-#include <QDirIterator>
-#include <QJsonArray>
-#include <QJsonDocument>
-#include <QJsonObject>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QSaveFile>
 #include <QStandardPaths>
+#include <QThread>
+#include <cstring>
+#include <memory>
+#include <unordered_set>
 
 FileCache::FileCache(QObject *parent) : QObject(parent) {
   // Set up cache file in app data location
   QString cacheDir =
       QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
   QDir().mkpath(cacheDir);
-  cacheFilePath = cacheDir + "/file_cache.json";
+  cacheFilePath = cacheDir + "/file_cache.idx";
+  // Superseded by the binary index; a rescan repopulates it
+  QFile::remove(cacheDir + "/file_cache.json");
 
   // Initialize excluded directories
   excludedDirs = {
@@ -19,207 +28,816 @@ FileCache::FileCache(QObject *parent) : QObject(parent) {
       "/snap",           "/var/run",       "/var/lock", "/private/var/vm",
       "/Library/Caches", "/System/Volumes"};
 
-  setupFileWatcher();
+  // Validation is stat-bound (and latency-bound on network homes), so it
+  // can use more threads than there are cores
+  validationPool.setMaxThreadCount(8);
+
+  changeTimer = new QTimer(this);
+  changeTimer->setSingleShot(true);
+  changeTimer->setInterval(CHANGE_INTERVAL_MS);
+  connect(changeTimer, &QTimer::timeout, this, &FileCache::flushChanges);
+
+  setupWatcher();
   loadCache();
 }
 
 FileCache::~FileCache() {
-  saveCache();
-  delete fileWatcher;
+  cancelSearches();
+  validationPool.clear();
+  validationPool.waitForDone();
+  QWriteLocker lock(&cacheLock);
+  compactLogIfNeeded();
+  logFile.close();
 }
 
-void FileCache::setupFileWatcher() {
-  fileWatcher = new QFileSystemWatcher(this);
-  connect(fileWatcher, &QFileSystemWatcher::fileChanged, this,
-          &FileCache::handleFileChanged);
-  connect(fileWatcher, &QFileSystemWatcher::directoryChanged, this,
-          &FileCache::handleDirectoryChanged);
+void FileCache::setupWatcher() {
+  watcher = new RecursiveWatcher(this);
+  watcher->setSuffix(".senc");
+  watcher->setSkipFunction(excludedDirectoryFilter());
+  connect(watcher, &RecursiveWatcher::pathsChanged, this,
+          &FileCache::handlePathsChanged);
 }
 
-void FileCache::handleFileChanged(const QString &path) {
-  if (path.endsWith(".senc")) {
+void FileCache::handlePathsChanged(const QStringList &paths) {
+  PerfTrace::count("watcher.changedPaths", paths.size());
+  // A reported path only says "look here": it may have been created,
+  // modified, removed or renamed
+  QStringList missing;
+  for (const QString &path : paths) {
     QFileInfo info(path);
-    if (!info.exists()) {
-      // File was deleted
-      removeFromCache(path);
-    } else {
-      // File was modified
+    if (info.isDir()) {
+      rescanDirectory(path);
+    } else if (info.isFile() && path.endsWith(".senc")) {
       addToCache(path);
+    } else {
+      missing << path;
     }
-    emit cacheUpdated();
   }
-}
+  if (missing.isEmpty()) {
+    return;
+  }
 
-void FileCache::handleDirectoryChanged(const QString &path) {
-  // Scan directory for new .senc files
-  QDir dir(path);
-  QStringList sencFiles = dir.entryList(QStringList() << "*.senc", QDir::Files);
+  QWriteLocker lock(&cacheLock);
+  QSet<QString> vanishedDirectories;
+  for (const QString &path : missing) {
+    if (removeEntry(path)) {
+      recordChange(path, Change::Removed);
+    } else if (!path.endsWith(".senc")) {
+      vanishedDirectories.insert(path);
+    }
+  }
+  if (vanishedDirectories.isEmpty()) {
+    return;
+  }
 
-  for (const QString &file : sencFiles) {
-    QString fullPath = dir.filePath(file);
-    if (!cache.contains(fullPath)) {
-      addToCache(fullPath);
+  // One pass over the cache for the whole batch, walking each entry's
+  // ancestors rather than comparing it against every directory
+  QStringList doomed;
+  for (const auto &entry : cache) {
+    for (int slash = entry.path.lastIndexOf('/'); slash > 0;
+         slash = entry.path.lastIndexOf('/', slash - 1)) {
+      if (vanishedDirectories.contains(entry.path.left(slash))) {
+        doomed << entry.path;
+        break;
+      }
     }
   }
+  for (const QString &path : doomed) {
+    removeEntry(path);
+    recordChange(path, Change::Removed);
+  }
+}
 
-  emit cacheUpdated();
+void FileCache::rescanDirectory(const QString &directory) {
+  // New or renamed trees can be deep; list them off the GUI thread and diff
+  // against the cache once the listing is back
+  auto skip = excludedDirectoryFilter();
+  validationPool.start([this, directory, skip]() {
+    QList<CacheEntry> found;
+    QMutex foundMutex;
+    DirectoryCrawler crawler;
+    crawler.setThreadCount(2);
+    crawler.setSkipFunction(skip);
+    if (!registerCrawler(&crawler)) {
+      return;
+    }
+    crawler.crawl(directory.toStdString(),
+                  [&](const std::string &path,
+                      const DirectoryCrawler::FileStat &stat) {
+      CacheEntry entry{QString::fromStdString(path), stat.lastModified,
+                       stat.size, false};
+      QMutexLocker lock(&foundMutex);
+      found.append(entry);
+    });
+    unregisterCrawler(&crawler);
+    if (crawler.isCancelled()) {
+      return; // a partial listing would drop entries it never reached
+    }
+    QMetaObject::invokeMethod(
+        this, [this, directory, found]() { applyRescan(directory, found); },
+        Qt::QueuedConnection);
+  });
 }
 
-void FileCache::watchDirectory(const QString &path) {
-  if (!watchedDirectories.contains(path)) {
-    fileWatcher->addPath(path);
-    watchedDirectories.insert(path);
-
-    // Watch subdirectories too
-    QDirIterator it(path, QDir::Dirs | QDir::NoDotAndDotDot,
-                    QDirIterator::Subdirectories);
-    while (it.hasNext()) {
-      QString subdir = it.next();
-      if (!shouldSkipDirectory(subdir)) {
-        fileWatcher->addPath(subdir);
-        watchedDirectories.insert(subdir);
-      }
+void FileCache::applyRescan(const QString &directory,
+                            const QList<CacheEntry> &found) {
+  QWriteLocker lock(&cacheLock);
+  mergeListing(directory, found, true);
+}
+
+void FileCache::mergeListing(const QString &directory,
+                             const QList<CacheEntry> &found, bool recursive) {
+  QSet<QString> present;
+  for (const CacheEntry &entry : found) {
+    present.insert(entry.path);
+    putEntry(entry);
+  }
+
+  QString prefix = directory + "/";
+  QStringList gone;
+  for (const auto &entry : cache) {
+    if (entry.path.startsWith(prefix) && !present.contains(entry.path) &&
+        (recursive || entry.path.indexOf('/', prefix.size()) < 0)) {
+      gone << entry.path;
     }
   }
+  for (const QString &path : gone) {
+    removeEntry(path);
+    recordChange(path, Change::Removed);
+  }
+}
+
+void FileCache::cancelSearches() {
+  QMutexLocker lock(&crawlersMutex);
+  searchesCancelled = true;
+  for (DirectoryCrawler *crawler : crawlers) {
+    crawler->cancel();
+  }
+}
+
+bool FileCache::registerCrawler(DirectoryCrawler *crawler) {
+  QMutexLocker lock(&crawlersMutex);
+  if (searchesCancelled) {
+    return false;
+  }
+  crawlers.insert(crawler);
+  return true;
+}
+
+void FileCache::unregisterCrawler(DirectoryCrawler *crawler) {
+  QMutexLocker lock(&crawlersMutex);
+  crawlers.remove(crawler);
+}
+
+std::function<bool(const std::string &)>
+FileCache::excludedDirectoryFilter() const {
+  // A private copy, so crawls on other threads never see excludedDirs change
+  auto excluded = std::make_shared<std::unordered_set<std::string>>();
+  for (const QString &dir : excludedDirs) {
+    excluded->insert(dir.toStdString());
+  }
+  return [excluded](const std::string &dir) {
+    return excluded->count(dir) != 0;
+  };
+}
+
+void FileCache::watchDirectory(const QString &path) {
+  // The watcher's notifiers belong to this object's thread; searches call
+  // in from a worker
+  QMetaObject::invokeMethod(this, [this, path]() { watcher->watch(path); });
 }
 
 void FileCache::removeFromCache(const QString &path) {
-  cache.remove(path);
-  saveCache();
+  QWriteLocker lock(&cacheLock);
+  if (removeEntry(path)) {
+    recordChange(path, Change::Removed);
+  }
+}
+
+bool FileCache::removeEntry(const QString &path) {
+  auto it = cache.find(path);
+  if (it == cache.end()) {
+    return false;
+  }
+  // Taken out first: the append can compact the log into a snapshot of
+  // what is still in memory
+  CacheEntry removed = it.value();
+  cache.erase(it);
+  metadataIndex.remove(path);
+  appendToLog(LogOp::Remove, removed);
+  return true;
 }
 
 void FileCache::addToCache(const QString &path) {
   QFileInfo info(path);
   if (info.exists() && path.endsWith(".senc")) {
-    CacheEntry entry{path, info.lastModified().toSecsSinceEpoch(), info.size()};
-    cache.insert(path, entry);
-    fileWatcher->addPath(path);
-    saveCache();
+    CacheEntry entry{path, info.lastModified().toSecsSinceEpoch(), info.size(),
+                     false};
+    QWriteLocker lock(&cacheLock);
+    putEntry(entry);
   }
 }
 
-bool FileCache::CacheEntry::isValid() const {
-  QFileInfo info(path);
-  return info.exists() &&
-         info.lastModified().toSecsSinceEpoch() == lastModified &&
-         info.size() == size;
+void FileCache::addToCache(const QStringList &paths) {
+  QVector<CacheEntry> entries;
+  entries.reserve(paths.size());
+  for (const QString &path : paths) {
+    QFileInfo info(path);
+    if (info.exists() && path.endsWith(".senc")) {
+      entries.append(CacheEntry{path, info.lastModified().toSecsSinceEpoch(),
+                                info.size(), false});
+    }
+  }
+  QWriteLocker lock(&cacheLock);
+  for (const CacheEntry &entry : entries) {
+    putEntry(entry);
+  }
+}
+
+void FileCache::putEntry(const CacheEntry &entry) {
+  auto cached = cache.find(entry.path);
+  if (cached != cache.end() && cached->lastModified == entry.lastModified &&
+      cached->size == entry.size) {
+    cached->stale = false;
+    return;
+  }
+  recordChange(entry.path,
+               cached == cache.end() ? Change::Added : Change::Modified);
+  cache.insert(entry.path, entry);
+  metadataIndex.remove(entry.path); // describes the old contents
+  appendToLog(LogOp::Put, entry);
+}
+
+void FileCache::setMetadata(const QString &path,
+                            const ArchiveMetadata &metadata) {
+  QWriteLocker lock(&cacheLock);
+  auto it = cache.constFind(path);
+  if (it == cache.constEnd()) {
+    return;
+  }
+  IndexedMetadata indexed{metadata, it->lastModified, it->size};
+  metadataIndex.insert(path, indexed);
+  appendMetadataToLog(path, indexed);
+  recordChange(path, Change::Modified);
+}
+
+bool FileCache::metadata(const QString &path,
+                         ArchiveMetadata &metadata) const {
+  QReadLocker lock(&cacheLock);
+  auto it = cache.constFind(path);
+  auto indexed = metadataIndex.constFind(path);
+  // Only valid for the archive exactly as it was when it was read
+  if (it == cache.constEnd() || indexed == metadataIndex.constEnd() ||
+      indexed->lastModified != it->lastModified || indexed->size != it->size) {
+    return false;
+  }
+  metadata = indexed->metadata;
+  return true;
+}
+
+bool FileCache::stamp(const QString &path, qint64 &lastModified,
+                      qint64 &size) const {
+  QReadLocker lock(&cacheLock);
+  auto it = cache.constFind(path);
+  if (it == cache.constEnd()) {
+    return false;
+  }
+  lastModified = it->lastModified;
+  size = it->size;
+  return true;
+}
+
+bool FileCache::hasMetadata(const QString &path) const {
+  ArchiveMetadata unused;
+  return metadata(path, unused);
+}
+
+void FileCache::recordChange(const QString &path, Change change) {
+  // Fold successive changes to one path into their net effect
+  auto it = pendingChanges.find(path);
+  if (it == pendingChanges.end()) {
+    pendingChanges.insert(path, change);
+  } else if (*it == Change::Added && change == Change::Removed) {
+    pendingChanges.erase(it); // never seen by anyone
+  } else if (*it == Change::Added && change == Change::Modified) {
+    // still new to listeners
+  } else if (*it == Change::Removed && change == Change::Added) {
+    *it = Change::Modified;
+  } else {
+    *it = change;
+  }
+
+  // A fixed window rather than a restarting one, so a steady stream of
+  // changes still produces an update every CHANGE_INTERVAL_MS. The timer
+  // belongs to the owner thread; writers may be elsewhere.
+  if (!changesScheduled) {
+    changesScheduled = true;
+    QMetaObject::invokeMethod(this, [this]() { changeTimer->start(); });
+  }
+}
+
+void FileCache::flushChanges() {
+  QStringList added;
+  QStringList removed;
+  QStringList modified;
+  QWriteLocker lock(&cacheLock);
+  for (auto it = pendingChanges.cbegin(); it != pendingChanges.cend(); ++it) {
+    switch (it.value()) {
+    case Change::Added:
+      added << it.key();
+      break;
+    case Change::Removed:
+      removed << it.key();
+      break;
+    case Change::Modified:
+      modified << it.key();
+      break;
+    }
+  }
+  pendingChanges.clear();
+  changesScheduled = false;
+  // Never emit under the lock: a direct-connected slot may read the cache
+  lock.unlock();
+
+  if (!added.isEmpty() || !removed.isEmpty() || !modified.isEmpty()) {
+    emit cacheUpdated(added, removed, modified);
+  }
 }
 
 void FileCache::loadCache() {
   QFile file(cacheFilePath);
   if (!file.open(QIODevice::ReadOnly)) {
+    openLog();
     return;
   }
 
-  QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
-  QJsonObject root = doc.object();
-
-  // Check cache version and age
-  qint64 cacheTimestamp = root["timestamp"].toDouble();
-  if (QDateTime::currentSecsSinceEpoch() - cacheTimestamp >
-      MAX_CACHE_AGE_DAYS * 86400) {
-    // Cache too old, clear it
-    cache.clear();
+  // Last append is the last time the cache was touched
+  qint64 age =
+      QFileInfo(file).lastModified().secsTo(QDateTime::currentDateTime());
+  const qint64 headerSize = sizeof(LOG_MAGIC);
+  uchar *mapped =
+      file.size() >= headerSize ? file.map(0, file.size()) : nullptr;
+  if (!mapped || std::memcmp(mapped, LOG_MAGIC, headerSize) != 0 ||
+      age > MAX_CACHE_AGE_DAYS * 86400) {
+    // Unreadable, foreign or too old: start over
+    file.close();
+    QFile::remove(cacheFilePath);
+    openLog();
     return;
   }
 
-  QJsonArray entries = root["entries"].toArray();
-  for (const auto &entry : entries) {
-    QJsonObject obj = entry.toObject();
-    CacheEntry cacheEntry{obj["path"].toString(),
-                          static_cast<qint64>(obj["lastModified"].toDouble()),
-                          static_cast<qint64>(obj["size"].toDouble())};
-
-    // Only add valid entries to cache
-    if (cacheEntry.isValid()) {
-      cache.insert(cacheEntry.path, cacheEntry);
+  // Replay the log straight out of the mapping. Entries are validated when
+  // they are used rather than stat'ed here, so loading stays cheap.
+  QByteArray bytes = QByteArray::fromRawData(
+      reinterpret_cast<const char *>(mapped), file.size());
+  QDataStream in(bytes);
+  in.setByteOrder(QDataStream::LittleEndian);
+  in.skipRawData(headerSize);
+  qint64 validSize = headerSize;
+  while (!in.atEnd()) {
+    quint8 op = 0;
+    qint64 lastModified = 0, size = 0;
+    QByteArray path;
+    in >> op >> lastModified >> size >> path;
+    QByteArray name, mimeType;
+    qint64 originalSize = -1;
+    if (op == quint8(LogOp::Metadata)) {
+      in >> name >> mimeType >> originalSize;
+    }
+    if (in.status() != QDataStream::Ok) {
+      break; // torn final record
     }
+    QString filePath = QString::fromUtf8(path);
+    if (op == quint8(LogOp::Put)) {
+      cache.insert(filePath, CacheEntry{filePath, lastModified, size});
+    } else if (op == quint8(LogOp::Directory)) {
+      directoryMtimes.insert(filePath, lastModified);
+    } else if (op == quint8(LogOp::Metadata)) {
+      metadataIndex.insert(
+          filePath, IndexedMetadata{{QString::fromUtf8(name),
+                                     QString::fromUtf8(mimeType),
+                                     originalSize},
+                                    lastModified,
+                                    size});
+    } else {
+      cache.remove(filePath);
+      metadataIndex.remove(filePath);
+    }
+    validSize = in.device()->pos();
+    ++logRecords;
   }
+  bool torn = validSize != file.size();
+  file.unmap(mapped);
+  file.close();
+
+  if (torn) {
+    QFile::resize(cacheFilePath, validSize);
+  }
+  openLog();
+  compactLogIfNeeded();
 }
 
-void FileCache::saveCache() {
-  QJsonObject root;
-  root["timestamp"] = QDateTime::currentSecsSinceEpoch();
+bool FileCache::openLog() {
+  logFile.setFileName(cacheFilePath);
+  if (!logFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
+    return false;
+  }
+  if (logFile.size() == 0) {
+    logFile.write(LOG_MAGIC, sizeof(LOG_MAGIC));
+    logFile.flush();
+    logRecords = 0;
+  }
+  return true;
+}
 
-  QJsonArray entries;
-  for (const auto &entry : cache) {
-    QJsonObject obj;
-    obj["path"] = entry.path;
-    obj["lastModified"] = entry.lastModified;
-    obj["size"] = entry.size;
-    entries.append(obj);
+void FileCache::appendToLog(LogOp op, const CacheEntry &entry) {
+  appendToLog(op, QList<CacheEntry>{entry});
+}
+
+void FileCache::appendToLog(LogOp op, const QList<CacheEntry> &entries) {
+  if (!logFile.isOpen() || entries.isEmpty()) {
+    return;
   }
 
-  root["entries"] = entries;
+  QByteArray records;
+  QDataStream out(&records, QIODevice::WriteOnly);
+  out.setByteOrder(QDataStream::LittleEndian);
+  for (const CacheEntry &entry : entries) {
+    out << quint8(op) << entry.lastModified << entry.size
+        << entry.path.toUtf8();
+  }
+  logFile.write(records);
+  logFile.flush();
+  logRecords += entries.size();
+  compactLogIfNeeded();
+}
 
-  QFile file(cacheFilePath);
-  if (file.open(QIODevice::WriteOnly)) {
-    file.write(QJsonDocument(root).toJson());
+void FileCache::appendDirectoryToLog(const QString &path, qint64 mtime) {
+  if (!logFile.isOpen()) {
+    return;
   }
+
+  QByteArray record;
+  QDataStream out(&record, QIODevice::WriteOnly);
+  out.setByteOrder(QDataStream::LittleEndian);
+  out << quint8(LogOp::Directory) << mtime << qint64(0) << path.toUtf8();
+  logFile.write(record);
+  logFile.flush();
+  ++logRecords;
+  compactLogIfNeeded();
 }
 
-bool FileCache::shouldSkipDirectory(const QString &path) {
-  // Skip system directories and hidden folders
-  if (path.startsWith('.') || excludedDirs.contains(path)) {
-    return true;
+void FileCache::appendMetadataToLog(const QString &path,
+                                    const IndexedMetadata &indexed) {
+  if (!logFile.isOpen()) {
+    return;
   }
 
-  QFileInfo info(path);
-  // Skip if no read permission
-  if (!info.isReadable()) {
-    return true;
+  QByteArray record;
+  QDataStream out(&record, QIODevice::WriteOnly);
+  out.setByteOrder(QDataStream::LittleEndian);
+  out << quint8(LogOp::Metadata) << indexed.lastModified << indexed.size
+      << path.toUtf8() << indexed.metadata.originalName.toUtf8()
+      << indexed.metadata.mimeType.toUtf8() << indexed.metadata.originalSize;
+  logFile.write(record);
+  logFile.flush();
+  ++logRecords;
+  compactLogIfNeeded();
+}
+
+void FileCache::compactLogIfNeeded() {
+  qint64 liveRecords =
+      cache.size() + directoryMtimes.size() + metadataIndex.size();
+  qint64 deadRecords = logRecords - liveRecords;
+  if (deadRecords >= MIN_COMPACT_RECORDS && deadRecords > liveRecords) {
+    saveCache();
   }
+}
 
-  return false;
+void FileCache::saveCache() {
+  PerfScope scope("saveCache");
+  // Rewrite the log as one Put per live entry, atomically
+  QSaveFile file(cacheFilePath);
+  if (!file.open(QIODevice::WriteOnly)) {
+    return;
+  }
+
+  QDataStream out(&file);
+  out.setByteOrder(QDataStream::LittleEndian);
+  out.writeRawData(LOG_MAGIC, sizeof(LOG_MAGIC));
+  for (const auto &entry : cache) {
+    out << quint8(LogOp::Put) << entry.lastModified << entry.size
+        << entry.path.toUtf8();
+  }
+  for (auto it = directoryMtimes.cbegin(); it != directoryMtimes.cend();
+       ++it) {
+    out << quint8(LogOp::Directory) << it.value() << qint64(0)
+        << it.key().toUtf8();
+  }
+  // Metadata that no longer matches its archive is dropped here
+  qint64 metadataRecords = 0;
+  for (auto it = metadataIndex.begin(); it != metadataIndex.end();) {
+    auto entry = cache.constFind(it.key());
+    if (entry == cache.constEnd() || entry->lastModified != it->lastModified ||
+        entry->size != it->size) {
+      it = metadataIndex.erase(it);
+      continue;
+    }
+    out << quint8(LogOp::Metadata) << it->lastModified << it->size
+        << it.key().toUtf8() << it->metadata.originalName.toUtf8()
+        << it->metadata.mimeType.toUtf8() << it->metadata.originalSize;
+    ++metadataRecords;
+    ++it;
+  }
+  logFile.close();
+  if (file.commit()) {
+    logRecords = cache.size() + directoryMtimes.size() + metadataRecords;
+  }
+  openLog();
 }
 
 QStringList FileCache::findEncryptedFiles(const QString &startPath,
-                                          bool useCache) {
+                                          bool useCache,
+                                          const BatchFunction &onBatch) {
+  PerfScope scope("findEncryptedFiles");
   QStringList results;
+  if (searchesCancelled) {
+    return results;
+  }
 
   // Watch the start directory and its subdirectories
   watchDirectory(startPath);
 
   if (useCache) {
-    // First check cache for valid entries
-    for (const auto &entry : cache) {
-      if (entry.path.startsWith(startPath) && entry.isValid()) {
-        results << entry.path;
-      }
-    }
-
+    // Hand back what the cache knows straight away; entries are re-checked
+    // in the background and corrections stream out as signals
+    results = cachedPaths(startPath);
     if (!results.isEmpty()) {
+      if (onBatch && !searchesCancelled) {
+        onBatch(results, 0, static_cast<quint64>(results.size()));
+      }
+      QMetaObject::invokeMethod(
+          this, [this, startPath]() { validateEntries(startPath); },
+          Qt::QueuedConnection);
       return results;
     }
   }
 
-  // Perform actual search if cache miss
-  QDirIterator it(startPath, QStringList() << "*.senc",
-                  QDir::Files | QDir::NoSymLinks | QDir::NoDotAndDotDot,
-                  QDirIterator::Subdirectories);
-
-  while (it.hasNext()) {
-    QString filePath = it.next();
-    QFileInfo info(filePath);
-
-    if (shouldSkipDirectory(info.path())) {
-      continue;
+  // Perform actual search if cache miss. Exclusions are checked before a
+  // directory is queued, so excluded trees are never listed.
+  DirectoryCrawler crawler;
+  crawler.setThreadCount(static_cast<unsigned>(QThread::idealThreadCount()));
+  crawler.setSkipFunction(excludedDirectoryFilter());
+
+  // Hits are handed out in batches, on size or on time, so the caller can
+  // show results long before the crawl finishes
+  QMutex foundMutex;
+  QList<CacheEntry> found;
+  QStringList batch;
+  quint64 directoriesScanned = 0;
+  QElapsedTimer sinceBatch;
+  sinceBatch.start();
+  auto flushLocked = [&](bool force) {
+    // Nothing reaches the caller once it has cancelled
+    if (onBatch && !searchesCancelled &&
+        (force || batch.size() >= SEARCH_BATCH_SIZE ||
+         (sinceBatch.elapsed() >= SEARCH_BATCH_INTERVAL_MS &&
+          !batch.isEmpty()))) {
+      onBatch(batch, directoriesScanned, static_cast<quint64>(found.size()));
+      batch.clear();
+      sinceBatch.restart();
     }
-
-    // Update cache
-    CacheEntry entry{filePath, info.lastModified().toSecsSinceEpoch(),
-                     info.size()};
-    cache.insert(filePath, entry);
-    fileWatcher->addPath(filePath); // Watch the file
-    results << filePath;
+  };
+  crawler.setProgressFunction([&](uint64_t directories) {
+    QMutexLocker lock(&foundMutex);
+    directoriesScanned = qMax<quint64>(directoriesScanned, directories);
+    flushLocked(false);
+  });
+
+  if (!registerCrawler(&crawler)) {
+    return results;
+  }
+  // The crawler hands over the mtime and size it listed; a second stat per
+  // hit would cost a round trip each on a network home
+  crawler.crawl(startPath.toStdString(),
+                [&](const std::string &path,
+                    const DirectoryCrawler::FileStat &stat) {
+    QString filePath = QString::fromStdString(path);
+    CacheEntry entry{filePath, stat.lastModified, stat.size, false};
+    QMutexLocker lock(&foundMutex);
+    found.append(entry);
+    batch.append(filePath);
+    flushLocked(false);
+  });
+  unregisterCrawler(&crawler);
+  flushLocked(true);
+
+  // Merge under one write lock; readers only wait for this loop, never for
+  // the crawl
+  QWriteLocker lock(&cacheLock);
+  QList<CacheEntry> changed;
+  for (const CacheEntry &entry : found) {
+    // Update cache; only new or changed entries reach the log
+    auto cached = cache.find(entry.path);
+    if (cached == cache.end() || cached->lastModified != entry.lastModified ||
+        cached->size != entry.size) {
+      cache.insert(entry.path, entry);
+      changed << entry;
+    } else {
+      cached->stale = false;
+    }
+    results << entry.path;
   }
+  appendToLog(LogOp::Put, changed);
 
-  // Save updated cache
-  saveCache();
   return results;
 }
 
 void FileCache::clearCache() {
+  QWriteLocker lock(&cacheLock);
+  // Drop the results of any validation still in flight
+  ++validationGeneration;
+  pendingChanges.clear();
   cache.clear();
+  metadataIndex.clear();
+  directoryMtimes.clear();
   saveCache();
+  lock.unlock();
+
+  QMetaObject::invokeMethod(this, [this]() { pendingValidation.clear(); });
+}
+
+QStringList FileCache::cachedPaths(const QString &startPath) const {
+  QStringList results;
+  QReadLocker lock(&cacheLock);
+  for (const auto &entry : cache) {
+    if (entry.path.startsWith(startPath)) {
+      results << entry.path;
+    }
+  }
+  return results;
+}
+
+bool FileCache::isStale(const QString &path) const {
+  QReadLocker lock(&cacheLock);
+  auto it = cache.constFind(path);
+  return it != cache.constEnd() && it->stale;
+}
+
+void FileCache::validateEntries(const QString &startPath) {
+  if (QThread::currentThread() != thread()) {
+    // Pass bookkeeping lives on the owner thread
+    QMetaObject::invokeMethod(
+        this, [this, startPath]() { validateEntries(startPath); },
+        Qt::QueuedConnection);
+    return;
+  }
+  if (pendingBatches > 0) {
+    // One pass at a time; the latest request runs once this one finishes
+    pendingValidation = startPath;
+    return;
+  }
+
+  // Group by parent directory so an unchanged directory costs one stat
+  QHash<QString, QList<CacheEntry>> byDirectory;
+  QReadLocker lock(&cacheLock);
+  for (const auto &entry : cache) {
+    if (entry.path.startsWith(startPath)) {
+      byDirectory[entry.path.left(entry.path.lastIndexOf('/'))].append(entry);
+    }
+  }
+  quint64 generation = validationGeneration;
+  QHash<QString, qint64> knownMtimes = directoryMtimes;
+  lock.unlock();
+  QList<QPair<QString, QList<CacheEntry>>> batch;
+  int batchEntries = 0;
+  auto flush = [&]() {
+    if (batch.isEmpty()) {
+      return;
+    }
+    ++pendingBatches;
+    validationPool.start([this, generation, batch, knownMtimes]() {
+      ValidationResult result = validateBatch(batch, knownMtimes);
+      QMetaObject::invokeMethod(
+          this,
+          [this, generation, result]() { applyValidation(generation, result); },
+          Qt::QueuedConnection);
+    });
+    batch.clear();
+    batchEntries = 0;
+  };
+
+  for (auto it = byDirectory.cbegin(); it != byDirectory.cend(); ++it) {
+    batch.append(qMakePair(it.key(), it.value()));
+    batchEntries += it.value().size();
+    if (batchEntries >= VALIDATION_BATCH) {
+      flush();
+    }
+  }
+  flush();
+}
+
+FileCache::ValidationResult FileCache::validateBatch(
+    const QList<QPair<QString, QList<CacheEntry>>> &directories,
+    const QHash<QString, qint64> &knownMtimes) {
+  ValidationResult result;
+  for (const auto &[directory, entries] : directories) {
+    QFileInfo directoryInfo(directory);
+    if (!directoryInfo.isDir()) {
+      for (const CacheEntry &entry : entries) {
+        result.removed << entry.path;
+      }
+      continue;
+    }
+
+    qint64 mtime = directoryInfo.lastModified().toMSecsSinceEpoch();
+    result.directoryMtimes.insert(directory, mtime);
+    if (knownMtimes.value(directory, -1) == mtime) {
+      for (CacheEntry entry : entries) {
+        entry.stale = false;
+        result.valid << entry;
+      }
+      continue;
+    }
+
+    // Something was added, removed or renamed here since the last pass;
+    // only a listing finds archives the cache has never seen. It goes
+    // through the crawler, entering no subdirectory, so it matches exactly
+    // what a search or the watcher would report.
+    QList<CacheEntry> &listed = result.listings[directory];
+    DirectoryCrawler crawler;
+    crawler.setThreadCount(1);
+    crawler.setSkipFunction([](const std::string &) { return true; });
+    crawler.crawl(directory.toStdString(),
+                  [&](const std::string &path,
+                      const DirectoryCrawler::FileStat &stat) {
+      listed << CacheEntry{QString::fromStdString(path), stat.lastModified,
+                           stat.size, false};
+    });
+  }
+  return result;
+}
+
+void FileCache::applyValidation(quint64 generation,
+                                const ValidationResult &result) {
+  --pendingBatches;
+  QStringList validated;
+  QStringList removed;
+  {
+    QWriteLocker lock(&cacheLock);
+    if (generation == validationGeneration) {
+      QList<CacheEntry> changed;
+      for (const CacheEntry &entry : result.valid) {
+        auto it = cache.find(entry.path);
+        if (it == cache.end()) {
+          continue; // removed while the batch was out
+        }
+        if (it->lastModified != entry.lastModified ||
+            it->size != entry.size) {
+          *it = entry;
+          changed << entry;
+        }
+        it->stale = false;
+        validated << entry.path;
+      }
+      appendToLog(LogOp::Put, changed);
+
+      for (const QString &path : result.removed) {
+        if (removeEntry(path)) {
+          removed << path;
+        }
+      }
+
+      // New and vanished archives go out through cacheUpdated
+      for (auto it = result.listings.cbegin(); it != result.listings.cend();
+           ++it) {
+        mergeListing(it.key(), it.value(), false);
+        for (const CacheEntry &entry : it.value()) {
+          validated << entry.path;
+        }
+      }
+
+      // Only now that the listings are in does a directory count as seen
+      for (auto it = result.directoryMtimes.cbegin();
+           it != result.directoryMtimes.cend(); ++it) {
+        if (directoryMtimes.value(it.key(), -1) != it.value()) {
+          directoryMtimes.insert(it.key(), it.value());
+          appendDirectoryToLog(it.key(), it.value());
+        }
+      }
+    }
+  }
+
+  if (!validated.isEmpty()) {
+    emit entriesValidated(validated);
+  }
+  if (!removed.isEmpty()) {
+    emit entriesRemoved(removed);
+  }
+
+  if (pendingBatches == 0 && !pendingValidation.isEmpty()) {
+    QString next = pendingValidation;
+    pendingValidation.clear();
+    validateEntries(next);
+  }
 }
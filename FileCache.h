@@ -2,54 +2,208 @@
 #define FILECACHE_H
 
 #include <QDateTime>
+#include <QFile>
 #include <QFileInfo>
-#include <QFileSystemWatcher>
 #include <QHash>
+#include <QMutex>
 #include <QObject>
+#include <QReadWriteLock>
 #include <QSet>
 #include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+#include <atomic>
+#include <functional>
+#include <string>
 
+class DirectoryCrawler;
+class RecursiveWatcher;
+
+// Index of archive paths under the searched roots, persisted as a log.
+//
+// Safe to use from any thread: lookups take a shared lock, changes an
+// exclusive one, and nothing disk-bound (crawls, stats) runs while the lock is
+// held. Signals are emitted from the owner thread with the lock released, and
+// watcher and validation bookkeeping are marshalled to the owner thread.
 class FileCache : public QObject {
   Q_OBJECT
 
 public:
+  // Paths found so far, with running totals; called from crawler threads
+  using BatchFunction =
+      std::function<void(const QStringList &paths, quint64 directoriesScanned,
+                         quint64 filesFound)>;
+
+  // What an archive's encrypted metadata block says. Only known once the
+  // archive has been opened with its password.
+  struct ArchiveMetadata {
+    QString originalName;
+    QString mimeType;
+    qint64 originalSize = -1;
+  };
+
   explicit FileCache(QObject *parent = nullptr);
   ~FileCache();
 
+  // `onBatch`, when given, receives the results as they are found: every
+  // SEARCH_BATCH_SIZE hits or SEARCH_BATCH_INTERVAL_MS, whichever is first
   QStringList findEncryptedFiles(const QString &startPath,
-                                 bool useCache = true);
+                                 bool useCache = true,
+                                 const BatchFunction &onBatch = {});
+  // What the index lists under `startPath` as loaded, stale entries
+  // included; touches neither the disk nor the watcher
+  QStringList cachedPaths(const QString &startPath) const;
+  // Stops every running crawl, searches and rescans alike, and turns new
+  // ones into no-ops; a cancelled search returns what it had found. For
+  // shutdown: an owner whose batch callback is about to go away calls this,
+  // then waits for its searches to return.
+  void cancelSearches();
   void clearCache();
   void removeFromCache(const QString &path);
   void addToCache(const QString &path);
+  // Stats every path first, then takes the lock once for the lot
+  void addToCache(const QStringList &paths);
   void watchDirectory(const QString &path);
+  // Re-checks cached entries under `startPath` on a worker pool; results
+  // arrive through entriesValidated / entriesRemoved in batches
+  void validateEntries(const QString &startPath);
+  // True until an entry loaded from disk has been re-checked
+  bool isStale(const QString &path) const;
+  // The mtime and size an entry was indexed at; together with the path they
+  // identify one version of an archive
+  bool stamp(const QString &path, qint64 &lastModified, qint64 &size) const;
+
+  // Indexed next to the entry and persisted with it; reported as a
+  // modification. Dropped as soon as the archive itself changes.
+  void setMetadata(const QString &path, const ArchiveMetadata &metadata);
+  bool metadata(const QString &path, ArchiveMetadata &metadata) const;
+  bool hasMetadata(const QString &path) const;
 
 signals:
-  void cacheUpdated();
+  // Net changes since the last signal, at most one per CHANGE_INTERVAL_MS.
+  // A path appears in one list only: added then removed in the same window
+  // is dropped, removed then added is reported as modified.
+  void cacheUpdated(const QStringList &added, const QStringList &removed,
+                    const QStringList &modified);
+  void entriesValidated(const QStringList &paths);
+  void entriesRemoved(const QStringList &paths);
 
 private slots:
-  void handleFileChanged(const QString &path);
-  void handleDirectoryChanged(const QString &path);
+  void handlePathsChanged(const QStringList &paths);
 
 private:
+  // Bench.cpp times saveCache() directly
+  friend class Bench;
+
   struct CacheEntry {
     QString path;
     qint64 lastModified;
     qint64 size;
+    bool stale = true;
+  };
 
-    bool isValid() const;
+  // Outcome of re-checking one batch of directories off the GUI thread
+  struct ValidationResult {
+    QList<CacheEntry> valid; // with current mtime and size
+    QStringList removed;
+    // Directories whose mtime moved, listed afresh; their entries are in
+    // neither list above
+    QHash<QString, QList<CacheEntry>> listings;
+    QHash<QString, qint64> directoryMtimes;
+  };
+
+  // Metadata records also carry the name, MIME type and original size
+  enum class LogOp : quint8 {
+    Put = 1,
+    Remove = 2,
+    Directory = 3,
+    Metadata = 4
+  };
+  enum class Change { Added, Removed, Modified };
+
+  // Metadata plus the archive mtime and size it was read at
+  struct IndexedMetadata {
+    ArchiveMetadata metadata;
+    qint64 lastModified;
+    qint64 size;
   };
 
+  // The index is an append-only log of put/remove records, so a single
+  // change costs one small write. It is compacted into a snapshot of the
+  // live entries once dead records outnumber them.
   void loadCache();
   void saveCache();
-  bool shouldSkipDirectory(const QString &path);
-  void setupFileWatcher();
+  bool openLog();
+  void appendToLog(LogOp op, const CacheEntry &entry);
+  // One write, flush and compaction check for the lot; call it once the
+  // entries are in memory
+  void appendToLog(LogOp op, const QList<CacheEntry> &entries);
+  void compactLogIfNeeded();
+  void appendDirectoryToLog(const QString &path, qint64 mtime);
+  void appendMetadataToLog(const QString &path,
+                           const IndexedMetadata &indexed);
+  static ValidationResult
+  validateBatch(const QList<QPair<QString, QList<CacheEntry>>> &directories,
+                const QHash<QString, qint64> &knownMtimes);
+  void applyValidation(quint64 generation, const ValidationResult &result);
+  // putEntry, removeEntry and recordChange expect cacheLock held for
+  // writing.
+  //
+  // Inserts or refreshes an entry, logging and reporting it only if new or
+  // changed
+  void putEntry(const CacheEntry &entry);
+  // Drops an entry without reporting it through cacheUpdated
+  bool removeEntry(const QString &path);
+  void recordChange(const QString &path, Change change);
+  void flushChanges();
+  void setupWatcher();
+  void rescanDirectory(const QString &directory);
+  void applyRescan(const QString &directory, const QList<CacheEntry> &found);
+  // Expects cacheLock held for writing. Brings the entries under `directory`
+  // in line with a listing of it, of the whole tree when `recursive`.
+  void mergeListing(const QString &directory, const QList<CacheEntry> &found,
+                    bool recursive);
+  std::function<bool(const std::string &)> excludedDirectoryFilter() const;
+  // False once searches are cancelled; the crawler is then never started
+  bool registerCrawler(DirectoryCrawler *crawler);
+  void unregisterCrawler(DirectoryCrawler *crawler);
 
+  // Guards cache, metadataIndex, directoryMtimes, pendingChanges,
+  // validationGeneration and the log
+  mutable QReadWriteLock cacheLock;
   QHash<QString, CacheEntry> cache;
+  QHash<QString, IndexedMetadata> metadataIndex;
+  // Directory mtimes (ms) as of the last validation. A directory whose mtime
+  // hasn't moved has had nothing added, removed or renamed in it, so its
+  // entries are taken as valid without a stat each; one whose mtime moved
+  // is listed again. In-place modification is left to the watcher.
+  QHash<QString, qint64> directoryMtimes;
+  QThreadPool validationPool;
+  // Crawls in flight, from any thread, so cancelSearches() can reach them
+  QMutex crawlersMutex;
+  QSet<DirectoryCrawler *> crawlers;
+  std::atomic<bool> searchesCancelled{false};
+  quint64 validationGeneration = 0;
+  int pendingBatches = 0;
+  QString pendingValidation; // start path queued behind the running pass
   QString cacheFilePath;
+  QFile logFile;
+  qint64 logRecords = 0;
   QSet<QString> excludedDirs;
-  QFileSystemWatcher *fileWatcher;
+  RecursiveWatcher *watcher;
+  QHash<QString, Change> pendingChanges;
+  bool changesScheduled = false;
+  QTimer *changeTimer;
   const int MAX_CACHE_AGE_DAYS = 7;
-  QSet<QString> watchedDirectories;
+  static constexpr char LOG_MAGIC[8] = {'S', 'V', 'C', 'A', 'C', 'H', 'E', '1'};
+  // Compaction waits for at least this many dead records
+  static constexpr qint64 MIN_COMPACT_RECORDS = 1024;
+  // Entries stat'ed per worker task
+  static constexpr int VALIDATION_BATCH = 256;
+  static constexpr int SEARCH_BATCH_SIZE = 256;
+  static constexpr int SEARCH_BATCH_INTERVAL_MS = 50;
+  static constexpr int CHANGE_INTERVAL_MS = 200;
 };
 
 #endif // FILECACHE_H
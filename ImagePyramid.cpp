@@ -0,0 +1,119 @@
+#include "ImagePyramid.h"
+#include <QPainter>
+
+ImagePyramid::ImagePyramid(const QImage &image) {
+  if (image.isNull()) {
+    return;
+  }
+  // Every level above the first comes from the one before it, so the
+  // full-size image is only needed for the first
+  levels.push_back(tiled(image));
+  while (levels.back().size.width() > SMALLEST_LEVEL ||
+         levels.back().size.height() > SMALLEST_LEVEL) {
+    levels.push_back(halved(levels.back()));
+  }
+}
+
+QSize ImagePyramid::size() const {
+  return levels.empty() ? QSize() : levels.front().size;
+}
+
+ImagePyramid::Level ImagePyramid::tiled(const QImage &image) {
+  // One format for every tile keeps painting on the fast paths
+  QImage::Format format = image.hasAlphaChannel()
+                              ? QImage::Format_ARGB32_Premultiplied
+                              : QImage::Format_RGB32;
+  Level level;
+  level.size = image.size();
+  level.columns = (level.size.width() + TILE_SIZE - 1) / TILE_SIZE;
+  int rows = (level.size.height() + TILE_SIZE - 1) / TILE_SIZE;
+  level.tiles.reserve(static_cast<size_t>(level.columns) * rows);
+  for (int row = 0; row < rows; row++) {
+    for (int column = 0; column < level.columns; column++) {
+      QRect rect(column * TILE_SIZE, row * TILE_SIZE, TILE_SIZE, TILE_SIZE);
+      level.tiles.push_back(
+          image.copy(rect & image.rect()).convertToFormat(format));
+    }
+  }
+  return level;
+}
+
+ImagePyramid::Level ImagePyramid::halved(const Level &source) {
+  Level level;
+  level.size = QSize(qMax(1, (source.size.width() + 1) / 2),
+                     qMax(1, (source.size.height() + 1) / 2));
+  level.columns = (level.size.width() + TILE_SIZE - 1) / TILE_SIZE;
+  int rows = (level.size.height() + TILE_SIZE - 1) / TILE_SIZE;
+  QImage::Format format = source.tiles.front().format();
+  level.tiles.reserve(static_cast<size_t>(level.columns) * rows);
+  for (int row = 0; row < rows; row++) {
+    for (int column = 0; column < level.columns; column++) {
+      QRect rect =
+          QRect(column * TILE_SIZE, row * TILE_SIZE, TILE_SIZE, TILE_SIZE) &
+          QRect(QPoint(), level.size);
+      QImage tile(rect.size(), format);
+      tile.fill(Qt::transparent);
+      QPainter painter(&tile);
+      // Sampling at exactly half scale averages each 2x2 block
+      painter.setRenderHint(QPainter::SmoothPixmapTransform);
+      painter.translate(-rect.topLeft());
+      paint(painter, source, level.size, rect);
+      painter.end();
+      level.tiles.push_back(std::move(tile));
+    }
+  }
+  return level;
+}
+
+void ImagePyramid::paint(QPainter &painter, const Level &level,
+                         const QSize &target, const QRect &clip) {
+  double scaleX = static_cast<double>(target.width()) / level.size.width();
+  double scaleY = static_cast<double>(target.height()) / level.size.height();
+  QRectF visible(clip);
+  for (size_t i = 0; i < level.tiles.size(); i++) {
+    const QImage &tile = level.tiles[i];
+    int column = static_cast<int>(i) % level.columns;
+    int row = static_cast<int>(i) / level.columns;
+    QRectF destination(column * TILE_SIZE * scaleX, row * TILE_SIZE * scaleY,
+                       tile.width() * scaleX, tile.height() * scaleY);
+    if (destination.intersects(visible)) {
+      painter.drawImage(destination, tile);
+    }
+  }
+}
+
+const ImagePyramid::Level &ImagePyramid::levelFor(const QSize &target) const {
+  // The smallest level that still covers the target; shrinking it by up to
+  // half looks as good as shrinking the original
+  for (auto it = levels.rbegin(); it != levels.rend(); ++it) {
+    if (it->size.width() >= target.width() &&
+        it->size.height() >= target.height()) {
+      return *it;
+    }
+  }
+  return levels.front();
+}
+
+QImage ImagePyramid::render(const QSize &bounds,
+                            Qt::TransformationMode mode) const {
+  if (levels.empty() || bounds.isEmpty()) {
+    return QImage();
+  }
+  QSize target = size().scaled(bounds, Qt::KeepAspectRatio);
+  target = target.expandedTo(QSize(1, 1));
+  const Level &level = levelFor(target);
+
+  QImage image(target, level.tiles.front().format());
+  image.fill(Qt::transparent);
+  QPainter painter(&image);
+  painter.setRenderHint(QPainter::SmoothPixmapTransform,
+                        mode == Qt::SmoothTransformation);
+  paint(painter, level, target, image.rect());
+  painter.end();
+  return image;
+}
+
+QPixmap ImagePyramid::renderPixmap(const QSize &bounds,
+                                   Qt::TransformationMode mode) const {
+  return QPixmap::fromImage(render(bounds, mode));
+}
@@ -0,0 +1,54 @@
+#ifndef IMAGEPYRAMID_H
+#define IMAGEPYRAMID_H
+
+#include <QImage>
+#include <QPixmap>
+#include <QRect>
+#include <QSize>
+#include <vector>
+
+class QPainter;
+
+// A decoded image kept as successively halved levels, each cut into tiles,
+// so drawing at any size starts from a level at most twice as large as the
+// result and no level is one giant allocation.
+//
+// Building is slow for large images and belongs on a worker thread; a built
+// pyramid is immutable and can be rendered from any thread.
+class ImagePyramid {
+public:
+  static constexpr int TILE_SIZE = 1024;
+  // Halving stops once both sides fit
+  static constexpr int SMALLEST_LEVEL = 256;
+
+  explicit ImagePyramid(const QImage &image);
+
+  bool isNull() const { return levels.empty(); }
+  QSize size() const;
+  int levelCount() const { return static_cast<int>(levels.size()); }
+
+  // The whole image fitted into `bounds`, keeping its aspect ratio
+  QImage render(const QSize &bounds,
+                Qt::TransformationMode mode = Qt::SmoothTransformation) const;
+  QPixmap renderPixmap(const QSize &bounds,
+                       Qt::TransformationMode mode) const;
+
+private:
+  struct Level {
+    QSize size;
+    int columns = 0;
+    std::vector<QImage> tiles; // row-major
+  };
+
+  static Level tiled(const QImage &image);
+  static Level halved(const Level &source);
+  // Draws `level` scaled to `target` into `painter`, skipping tiles that
+  // fall outside `clip` (in target coordinates)
+  static void paint(QPainter &painter, const Level &level, const QSize &target,
+                    const QRect &clip);
+  const Level &levelFor(const QSize &target) const;
+
+  std::vector<Level> levels; // largest first
+};
+
+#endif // IMAGEPYRAMID_H
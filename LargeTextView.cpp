@@ -0,0 +1,240 @@
+#include "LargeTextView.h"
+#include <QContextMenuEvent>
+#include <QElapsedTimer>
+#include <QFontDatabase>
+#include <QMenu>
+#include <QPainter>
+#include <QScrollBar>
+#include <QtConcurrent>
+#include <climits>
+#include <cstring>
+
+LargeTextView::LargeTextView(QWidget *parent) : QAbstractScrollArea(parent) {
+  setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+  viewport()->setAutoFillBackground(false);
+}
+
+LargeTextView::~LargeTextView() { stopIndexing(); }
+
+void LargeTextView::setData(const char *newData, qint64 size, Mode mode) {
+  clear();
+  data = newData;
+  dataSize = size;
+  viewMode = mode;
+  startIndexing();
+  updateScrollBars();
+}
+
+void LargeTextView::clear() {
+  stopIndexing();
+  data = nullptr;
+  dataSize = 0;
+  lineStarts.clear();
+  lineStarts.shrink_to_fit();
+  longestLine = 0;
+  indexed = false;
+  verticalScrollBar()->setValue(0);
+  horizontalScrollBar()->setValue(0);
+  updateScrollBars();
+}
+
+void LargeTextView::setMode(Mode mode) {
+  if (mode == viewMode) {
+    return;
+  }
+  viewMode = mode;
+  if (viewMode == Mode::Text && !indexed && lineStarts.empty()) {
+    startIndexing();
+  }
+  verticalScrollBar()->setValue(0);
+  updateScrollBars();
+}
+
+bool LargeTextView::looksBinary(const char *bytes, qint64 size) {
+  qint64 sample = qMin<qint64>(size, 64 * 1024);
+  qint64 control = 0;
+  for (qint64 i = 0; i < sample; i++) {
+    unsigned char c = static_cast<unsigned char>(bytes[i]);
+    if (c == 0) {
+      return true;
+    }
+    if (c < 0x20 && c != '\t' && c != '\n' && c != '\r' && c != '\f' &&
+        c != 0x1b) {
+      control++;
+    }
+  }
+  return control * 10 > sample;
+}
+
+void LargeTextView::startIndexing() {
+  if (!data || viewMode != Mode::Text) {
+    return;
+  }
+  lineStarts.push_back(0);
+  auto cancelled = std::make_shared<std::atomic<bool>>(false);
+  cancelIndexing = cancelled;
+  quint64 current = ++generation;
+  const char *bytes = data;
+  qint64 size = dataSize;
+
+  indexFuture = QtConcurrent::run([this, cancelled, current, bytes, size]() {
+    std::vector<qint64> starts;
+    qint64 longest = 0;
+    qint64 lineStart = 0;
+    QElapsedTimer sinceReport;
+    sinceReport.start();
+    const char *end = bytes + size;
+    for (const char *p = bytes; p < end && !*cancelled;) {
+      auto *newline =
+          static_cast<const char *>(std::memchr(p, '\n', end - p));
+      if (!newline) {
+        break;
+      }
+      qint64 next = newline - bytes + 1;
+      longest = qMax(longest, next - 1 - lineStart);
+      lineStart = next;
+      if (next < size) {
+        starts.push_back(next);
+      }
+      p = newline + 1;
+      if (sinceReport.elapsed() >= INDEX_REPORT_MS) {
+        QMetaObject::invokeMethod(
+            this, [this, current, starts = std::move(starts), longest]() {
+              appendLineStarts(current, starts, longest, false);
+            });
+        starts.clear();
+        sinceReport.restart();
+      }
+    }
+    if (*cancelled) {
+      return;
+    }
+    longest = qMax(longest, size - lineStart);
+    QMetaObject::invokeMethod(
+        this, [this, current, starts = std::move(starts), longest]() {
+          appendLineStarts(current, starts, longest, true);
+        });
+  });
+}
+
+void LargeTextView::stopIndexing() {
+  // The worker reads the buffer; it must be done before the buffer goes
+  if (cancelIndexing) {
+    *cancelIndexing = true;
+    cancelIndexing.reset();
+  }
+  indexFuture.waitForFinished();
+  ++generation;
+}
+
+void LargeTextView::appendLineStarts(quint64 batchGeneration,
+                                     const std::vector<qint64> &starts,
+                                     qint64 longest, bool finished) {
+  if (batchGeneration != generation) {
+    return; // data changed since the batch was found
+  }
+  lineStarts.insert(lineStarts.end(), starts.begin(), starts.end());
+  longestLine = qMax(longestLine, longest);
+  indexed = finished;
+  updateScrollBars();
+  viewport()->update();
+}
+
+qint64 LargeTextView::rowCount() const {
+  if (!data) {
+    return 0;
+  }
+  if (viewMode == Mode::Hex) {
+    return (dataSize + HEX_BYTES_PER_ROW - 1) / HEX_BYTES_PER_ROW;
+  }
+  qint64 known = static_cast<qint64>(lineStarts.size());
+  return indexed ? known : qMax<qint64>(0, known - 1);
+}
+
+QString LargeTextView::rowText(qint64 row) const {
+  if (viewMode == Mode::Hex) {
+    static const char digits[] = "0123456789abcdef";
+    qint64 offset = row * HEX_BYTES_PER_ROW;
+    int count = static_cast<int>(qMin<qint64>(HEX_BYTES_PER_ROW,
+                                              dataSize - offset));
+    QString text = QString("%1  ").arg(offset, 10, 16, QChar('0'));
+    QString ascii;
+    for (int i = 0; i < HEX_BYTES_PER_ROW; i++) {
+      if (i < count) {
+        unsigned char c = static_cast<unsigned char>(data[offset + i]);
+        text += QLatin1Char(digits[c >> 4]);
+        text += QLatin1Char(digits[c & 0xf]);
+        ascii += QLatin1Char((c >= 0x20 && c < 0x7f) ? char(c) : '.');
+      } else {
+        text += "  ";
+      }
+      text += (i == 7) ? "  " : " ";
+    }
+    return text + " |" + ascii + "|";
+  }
+
+  qint64 start = lineStarts[static_cast<size_t>(row)];
+  qint64 end = static_cast<size_t>(row + 1) < lineStarts.size()
+                   ? lineStarts[static_cast<size_t>(row + 1)] - 1
+                   : dataSize;
+  if (end > start && data[end - 1] == '\r') {
+    end--;
+  }
+  QString text = QString::fromUtf8(data + start,
+                                   qMin<qint64>(end - start, MAX_LINE_BYTES));
+  return text.replace('\t', "    ");
+}
+
+void LargeTextView::updateScrollBars() {
+  QFontMetrics metrics(font());
+  int lineHeight = qMax(1, metrics.height());
+  int visibleRows = qMax(1, viewport()->height() / lineHeight);
+  qint64 rows = rowCount();
+  verticalScrollBar()->setPageStep(visibleRows);
+  verticalScrollBar()->setSingleStep(1);
+  verticalScrollBar()->setRange(
+      0, static_cast<int>(qBound<qint64>(0, rows - visibleRows, INT_MAX)));
+
+  qint64 columns = viewMode == Mode::Hex
+                       ? 13 + HEX_BYTES_PER_ROW * 4 + 4
+                       : qMin<qint64>(longestLine, MAX_LINE_BYTES);
+  int width = static_cast<int>(columns) * metrics.horizontalAdvance('0');
+  horizontalScrollBar()->setPageStep(viewport()->width());
+  horizontalScrollBar()->setSingleStep(metrics.horizontalAdvance('0') * 4);
+  horizontalScrollBar()->setRange(0, qMax(0, width - viewport()->width()));
+}
+
+void LargeTextView::paintEvent(QPaintEvent *event) {
+  QPainter painter(viewport());
+  painter.fillRect(event->rect(), palette().base());
+  if (!data) {
+    return;
+  }
+  painter.setPen(palette().text().color());
+  painter.setFont(font());
+
+  QFontMetrics metrics(font());
+  int lineHeight = qMax(1, metrics.height());
+  qint64 first = verticalScrollBar()->value();
+  qint64 rows = rowCount();
+  int x = 4 - horizontalScrollBar()->value();
+  int visibleRows = viewport()->height() / lineHeight + 1;
+  for (int i = 0; i < visibleRows && first + i < rows; i++) {
+    painter.drawText(x, i * lineHeight + metrics.ascent(), rowText(first + i));
+  }
+}
+
+void LargeTextView::resizeEvent(QResizeEvent *event) {
+  QAbstractScrollArea::resizeEvent(event);
+  updateScrollBars();
+}
+
+void LargeTextView::contextMenuEvent(QContextMenuEvent *event) {
+  QMenu menu(this);
+  QAction *hex = menu.addAction("Hex View");
+  hex->setCheckable(true);
+  hex->setChecked(viewMode == Mode::Hex);
+  if (menu.exec(event->globalPos()) == hex) {
+    setMode(hex->isChecked() ? Mode::Hex : Mode::Text);
+  }
+}
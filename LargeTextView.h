@@ -0,0 +1,71 @@
+#ifndef LARGETEXTVIEW_H
+#define LARGETEXTVIEW_H
+
+#include <QAbstractScrollArea>
+#include <QFuture>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Read-only view over a text or binary buffer of any size. Nothing is
+// copied: rows are decoded from the buffer as they are painted, and only
+// the visible ones ever are.
+//
+// Text mode needs line offsets, which are indexed on a worker thread; rows
+// appear and the scroll range grows while that runs. Hex mode shows 16 bytes
+// per row and needs no index.
+class LargeTextView : public QAbstractScrollArea {
+  Q_OBJECT
+
+public:
+  enum class Mode { Text, Hex };
+
+  explicit LargeTextView(QWidget *parent = nullptr);
+  ~LargeTextView() override;
+
+  // `data` must stay valid until clear() or the next setData()
+  void setData(const char *data, qint64 size, Mode mode = Mode::Text);
+  // Stops indexing and lets go of the buffer
+  void clear();
+  void setMode(Mode mode);
+  Mode mode() const { return viewMode; }
+
+  // NUL bytes, or mostly control characters, near the start
+  static bool looksBinary(const char *data, qint64 size);
+
+  static constexpr int HEX_BYTES_PER_ROW = 16;
+  // Longer lines are cut off when drawn
+  static constexpr int MAX_LINE_BYTES = 4096;
+
+protected:
+  void paintEvent(QPaintEvent *event) override;
+  void resizeEvent(QResizeEvent *event) override;
+  void contextMenuEvent(QContextMenuEvent *event) override;
+
+private:
+  void startIndexing();
+  void stopIndexing();
+  void appendLineStarts(quint64 generation, const std::vector<qint64> &starts,
+                        qint64 longest, bool finished);
+  void updateScrollBars();
+  qint64 rowCount() const;
+  QString rowText(qint64 row) const;
+
+  const char *data = nullptr;
+  qint64 dataSize = 0;
+  Mode viewMode = Mode::Text;
+
+  // Start of every line found so far; the last one is only a row once the
+  // newline after it (or the end) has been seen
+  std::vector<qint64> lineStarts;
+  qint64 longestLine = 0;
+  bool indexed = false;
+  quint64 generation = 0;
+  QFuture<void> indexFuture;
+  std::shared_ptr<std::atomic<bool>> cancelIndexing;
+
+  // Batches are handed to the GUI thread at most this often
+  static constexpr int INDEX_REPORT_MS = 100;
+};
+
+#endif // LARGETEXTVIEW_H
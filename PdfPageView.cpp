@@ -0,0 +1,330 @@
+#include "PdfPageView.h"
+#include <QBuffer>
+#include <QKeyEvent>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QScrollBar>
+#include <QThread>
+#include <QWheelEvent>
+#include <QtConcurrent>
+#include <cmath>
+
+PdfPageView::PdfPageView(QWidget *parent) : QAbstractScrollArea(parent) {
+  // pdfium serialises rendering anyway
+  renderPool.setMaxThreadCount(1);
+  renderTimer = new QTimer(this);
+  renderTimer->setSingleShot(true);
+  renderTimer->setInterval(RENDER_DELAY_MS);
+  connect(renderTimer, &QTimer::timeout, this, [this]() {
+    renderScale = scale();
+    viewport()->update();
+  });
+}
+
+PdfPageView::~PdfPageView() { stopWorkers(); }
+
+void PdfPageView::load(const QByteArray &pdf) {
+  clear();
+  source = pdf;
+  quint64 current = generation;
+  QThread *guiThread = thread();
+
+  loadFuture = QtConcurrent::run([pdf, guiThread]() {
+    auto result = std::make_shared<Loaded>();
+    result->document = std::make_unique<QPdfDocument>();
+    auto *buffer = new QBuffer(result->document.get());
+    buffer->setData(pdf);
+    buffer->open(QIODevice::ReadOnly);
+    result->document->load(buffer);
+    if (result->document->status() != QPdfDocument::Status::Ready) {
+      result->error = "The document could not be read";
+      result->document.reset();
+      return result;
+    }
+    int count = result->document->pageCount();
+    result->pageSizes.reserve(count);
+    for (int page = 0; page < count; page++) {
+      result->pageSizes.push_back(result->document->pagePointSize(page));
+    }
+    // Its buffer moves along with it
+    result->document->moveToThread(guiThread);
+    return result;
+  });
+  loadFuture.then(this, [this, current](std::shared_ptr<Loaded> result) {
+    finishLoading(current, std::move(result));
+  });
+}
+
+void PdfPageView::finishLoading(quint64 loadGeneration,
+                                std::shared_ptr<Loaded> result) {
+  if (loadGeneration != generation) {
+    return; // cleared while loading
+  }
+  if (!result->document) {
+    emit loadFailed(result->error);
+    return;
+  }
+  pdfDocument = std::move(result->document);
+  pageSizes = std::move(result->pageSizes);
+  pageOffsets.resize(pageSizes.size());
+  double offset = 0;
+  widestPage = 0;
+  for (size_t page = 0; page < pageSizes.size(); page++) {
+    pageOffsets[page] = offset;
+    offset += pageSizes[page].height();
+    widestPage = qMax(widestPage, pageSizes[page].width());
+  }
+  updateLayout();
+  renderScale = scale();
+  viewport()->update();
+  emit loaded();
+}
+
+void PdfPageView::stopWorkers() {
+  // Workers read `pdfDocument` and `source`; both outlive them
+  ++generation;
+  wantedFirst = 0;
+  wantedLast = -1;
+  renderPool.clear();
+  renderPool.waitForDone();
+  loadFuture.waitForFinished();
+}
+
+void PdfPageView::clear() {
+  stopWorkers();
+  renderTimer->stop();
+  pages.clear();
+  pendingPages.clear();
+  pdfDocument.reset();
+  source.clear();
+  pageSizes.clear();
+  pageOffsets.clear();
+  widestPage = 0;
+  zoomFactor = 1.0;
+  renderScale = 0;
+  verticalScrollBar()->setValue(0);
+  horizontalScrollBar()->setValue(0);
+  updateLayout();
+  viewport()->update();
+}
+
+void PdfPageView::setZoom(double zoom) {
+  zoom = qBound(0.25, zoom, 4.0);
+  if (qFuzzyCompare(zoom, zoomFactor)) {
+    return;
+  }
+  // Keep the same part of the document in view
+  QScrollBar *bar = verticalScrollBar();
+  double position =
+      bar->maximum() > 0 ? static_cast<double>(bar->value()) / bar->maximum()
+                         : 0;
+  zoomFactor = zoom;
+  updateLayout();
+  bar->setValue(qRound(position * bar->maximum()));
+  renderTimer->start();
+  viewport()->update();
+}
+
+double PdfPageView::scale() const {
+  // Fit the widest page to the view at zoom 1
+  if (widestPage <= 0) {
+    return 0;
+  }
+  double available = qMax(1, viewport()->width() - 2 * MARGIN);
+  return available / widestPage * zoomFactor;
+}
+
+int PdfPageView::pageTop(int page) const {
+  return MARGIN + qRound(pageOffsets[page] * scale()) + page * PAGE_SPACING;
+}
+
+QRect PdfPageView::pageRect(int page) const {
+  QSize size = (pageSizes[page] * scale()).toSize();
+  int contentWidth = qRound(widestPage * scale()) + 2 * MARGIN;
+  int left = qMax(0, viewport()->width() - contentWidth) / 2 + MARGIN +
+             (qRound(widestPage * scale()) - size.width()) / 2;
+  return QRect(left - horizontalScrollBar()->value(),
+               pageTop(page) - verticalScrollBar()->value(), size.width(),
+               size.height());
+}
+
+int PdfPageView::firstPageBelow(int y) const {
+  // First page whose bottom edge is below `y`, in document coordinates
+  int low = 0;
+  int high = pageCount();
+  while (low < high) {
+    int middle = (low + high) / 2;
+    int bottom =
+        pageTop(middle) + qRound(pageSizes[middle].height() * scale());
+    if (bottom < y) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+void PdfPageView::updateLayout() {
+  if (pageSizes.empty()) {
+    verticalScrollBar()->setRange(0, 0);
+    horizontalScrollBar()->setRange(0, 0);
+    return;
+  }
+  int last = pageCount() - 1;
+  int height = pageTop(last) + qRound(pageSizes[last].height() * scale()) +
+               MARGIN;
+  int width = qRound(widestPage * scale()) + 2 * MARGIN;
+  verticalScrollBar()->setRange(0, qMax(0, height - viewport()->height()));
+  verticalScrollBar()->setPageStep(viewport()->height());
+  verticalScrollBar()->setSingleStep(40);
+  horizontalScrollBar()->setRange(0, qMax(0, width - viewport()->width()));
+  horizontalScrollBar()->setPageStep(viewport()->width());
+  horizontalScrollBar()->setSingleStep(40);
+}
+
+int PdfPageView::targetWidth(int page) const {
+  return qMax(1, qRound(pageSizes[page].width() * renderScale *
+                        devicePixelRatioF()));
+}
+
+void PdfPageView::paintEvent(QPaintEvent *event) {
+  QPainter painter(viewport());
+  painter.fillRect(event->rect(), palette().window());
+  if (!pdfDocument || pageSizes.empty()) {
+    return;
+  }
+
+  int top = verticalScrollBar()->value();
+  int first = firstPageBelow(top);
+  int last = first;
+  for (int page = first; page < pageCount(); page++) {
+    QRect rect = pageRect(page);
+    if (rect.top() > viewport()->height()) {
+      break;
+    }
+    last = page;
+    if (!rect.intersects(event->rect())) {
+      continue;
+    }
+    // Whatever resolution is cached is stretched until the right one
+    // arrives
+    if (QImage *image = pages.object(page)) {
+      painter.drawImage(rect, *image);
+    } else {
+      painter.fillRect(rect, Qt::white);
+    }
+  }
+
+  wantedFirst = qMax(0, first - LOOKAHEAD_PAGES);
+  wantedLast = qMin(pageCount() - 1, last + LOOKAHEAD_PAGES);
+  if (renderTimer->isActive()) {
+    return; // still resizing or zooming
+  }
+  for (int page = first; page <= last; page++) {
+    requestRender(page);
+  }
+  for (int distance = 1; distance <= LOOKAHEAD_PAGES; distance++) {
+    if (last + distance < pageCount()) {
+      requestRender(last + distance);
+    }
+    if (first - distance >= 0) {
+      requestRender(first - distance);
+    }
+  }
+}
+
+void PdfPageView::requestRender(int page) {
+  QImage *cached = pages.object(page);
+  int width = targetWidth(page);
+  if ((cached && cached->width() == width) || pendingPages.contains(page)) {
+    return;
+  }
+  pendingPages.insert(page);
+
+  quint64 current = generation;
+  QPdfDocument *document = pdfDocument.get();
+  QSize size(width, qMax(1, qRound(width * pageSizes[page].height() /
+                                   pageSizes[page].width())));
+  renderPool.start([this, current, document, page, size]() {
+    QImage image;
+    // Scrolled past before its turn came
+    if (page >= wantedFirst && page <= wantedLast) {
+      image = document->render(page, size);
+    }
+    QMetaObject::invokeMethod(this, [this, current, page, size, image]() {
+      pageRendered(current, page, size.width(), image);
+    });
+  });
+}
+
+void PdfPageView::requestThumbnail(int edge) {
+  if (pageSizes.empty() || pageSizes[0].isEmpty()) {
+    return;
+  }
+  quint64 current = generation;
+  QPdfDocument *document = pdfDocument.get();
+  QSize size = pageSizes[0].toSize().scaled(edge, edge, Qt::KeepAspectRatio);
+  renderPool.start([this, current, document, size]() {
+    QImage image = document->render(0, size);
+    QMetaObject::invokeMethod(this, [this, current, image]() {
+      if (current == generation && !image.isNull()) {
+        emit thumbnailReady(image);
+      }
+    });
+  });
+}
+
+void PdfPageView::pageRendered(quint64 renderGeneration, int page, int width,
+                               const QImage &image) {
+  if (renderGeneration != generation) {
+    return;
+  }
+  pendingPages.remove(page);
+  if (image.isNull()) {
+    return;
+  }
+  int cost = qMax<qsizetype>(1, image.sizeInBytes() / 1024);
+  pages.insert(page, new QImage(image), cost);
+  if (width == targetWidth(page)) {
+    viewport()->update(pageRect(page));
+  } else {
+    viewport()->update(); // stale already; ask again at the current width
+  }
+}
+
+void PdfPageView::resizeEvent(QResizeEvent *event) {
+  QScrollBar *bar = verticalScrollBar();
+  double position =
+      bar->maximum() > 0 ? static_cast<double>(bar->value()) / bar->maximum()
+                         : 0;
+  QAbstractScrollArea::resizeEvent(event);
+  updateLayout();
+  bar->setValue(qRound(position * bar->maximum()));
+  if (pdfDocument) {
+    renderTimer->start();
+  }
+}
+
+void PdfPageView::wheelEvent(QWheelEvent *event) {
+  if (event->modifiers() & Qt::ControlModifier) {
+    double steps = event->angleDelta().y() / 120.0;
+    setZoom(zoomFactor * std::pow(1.1, steps));
+    event->accept();
+    return;
+  }
+  QAbstractScrollArea::wheelEvent(event);
+}
+
+void PdfPageView::keyPressEvent(QKeyEvent *event) {
+  if (event->matches(QKeySequence::ZoomIn)) {
+    setZoom(zoomFactor * 1.25);
+  } else if (event->matches(QKeySequence::ZoomOut)) {
+    setZoom(zoomFactor / 1.25);
+  } else if (event->modifiers() & Qt::ControlModifier &&
+             event->key() == Qt::Key_0) {
+    setZoom(1.0);
+  } else {
+    QAbstractScrollArea::keyPressEvent(event);
+  }
+}
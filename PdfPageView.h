@@ -0,0 +1,107 @@
+#ifndef PDFPAGEVIEW_H
+#define PDFPAGEVIEW_H
+
+#include <QAbstractScrollArea>
+#include <QByteArray>
+#include <QCache>
+#include <QFuture>
+#include <QImage>
+#include <QPdfDocument>
+#include <QSet>
+#include <QSizeF>
+#include <QThreadPool>
+#include <QTimer>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Scrolling view of a PDF held in memory. Pages are laid out from their
+// sizes alone; only the visible ones plus LOOKAHEAD_PAGES either side are
+// rendered, one at a time on a worker thread, into a cache bounded by
+// MAX_CACHE_KB.
+//
+// The document is parsed on a worker as well, so opening a large file never
+// blocks the GUI thread. While the view is resized or zoomed, cached pages
+// are stretched to fit and re-rendered at the new width only once it has
+// settled for RENDER_DELAY_MS.
+class PdfPageView : public QAbstractScrollArea {
+  Q_OBJECT
+
+public:
+  static constexpr int LOOKAHEAD_PAGES = 2;
+  static constexpr int MAX_CACHE_KB = 192 * 1024;
+  static constexpr int RENDER_DELAY_MS = 150;
+  static constexpr int MARGIN = 12;
+  static constexpr int PAGE_SPACING = 12;
+
+  explicit PdfPageView(QWidget *parent = nullptr);
+  ~PdfPageView() override;
+
+  // `pdf` is read in place and must stay valid until clear() or the next
+  // load(); loaded() or loadFailed() follows
+  void load(const QByteArray &pdf);
+  // Waits for the worker, then drops the document and every rendered page
+  void clear();
+
+  // Null until loaded(); renders from it are safe on any thread
+  QPdfDocument *document() const { return pdfDocument.get(); }
+  int pageCount() const { return static_cast<int>(pageSizes.size()); }
+  // Renders page 0 to fit `edge` x `edge` on the render worker, behind any
+  // page already queued; thumbnailReady() follows unless the document is
+  // cleared or replaced first
+  void requestThumbnail(int edge);
+
+  void setZoom(double zoom);
+  double zoom() const { return zoomFactor; }
+
+signals:
+  void loaded();
+  void loadFailed(const QString &error);
+  void thumbnailReady(const QImage &image);
+
+protected:
+  void paintEvent(QPaintEvent *event) override;
+  void resizeEvent(QResizeEvent *event) override;
+  void wheelEvent(QWheelEvent *event) override;
+  void keyPressEvent(QKeyEvent *event) override;
+
+private:
+  struct Loaded {
+    std::unique_ptr<QPdfDocument> document;
+    std::vector<QSizeF> pageSizes;
+    QString error;
+  };
+
+  void finishLoading(quint64 loadGeneration, std::shared_ptr<Loaded> result);
+  void stopWorkers();
+  void updateLayout();
+  double scale() const;
+  int pageTop(int page) const;
+  QRect pageRect(int page) const;
+  int firstPageBelow(int y) const;
+  int targetWidth(int page) const;
+  void requestRender(int page);
+  void pageRendered(quint64 renderGeneration, int page, int width,
+                    const QImage &image);
+
+  QByteArray source;
+  std::unique_ptr<QPdfDocument> pdfDocument;
+  std::vector<QSizeF> pageSizes;   // points
+  std::vector<double> pageOffsets; // points above each page
+  double widestPage = 0;
+  double zoomFactor = 1.0;
+
+  quint64 generation = 0;
+  QFuture<std::shared_ptr<Loaded>> loadFuture;
+  QThreadPool renderPool;
+  // Pages worth rendering right now; queued renders outside it are skipped
+  std::atomic<int> wantedFirst{0};
+  std::atomic<int> wantedLast{-1};
+  QCache<int, QImage> pages{MAX_CACHE_KB};
+  QSet<int> pendingPages;
+  // Width the pages are rendered at; follows the layout after a delay
+  double renderScale = 0;
+  QTimer *renderTimer;
+};
+
+#endif // PDFPAGEVIEW_H
@@ -0,0 +1,100 @@
+#include "PerfPanel.h"
+#include "PerfTrace.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFileDialog>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QMessageBox>
+#include <QPushButton>
+#include <QVBoxLayout>
+
+namespace {
+QString milliseconds(qint64 us) { return QString::number(us / 1000.0, 'f', 2); }
+} // namespace
+
+PerfPanel::PerfPanel(QWidget *parent)
+    : QWidget(parent), table(new QTreeWidget(this)),
+      refreshTimer(new QTimer(this)) {
+  table->setColumnCount(6);
+  table->setHeaderLabels(
+      {"Name", "Count", "Total ms", "Mean ms", "Max ms", "Last ms"});
+  table->setRootIsDecorated(false);
+  table->setUniformRowHeights(true);
+  table->header()->setSectionResizeMode(0, QHeaderView::Stretch);
+
+  auto *resetButton = new QPushButton("Reset", this);
+  auto *exportButton = new QPushButton("Export Trace...", this);
+  connect(resetButton, &QPushButton::clicked, this, [this]() {
+    PerfTrace::reset();
+    refresh();
+  });
+  connect(exportButton, &QPushButton::clicked, this, &PerfPanel::exportTrace);
+
+  auto *buttons = new QHBoxLayout();
+  buttons->addStretch(1);
+  buttons->addWidget(resetButton);
+  buttons->addWidget(exportButton);
+  auto *layout = new QVBoxLayout(this);
+  layout->setContentsMargins(4, 4, 4, 4);
+  layout->addWidget(table);
+  layout->addLayout(buttons);
+
+  refreshTimer->setInterval(REFRESH_INTERVAL_MS);
+  connect(refreshTimer, &QTimer::timeout, this, &PerfPanel::refresh);
+}
+
+void PerfPanel::showEvent(QShowEvent *event) {
+  QWidget::showEvent(event);
+  refresh();
+  refreshTimer->start();
+}
+
+void PerfPanel::hideEvent(QHideEvent *event) {
+  QWidget::hideEvent(event);
+  refreshTimer->stop();
+}
+
+void PerfPanel::refresh() {
+  // Rebuilt every time; there are only a handful of names
+  table->clear();
+  for (const PerfTrace::Stat &stat : PerfTrace::stats()) {
+    auto *item = new QTreeWidgetItem(table);
+    item->setText(0, stat.name);
+    item->setText(1, QString::number(stat.calls));
+    item->setText(2, milliseconds(stat.totalUs));
+    item->setText(3, milliseconds(stat.calls ? stat.totalUs / qint64(stat.calls)
+                                             : 0));
+    item->setText(4, milliseconds(stat.maxUs));
+    item->setText(5, milliseconds(stat.lastUs));
+  }
+  QHash<QString, qint64> counters = PerfTrace::counters();
+  QStringList names = counters.keys();
+  names.sort();
+  for (const QString &name : names) {
+    auto *item = new QTreeWidgetItem(table);
+    item->setText(0, name);
+    item->setText(1, QString::number(counters.value(name)));
+  }
+  for (int column = 1; column < table->columnCount(); ++column) {
+    for (int row = 0; row < table->topLevelItemCount(); ++row) {
+      table->topLevelItem(row)->setTextAlignment(column, Qt::AlignRight);
+    }
+  }
+}
+
+void PerfPanel::exportTrace() {
+  QString suggested =
+      QDir::homePath() + "/SecureViewer-" +
+      QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss") + ".json";
+  QString path = QFileDialog::getSaveFileName(
+      this, "Export Trace", suggested, "Chrome Trace (*.json)");
+  if (path.isEmpty()) {
+    return;
+  }
+  QString error;
+  if (!PerfTrace::exportChromeTrace(path, error)) {
+    QMessageBox::warning(this, "Error",
+                         QString("Failed to export trace:\n%1").arg(error));
+  }
+}
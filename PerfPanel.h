@@ -0,0 +1,31 @@
+#ifndef PERFPANEL_H
+#define PERFPANEL_H
+
+#include <QTimer>
+#include <QTreeWidget>
+#include <QWidget>
+
+// Live view of PerfTrace: per-name timings and counters, refreshed every
+// REFRESH_INTERVAL_MS while the panel is visible, with buttons to reset the
+// figures and to export the trace.
+class PerfPanel : public QWidget {
+  Q_OBJECT
+
+public:
+  explicit PerfPanel(QWidget *parent = nullptr);
+
+  static constexpr int REFRESH_INTERVAL_MS = 500;
+
+protected:
+  void showEvent(QShowEvent *event) override;
+  void hideEvent(QHideEvent *event) override;
+
+private:
+  void refresh();
+  void exportTrace();
+
+  QTreeWidget *table;
+  QTimer *refreshTimer;
+};
+
+#endif // PERFPANEL_H
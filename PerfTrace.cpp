@@ -0,0 +1,169 @@
+#include "PerfTrace.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QTextStream>
+#include <algorithm>
+#include <vector>
+
+std::atomic<bool> PerfTrace::enabledFlag{false};
+
+namespace {
+struct Event {
+  const char *name;
+  qint64 start;
+  qint64 value; // duration for spans, running total for counters
+  int thread;
+  bool counter;
+};
+
+// Keyed by the literal's address; names that appear in several translation
+// units are merged when read
+struct State {
+  QMutex mutex;
+  std::vector<Event> events; // ring of MAX_EVENTS once full
+  size_t next = 0;
+  QHash<const char *, PerfTrace::Stat> stats;
+  QHash<const char *, qint64> counters;
+};
+
+State &state() {
+  static State *instance = new State;
+  return *instance;
+}
+
+// Small stable ids read better in the trace viewer than thread handles
+int threadIndex() {
+  static std::atomic<int> nextIndex{1};
+  thread_local int index = nextIndex++;
+  return index;
+}
+
+void append(State &s, const Event &event) {
+  if (s.events.size() < static_cast<size_t>(PerfTrace::MAX_EVENTS)) {
+    s.events.push_back(event);
+  } else {
+    s.events[s.next] = event;
+    s.next = (s.next + 1) % s.events.size();
+  }
+}
+} // namespace
+
+void PerfTrace::setEnabled(bool enabled) {
+  now(); // starts the clock
+  enabledFlag.store(enabled, std::memory_order_relaxed);
+}
+
+qint64 PerfTrace::now() {
+  static QElapsedTimer clock = []() {
+    QElapsedTimer timer;
+    timer.start();
+    return timer;
+  }();
+  return clock.nsecsElapsed() / 1000;
+}
+
+void PerfTrace::record(const char *name, qint64 startUs, qint64 durationUs) {
+  int thread = threadIndex();
+  State &s = state();
+  QMutexLocker lock(&s.mutex);
+  Stat &stat = s.stats[name];
+  ++stat.calls;
+  stat.totalUs += durationUs;
+  stat.maxUs = std::max(stat.maxUs, durationUs);
+  stat.lastUs = durationUs;
+  append(s, {name, startUs, durationUs, thread, false});
+}
+
+void PerfTrace::addCount(const char *name, qint64 delta) {
+  qint64 timestamp = now();
+  int thread = threadIndex();
+  State &s = state();
+  QMutexLocker lock(&s.mutex);
+  qint64 &total = s.counters[name];
+  total += delta;
+  append(s, {name, timestamp, total, thread, true});
+}
+
+QList<PerfTrace::Stat> PerfTrace::stats() {
+  QHash<QString, Stat> merged;
+  {
+    State &s = state();
+    QMutexLocker lock(&s.mutex);
+    for (auto it = s.stats.cbegin(); it != s.stats.cend(); ++it) {
+      QString name = QString::fromLatin1(it.key());
+      Stat &stat = merged[name];
+      stat.name = name;
+      stat.calls += it->calls;
+      stat.totalUs += it->totalUs;
+      stat.maxUs = std::max(stat.maxUs, it->maxUs);
+      stat.lastUs = it->lastUs;
+    }
+  }
+  QList<Stat> result = merged.values();
+  std::sort(result.begin(), result.end(),
+            [](const Stat &a, const Stat &b) { return a.name < b.name; });
+  return result;
+}
+
+QHash<QString, qint64> PerfTrace::counters() {
+  QHash<QString, qint64> result;
+  State &s = state();
+  QMutexLocker lock(&s.mutex);
+  for (auto it = s.counters.cbegin(); it != s.counters.cend(); ++it) {
+    result[QString::fromLatin1(it.key())] += it.value();
+  }
+  return result;
+}
+
+void PerfTrace::reset() {
+  State &s = state();
+  QMutexLocker lock(&s.mutex);
+  s.events.clear();
+  s.next = 0;
+  s.stats.clear();
+  s.counters.clear();
+}
+
+bool PerfTrace::exportChromeTrace(const QString &path, QString &error) {
+  std::vector<Event> events;
+  {
+    State &s = state();
+    QMutexLocker lock(&s.mutex);
+    // Oldest first
+    events.reserve(s.events.size());
+    events.insert(events.end(), s.events.begin() + s.next, s.events.end());
+    events.insert(events.end(), s.events.begin(), s.events.begin() + s.next);
+  }
+
+  QSaveFile file(path);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+    error = file.errorString();
+    return false;
+  }
+  // Written by hand: names are literals, and a QJsonDocument of this many
+  // events would be several times the size of the file
+  QTextStream out(&file);
+  qint64 pid = QCoreApplication::applicationPid();
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  for (size_t i = 0; i < events.size(); ++i) {
+    const Event &event = events[i];
+    out << (i ? ",\n" : "\n") << "{\"name\":\"" << event.name
+        << "\",\"pid\":" << pid << ",\"tid\":" << event.thread
+        << ",\"ts\":" << event.start;
+    if (event.counter) {
+      out << ",\"ph\":\"C\",\"args\":{\"value\":" << event.value << "}}";
+    } else {
+      out << ",\"ph\":\"X\",\"dur\":" << event.value << "}";
+    }
+  }
+  out << "\n]}\n";
+  out.flush();
+  if (!file.commit()) {
+    error = file.errorString();
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,77 @@
+#ifndef PERFTRACE_H
+#define PERFTRACE_H
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QtGlobal>
+#include <atomic>
+
+// Timings and counters for the hot paths, kept in memory for the
+// performance panel and for export as a Chrome trace (chrome://tracing or
+// Perfetto).
+//
+// Off by default. While disabled a PerfScope or count() costs one relaxed
+// atomic load; enabled, each event takes a mutex for a moment. The newest
+// MAX_EVENTS events are kept for the trace, and the per-name statistics
+// cover everything since the last reset(). Names must be string literals.
+// Thread-safe.
+class PerfTrace {
+public:
+  struct Stat {
+    QString name;
+    quint64 calls = 0;
+    qint64 totalUs = 0;
+    qint64 maxUs = 0;
+    qint64 lastUs = 0;
+  };
+
+  static void setEnabled(bool enabled);
+  static bool isEnabled() {
+    return enabledFlag.load(std::memory_order_relaxed);
+  }
+
+  // Microseconds on a monotonic clock
+  static qint64 now();
+  static void record(const char *name, qint64 startUs, qint64 durationUs);
+  static void count(const char *name, qint64 delta = 1) {
+    if (isEnabled()) {
+      addCount(name, delta);
+    }
+  }
+
+  // Sorted by name
+  static QList<Stat> stats();
+  static QHash<QString, qint64> counters();
+  static void reset();
+  static bool exportChromeTrace(const QString &path, QString &error);
+
+  static constexpr int MAX_EVENTS = 200000;
+
+private:
+  static void addCount(const char *name, qint64 delta);
+
+  static std::atomic<bool> enabledFlag;
+};
+
+// Records its own lifetime under `name`, if tracing was enabled when it was
+// created
+class PerfScope {
+public:
+  explicit PerfScope(const char *name)
+      : name(PerfTrace::isEnabled() ? name : nullptr),
+        start(this->name ? PerfTrace::now() : 0) {}
+  ~PerfScope() {
+    if (name) {
+      PerfTrace::record(name, start, PerfTrace::now() - start);
+    }
+  }
+  PerfScope(const PerfScope &) = delete;
+  PerfScope &operator=(const PerfScope &) = delete;
+
+private:
+  const char *name;
+  qint64 start;
+};
+
+#endif // PERFTRACE_H
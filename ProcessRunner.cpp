@@ -0,0 +1,180 @@
+#include "ProcessRunner.h"
+#include <QThread>
+#include <openssl/crypto.h>
+#include <unistd.h>
+
+namespace {
+void wipe(QByteArray &bytes) {
+  if (!bytes.isEmpty()) {
+    bytes.detach();
+    OPENSSL_cleanse(bytes.data(), bytes.size());
+  }
+  bytes.clear();
+}
+} // namespace
+
+ProcessRunner::ProcessRunner(QObject *parent)
+    : QObject(parent), concurrency(qMax(1, QThread::idealThreadCount())),
+      progressTimer(new QTimer(this)) {
+  progressTimer->setInterval(PROGRESS_INTERVAL_MS);
+  connect(progressTimer, &QTimer::timeout, this,
+          &ProcessRunner::reportProgress);
+}
+
+ProcessRunner::~ProcessRunner() { killAll(); }
+
+void ProcessRunner::setMaxConcurrent(int count) {
+  concurrency = qMax(1, count);
+  startQueued();
+}
+
+int ProcessRunner::start(Job job) {
+  int id = nextId++;
+  queued.append({id, std::move(job)});
+  startQueued();
+  return id;
+}
+
+void ProcessRunner::startQueued() {
+  while (running.size() < concurrency && !queued.isEmpty()) {
+    QPair<int, Job> next = queued.takeFirst();
+    int id = next.first;
+    Job &job = next.second;
+
+    auto *process = new QProcess(this);
+    process->setProcessChannelMode(QProcess::MergedChannels);
+    process->setWorkingDirectory(job.workingDirectory);
+    // Without a controlling terminal, openssl in the scripts reads the
+    // password from stdin rather than prompting on whatever terminal
+    // started us
+    process->setChildProcessModifier([]() { setsid(); });
+    connect(process, &QProcess::readyRead, this, [this, id]() {
+      readOutput(id);
+    });
+    connect(process, &QProcess::finished, this,
+            [this, id](int exitCode, QProcess::ExitStatus status) {
+              readOutput(id);
+              complete(id, status == QProcess::NormalExit && exitCode == 0,
+                       QString());
+            });
+    // Crashes arrive through finished() as well; only a failed start needs
+    // handling here. Queued, as start() may report it before returning.
+    connect(
+        process, &QProcess::errorOccurred, this,
+        [this, id](QProcess::ProcessError error) {
+          auto it = running.find(id);
+          if (error == QProcess::FailedToStart && it != running.end()) {
+            complete(id, false, it->process->errorString());
+          }
+        },
+        Qt::QueuedConnection);
+
+    Running &entry = running[id];
+    entry.process = process;
+    entry.elapsed.start();
+    process->start(job.program, job.arguments);
+    // Buffered until the process is up; stdin closes once it is written
+    process->write(job.input);
+    process->closeWriteChannel();
+    wipe(job.input);
+  }
+  if (!running.isEmpty() && !progressTimer->isActive()) {
+    progressTimer->start();
+  }
+}
+
+void ProcessRunner::readOutput(int id) {
+  auto it = running.find(id);
+  if (it == running.end()) {
+    return;
+  }
+  it->output += it->process->readAll();
+  if (it->output.size() > MAX_OUTPUT_SIZE) {
+    it->output.remove(0, it->output.size() - MAX_OUTPUT_SIZE);
+  }
+}
+
+void ProcessRunner::complete(int id, bool ok, const QString &message) {
+  auto it = running.find(id);
+  if (it == running.end()) {
+    return;
+  }
+  Running entry = *it;
+  running.erase(it);
+  entry.process->disconnect(this);
+  entry.process->deleteLater();
+  if (running.isEmpty()) {
+    progressTimer->stop();
+  }
+
+  QString output = QString::fromLocal8Bit(entry.output);
+  if (!message.isEmpty()) {
+    output = output.isEmpty() ? message : output + "\n" + message;
+  }
+  startQueued();
+  emit finished(id, ok && !entry.cancelled, output, entry.cancelled);
+}
+
+void ProcessRunner::cancel(int id) {
+  for (int i = 0; i < queued.size(); ++i) {
+    if (queued[i].first == id) {
+      wipe(queued[i].second.input);
+      queued.removeAt(i);
+      emit finished(id, false, QString(), true);
+      return;
+    }
+  }
+
+  auto it = running.find(id);
+  if (it == running.end() || it->cancelled) {
+    return;
+  }
+  it->cancelled = true;
+  QProcess *process = it->process;
+  process->terminate();
+  QTimer::singleShot(KILL_TIMEOUT_MS, process, &QProcess::kill);
+}
+
+void ProcessRunner::cancelAll() {
+  QList<int> ids;
+  for (const auto &job : queued) {
+    ids.append(job.first);
+  }
+  ids.append(running.keys());
+  for (int id : ids) {
+    cancel(id);
+  }
+}
+
+void ProcessRunner::killAll() {
+  for (auto &job : queued) {
+    wipe(job.second.input);
+  }
+  queued.clear();
+  for (const Running &entry : running) {
+    entry.process->disconnect(this);
+    entry.process->kill();
+    entry.process->waitForFinished(KILL_TIMEOUT_MS);
+    delete entry.process;
+  }
+  running.clear();
+  progressTimer->stop();
+}
+
+bool ProcessRunner::isActive(int id) const {
+  if (running.contains(id)) {
+    return true;
+  }
+  for (const auto &job : queued) {
+    if (job.first == id) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ProcessRunner::reportProgress() {
+  for (auto it = running.cbegin(); it != running.cend(); ++it) {
+    emit progress(it.key(), it->elapsed.elapsed(), it->output);
+  }
+}
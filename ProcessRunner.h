@@ -0,0 +1,82 @@
+#ifndef PROCESSRUNNER_H
+#define PROCESSRUNNER_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QProcess>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+
+// Runs external programs without blocking the event loop; today that is the
+// decrypt script embedded in archives the native engine can't read.
+//
+// Programs are started directly with an argument list, never through a
+// shell, so nothing needs quoting. Secrets go in `input`, which is written
+// to the program's stdin, after which stdin is closed and our copy wiped.
+//
+// Up to maxConcurrent() jobs run at once and the rest wait their turn. Each
+// job reports progress every PROGRESS_INTERVAL_MS while it runs, and exactly
+// one finished() once it exits, fails to start or is cancelled.
+class ProcessRunner : public QObject {
+  Q_OBJECT
+
+public:
+  struct Job {
+    QString program;
+    QStringList arguments;
+    QString workingDirectory;
+    QByteArray input;
+  };
+
+  explicit ProcessRunner(QObject *parent = nullptr);
+  // Kills whatever is still running
+  ~ProcessRunner();
+
+  void setMaxConcurrent(int count);
+  int maxConcurrent() const { return concurrency; }
+
+  // Queues `job` and returns its id
+  int start(Job job);
+  // Asks a running job to terminate, killing it after KILL_TIMEOUT_MS; a
+  // queued one is dropped. finished() follows with `cancelled` set.
+  void cancel(int id);
+  void cancelAll();
+  // Kills every job and waits for it to exit, without emitting finished()
+  void killAll();
+  bool isActive(int id) const;
+
+  static constexpr int PROGRESS_INTERVAL_MS = 250;
+  static constexpr int KILL_TIMEOUT_MS = 3000;
+  // Only the tail of longer output is kept
+  static constexpr int MAX_OUTPUT_SIZE = 64 * 1024;
+
+signals:
+  // `output` is the program's stdout and stderr so far, merged
+  void progress(int id, qint64 elapsedMs, const QByteArray &output);
+  void finished(int id, bool ok, const QString &output, bool cancelled);
+
+private:
+  struct Running {
+    QProcess *process = nullptr;
+    QElapsedTimer elapsed;
+    QByteArray output;
+    bool cancelled = false;
+  };
+
+  void startQueued();
+  void readOutput(int id);
+  void complete(int id, bool ok, const QString &message);
+  void reportProgress();
+
+  int concurrency;
+  int nextId = 1;
+  QList<QPair<int, Job>> queued;
+  QHash<int, Running> running;
+  QTimer *progressTimer;
+};
+
+#endif // PROCESSRUNNER_H
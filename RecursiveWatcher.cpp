@@ -0,0 +1,369 @@
+#include "RecursiveWatcher.h"
+#include "DirectoryCrawler.h"
+#include <QDebug>
+#include <QMutexLocker>
+
+#if defined(__APPLE__)
+#include <CoreServices/CoreServices.h>
+#include <vector>
+#elif defined(__linux__)
+#include <QHash>
+#include <QSocketNotifier>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sys/inotify.h>
+#include <thread>
+#include <unistd.h>
+#endif
+
+#if defined(__APPLE__)
+struct RecursiveWatcher::Backend {
+  explicit Backend(RecursiveWatcher *owner)
+      : owner(owner),
+        queue(dispatch_queue_create("SecureViewer.fsevents",
+                                    DISPATCH_QUEUE_SERIAL)) {}
+
+  ~Backend() {
+    for (FSEventStreamRef stream : streams) {
+      FSEventStreamStop(stream);
+      FSEventStreamInvalidate(stream);
+      FSEventStreamRelease(stream);
+    }
+    // Let a callback already running on the queue finish before the owner
+    // goes away
+    dispatch_sync_f(queue, nullptr, [](void *) {});
+    dispatch_release(queue);
+  }
+
+  bool start(const QString &root) {
+    QByteArray utf8 = root.toUtf8();
+    CFStringRef path = CFStringCreateWithCString(nullptr, utf8.constData(),
+                                                 kCFStringEncodingUTF8);
+    CFArrayRef paths =
+        CFArrayCreate(nullptr, reinterpret_cast<const void **>(&path), 1,
+                      &kCFTypeArrayCallBacks);
+    FSEventStreamContext context{0, this, nullptr, nullptr, nullptr};
+    // FSEvents does its own coalescing over the latency window
+    FSEventStreamRef stream = FSEventStreamCreate(
+        nullptr, &Backend::callback, &context, paths,
+        kFSEventStreamEventIdSinceNow, COALESCE_MS / 1000.0,
+        kFSEventStreamCreateFlagFileEvents |
+            kFSEventStreamCreateFlagWatchRoot);
+    CFRelease(paths);
+    CFRelease(path);
+    if (!stream) {
+      return false;
+    }
+
+    FSEventStreamSetDispatchQueue(stream, queue);
+    if (!FSEventStreamStart(stream)) {
+      FSEventStreamInvalidate(stream);
+      FSEventStreamRelease(stream);
+      return false;
+    }
+    streams.push_back(stream);
+    roots << root;
+    return true;
+  }
+
+  static void callback(ConstFSEventStreamRef, void *info, size_t count,
+                       void *eventPaths,
+                       const FSEventStreamEventFlags flags[],
+                       const FSEventStreamEventId[]) {
+    auto *backend = static_cast<Backend *>(info);
+    char **paths = static_cast<char **>(eventPaths);
+    const FSEventStreamEventFlags lost =
+        kFSEventStreamEventFlagUserDropped |
+        kFSEventStreamEventFlagKernelDropped;
+    const FSEventStreamEventFlags structural =
+        kFSEventStreamEventFlagItemCreated |
+        kFSEventStreamEventFlagItemRemoved |
+        kFSEventStreamEventFlagItemRenamed;
+
+    QStringList changed;
+    for (size_t i = 0; i < count; ++i) {
+      QString path = QString::fromUtf8(paths[i]);
+      if (flags[i] & lost) {
+        changed << backend->roots;
+      } else if (flags[i] & (kFSEventStreamEventFlagMustScanSubDirs |
+                             kFSEventStreamEventFlagRootChanged)) {
+        changed << path;
+      } else {
+        bool isDirectory = flags[i] & kFSEventStreamEventFlagItemIsDir;
+        // Directory contents changing is reported per file already
+        if (isDirectory && !(flags[i] & structural)) {
+          continue;
+        }
+        if (backend->owner->wanted(path, isDirectory)) {
+          changed << path;
+        }
+      }
+    }
+    if (!changed.isEmpty()) {
+      backend->owner->enqueue(changed);
+    }
+  }
+
+  RecursiveWatcher *owner;
+  dispatch_queue_t queue;
+  std::vector<FSEventStreamRef> streams;
+  QStringList roots;
+};
+#elif defined(__linux__)
+struct RecursiveWatcher::Backend {
+  // Directory watches only; files are reported through their directory
+  static constexpr uint32_t WATCH_MASK =
+      IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE |
+      IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+
+  explicit Backend(RecursiveWatcher *owner) : owner(owner) {}
+
+  ~Backend() {
+    {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      stopping = true;
+      if (crawler) {
+        crawler->cancel();
+      }
+    }
+    queueReady.notify_all();
+    if (registrar.joinable()) {
+      registrar.join();
+    }
+    delete notifier;
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  bool start(const QString &root) {
+    if (fd < 0) {
+      fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+      if (fd < 0) {
+        return false;
+      }
+      notifier = new QSocketNotifier(fd, QSocketNotifier::Read);
+      QObject::connect(notifier, &QSocketNotifier::activated, owner,
+                       [this]() { readEvents(); });
+      registrar = std::thread([this]() { registerLoop(); });
+    }
+    roots << root;
+    registerTree(root);
+    return true;
+  }
+
+  // Watches are added from a background crawl so a large tree doesn't hold
+  // up the GUI thread
+  void registerTree(const QString &path) {
+    {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      pendingTrees.push_back(path.toStdString());
+    }
+    queueReady.notify_one();
+  }
+
+  void registerLoop() {
+    for (;;) {
+      std::string tree;
+      DirectoryCrawler treeCrawler;
+      {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        queueReady.wait(lock,
+                        [this]() { return stopping || !pendingTrees.empty(); });
+        if (stopping) {
+          return;
+        }
+        tree = std::move(pendingTrees.front());
+        pendingTrees.pop_front();
+        crawler = &treeCrawler;
+      }
+
+      treeCrawler.setThreadCount(2);
+      treeCrawler.setSkipFunction(owner->skip);
+      treeCrawler.setDirectoryFunction(
+          [this](const std::string &directory) { addWatch(directory); });
+      treeCrawler.crawl(
+          tree, [](const std::string &, const DirectoryCrawler::FileStat &) {});
+
+      std::lock_guard<std::mutex> lock(queueMutex);
+      crawler = nullptr;
+    }
+  }
+
+  void addWatch(const std::string &directory) {
+    int wd = inotify_add_watch(fd, directory.c_str(), WATCH_MASK);
+    if (wd >= 0) {
+      QMutexLocker lock(&watchMutex);
+      watches.insert(wd, QString::fromStdString(directory));
+    } else if (errno == ENOSPC && !warnedLimit.exchange(true)) {
+      qWarning() << "inotify watch limit reached; changes below"
+                 << QString::fromStdString(directory)
+                 << "and elsewhere may be missed";
+    }
+  }
+
+  void forgetTree(const QString &directory) {
+    QString prefix = directory + "/";
+    QMutexLocker lock(&watchMutex);
+    for (auto it = watches.begin(); it != watches.end();) {
+      if (it.value() == directory || it.value().startsWith(prefix)) {
+        inotify_rm_watch(fd, it.key());
+        it = watches.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  void readEvents() {
+    alignas(inotify_event) char buffer[64 * 1024];
+    QStringList changed;
+    for (;;) {
+      ssize_t bytes = read(fd, buffer, sizeof(buffer));
+      if (bytes <= 0) {
+        break;
+      }
+      for (char *p = buffer; p < buffer + bytes;) {
+        auto *event = reinterpret_cast<inotify_event *>(p);
+        handleEvent(*event, changed);
+        p += sizeof(inotify_event) + event->len;
+      }
+    }
+    if (!changed.isEmpty()) {
+      owner->enqueue(changed);
+    }
+  }
+
+  void handleEvent(const inotify_event &event, QStringList &changed) {
+    if (event.mask & IN_Q_OVERFLOW) {
+      changed << roots;
+      return;
+    }
+
+    QString directory;
+    {
+      QMutexLocker lock(&watchMutex);
+      if (event.mask & IN_IGNORED) {
+        watches.remove(event.wd);
+        return;
+      }
+      directory = watches.value(event.wd);
+    }
+    // Events about the watched directory itself also reach its parent
+    if (directory.isEmpty() || event.len == 0) {
+      return;
+    }
+
+    QString path = directory + "/" + QString::fromUtf8(event.name);
+    bool isDirectory = event.mask & IN_ISDIR;
+    if (isDirectory && (event.mask & IN_MOVED_FROM)) {
+      // Its watches would keep reporting under the old name
+      forgetTree(path);
+    }
+    if (!owner->wanted(path, isDirectory)) {
+      return;
+    }
+    if (isDirectory && (event.mask & (IN_CREATE | IN_MOVED_TO))) {
+      registerTree(path);
+    }
+    changed << path;
+  }
+
+  RecursiveWatcher *owner;
+  int fd = -1;
+  QSocketNotifier *notifier = nullptr;
+  QStringList roots;
+
+  QMutex watchMutex;
+  QHash<int, QString> watches; // wd -> directory
+  std::atomic<bool> warnedLimit{false};
+
+  std::thread registrar;
+  std::mutex queueMutex;
+  std::condition_variable queueReady;
+  std::deque<std::string> pendingTrees;
+  DirectoryCrawler *crawler = nullptr;
+  bool stopping = false;
+};
+#else
+struct RecursiveWatcher::Backend {
+  explicit Backend(RecursiveWatcher *) {}
+  bool start(const QString &) { return false; }
+};
+#endif
+
+RecursiveWatcher::RecursiveWatcher(QObject *parent)
+    : QObject(parent), backend(std::make_unique<Backend>(this)) {
+  coalesceTimer = new QTimer(this);
+  coalesceTimer->setSingleShot(true);
+  coalesceTimer->setInterval(COALESCE_MS);
+  connect(coalesceTimer, &QTimer::timeout, this, &RecursiveWatcher::flush);
+}
+
+RecursiveWatcher::~RecursiveWatcher() {
+  // Stops the native callbacks before anything they touch is destroyed
+  backend.reset();
+}
+
+bool RecursiveWatcher::watch(const QString &root) {
+  if (roots.contains(root)) {
+    return true;
+  }
+  if (!backend->start(root)) {
+    qWarning() << "Recursive file watching is unavailable for" << root;
+    return false;
+  }
+  roots.insert(root);
+  return true;
+}
+
+bool RecursiveWatcher::wanted(const QString &path, bool isDirectory) const {
+  // Same rules as the crawler: nothing hidden, nothing excluded
+  int start = 1;
+  for (int slash = path.indexOf('/', start); start < path.size();
+       slash = path.indexOf('/', start)) {
+    if (path.at(start) == '.') {
+      return false;
+    }
+    if (slash < 0) {
+      break;
+    }
+    if (skip && skip(path.left(slash).toStdString())) {
+      return false;
+    }
+    start = slash + 1;
+  }
+  if (isDirectory) {
+    return !skip || !skip(path.toStdString());
+  }
+  return path.endsWith(suffix);
+}
+
+void RecursiveWatcher::enqueue(const QStringList &paths) {
+  QMutexLocker lock(&pendingMutex);
+  for (const QString &path : paths) {
+    pendingPaths.insert(path);
+  }
+  if (!flushScheduled) {
+    // The timer lives on the GUI thread; backends may call from elsewhere
+    flushScheduled = true;
+    QMetaObject::invokeMethod(
+        this, [this]() { coalesceTimer->start(); }, Qt::QueuedConnection);
+  }
+}
+
+void RecursiveWatcher::flush() {
+  QStringList paths;
+  {
+    QMutexLocker lock(&pendingMutex);
+    paths = QStringList(pendingPaths.begin(), pendingPaths.end());
+    pendingPaths.clear();
+    flushScheduled = false;
+  }
+  if (!paths.isEmpty()) {
+    emit pathsChanged(paths);
+  }
+}
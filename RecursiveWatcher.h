@@ -0,0 +1,73 @@
+#ifndef RECURSIVEWATCHER_H
+#define RECURSIVEWATCHER_H
+
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+#include <functional>
+#include <memory>
+#include <string>
+
+// Watches whole directory trees for archive and directory changes with the
+// platform's native recursive mechanism, instead of one QFileSystemWatcher
+// entry (and one kqueue descriptor) per path.
+//
+// macOS: one FSEvents stream per root, with file-level events.
+// Linux: one inotify descriptor; directory watches (no per-file watches) are
+// registered in bulk on a background crawl and extended as directories
+// appear.
+//
+// Only events for directories and for files with the watched suffix are
+// reported. They are coalesced: pathsChanged() fires at most once per
+// COALESCE_MS with every distinct path touched in that window. A path is
+// reported without saying what happened to it; the receiver re-checks it.
+// When the backend loses events (queue overflow) the root itself is
+// reported, meaning "rescan everything".
+class RecursiveWatcher : public QObject {
+  Q_OBJECT
+
+public:
+  using SkipFunction = std::function<bool(const std::string &)>;
+
+  explicit RecursiveWatcher(QObject *parent = nullptr);
+  ~RecursiveWatcher();
+
+  void setSuffix(const QString &value) { suffix = value; }
+  // Directories for which this returns true are not watched (Linux) or have
+  // their events dropped (macOS)
+  void setSkipFunction(SkipFunction function) { skip = std::move(function); }
+
+  // Starts watching `root` recursively; repeated calls for a root already
+  // being watched do nothing
+  bool watch(const QString &root);
+  bool isWatching(const QString &root) const { return roots.contains(root); }
+
+  // Thread-safe; used by the backends to report raw events
+  void enqueue(const QStringList &paths);
+  bool wanted(const QString &path, bool isDirectory) const;
+
+  static constexpr int COALESCE_MS = 250;
+
+signals:
+  void pathsChanged(const QStringList &paths);
+
+private:
+  struct Backend;
+
+  void flush();
+
+  std::unique_ptr<Backend> backend;
+  QSet<QString> roots;
+  QString suffix = ".senc";
+  SkipFunction skip;
+
+  QMutex pendingMutex;
+  QSet<QString> pendingPaths;
+  bool flushScheduled = false;
+  QTimer *coalesceTimer;
+};
+
+#endif // RECURSIVEWATCHER_H
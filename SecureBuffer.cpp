@@ -0,0 +1,160 @@
+#include "SecureBuffer.h"
+#include <map>
+#include <mutex>
+#include <openssl/crypto.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+struct Region {
+  unsigned char *data;
+  bool locked;
+};
+
+// Everything in here has already been wiped. Never destroyed, so buffers in
+// other static objects can still be released during exit.
+struct Pool {
+  std::mutex mutex;
+  std::multimap<size_t, Region> regions; // by mapped length
+  size_t bytes = 0;
+};
+
+Pool &pool() {
+  static Pool *instance = new Pool;
+  return *instance;
+}
+
+void unmap(unsigned char *data, size_t length, bool locked) {
+  if (locked) {
+    munlock(data, length);
+  }
+  munmap(data, length);
+}
+
+// Best fit, but never more than twice what was asked for, so small requests
+// don't tie up big slabs
+bool takePooled(size_t length, unsigned char *&data, size_t &mapped,
+                bool &locked) {
+  Pool &p = pool();
+  std::lock_guard<std::mutex> lock(p.mutex);
+  auto it = p.regions.lower_bound(length);
+  if (it == p.regions.end() || it->first > 2 * length) {
+    return false;
+  }
+  data = it->second.data;
+  locked = it->second.locked;
+  mapped = it->first;
+  p.bytes -= mapped;
+  p.regions.erase(it);
+  return true;
+}
+
+bool givePooled(unsigned char *data, size_t mapped, bool locked) {
+  Pool &p = pool();
+  std::lock_guard<std::mutex> lock(p.mutex);
+  if (mapped > SecureBuffer::MAX_POOLED_BYTES / 2 ||
+      p.bytes + mapped > SecureBuffer::MAX_POOLED_BYTES) {
+    return false;
+  }
+  p.regions.emplace(mapped, Region{data, locked});
+  p.bytes += mapped;
+  return true;
+}
+} // namespace
+
+SecureBuffer::~SecureBuffer() { clear(); }
+
+SecureBuffer::SecureBuffer(SecureBuffer &&other) noexcept
+    : region(std::exchange(other.region, nullptr)),
+      used(std::exchange(other.used, 0)),
+      mapped(std::exchange(other.mapped, 0)),
+      locked(std::exchange(other.locked, false)) {}
+
+SecureBuffer &SecureBuffer::operator=(SecureBuffer &&other) noexcept {
+  if (this != &other) {
+    clear();
+    region = std::exchange(other.region, nullptr);
+    used = std::exchange(other.used, 0);
+    mapped = std::exchange(other.mapped, 0);
+    locked = std::exchange(other.locked, false);
+  }
+  return *this;
+}
+
+size_t SecureBuffer::pageSize() {
+  static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  return size;
+}
+
+bool SecureBuffer::allocate(size_t size) {
+  clear();
+  if (size == 0) {
+    return true;
+  }
+
+  size_t page = pageSize();
+  size_t length = (size + page - 1) / page * page;
+  if (takePooled(length, region, mapped, locked)) {
+    used = size;
+    return true;
+  }
+
+  void *ptr = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANON, -1, 0);
+  if (ptr == MAP_FAILED) {
+    return false;
+  }
+
+  region = static_cast<unsigned char *>(ptr);
+  mapped = length;
+  used = size;
+  // Locking is best effort: RLIMIT_MEMLOCK may be far smaller than a video
+  locked = mlock(region, mapped) == 0;
+#ifdef MADV_DONTDUMP
+  madvise(region, mapped, MADV_DONTDUMP);
+#endif
+#ifdef MADV_DONTFORK
+  madvise(region, mapped, MADV_DONTFORK);
+#endif
+  return true;
+}
+
+void SecureBuffer::resize(size_t size) {
+  if (size <= mapped) {
+    used = size;
+  }
+}
+
+void SecureBuffer::clear() {
+  if (!region) {
+    return;
+  }
+  OPENSSL_cleanse(region, mapped);
+  if (!givePooled(region, mapped, locked)) {
+    unmap(region, mapped, locked);
+  }
+  region = nullptr;
+  used = 0;
+  mapped = 0;
+  locked = false;
+}
+
+size_t SecureBuffer::pooledBytes() {
+  Pool &p = pool();
+  std::lock_guard<std::mutex> lock(p.mutex);
+  return p.bytes;
+}
+
+void SecureBuffer::trimPool() {
+  std::multimap<size_t, Region> regions;
+  {
+    Pool &p = pool();
+    std::lock_guard<std::mutex> lock(p.mutex);
+    regions.swap(p.regions);
+    p.bytes = 0;
+  }
+  for (const auto &entry : regions) {
+    unmap(entry.second.data, entry.first, entry.second.locked);
+  }
+}
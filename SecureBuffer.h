@@ -0,0 +1,61 @@
+#ifndef SECUREBUFFER_H
+#define SECUREBUFFER_H
+
+#include <cstddef>
+
+// Page-aligned anonymous memory for plaintext. The region is mlock'd when the
+// system allows it (so it never hits swap) and is always zeroed before it is
+// unmapped.
+//
+// Released regions are zeroed and then parked in a process-wide pool, still
+// mapped and locked, so the next allocate() of a similar size reuses one
+// instead of paying for mmap, mlock and page faults again. Opening file after
+// file cycles through the same few slabs.
+class SecureBuffer {
+public:
+  SecureBuffer() = default;
+  ~SecureBuffer();
+
+  SecureBuffer(const SecureBuffer &) = delete;
+  SecureBuffer &operator=(const SecureBuffer &) = delete;
+  SecureBuffer(SecureBuffer &&other) noexcept;
+  SecureBuffer &operator=(SecureBuffer &&other) noexcept;
+
+  // Maps at least `size` bytes; previous contents are wiped first
+  bool allocate(size_t size);
+  // Shrinks the logical size; never reallocates
+  void resize(size_t size);
+  // Zeroes the region and releases it. It usually stays mapped, and locked,
+  // in the pool for reuse until trimPool(); only a region the pool has no
+  // room for is unmapped here.
+  void clear();
+
+  unsigned char *data() { return region; }
+  const unsigned char *data() const { return region; }
+  size_t size() const { return used; }
+  size_t capacity() const { return mapped; }
+  bool empty() const { return used == 0; }
+  bool isLocked() const { return locked; }
+
+  unsigned char *begin() { return region; }
+  unsigned char *end() { return region + used; }
+  const unsigned char *begin() const { return region; }
+  const unsigned char *end() const { return region + used; }
+
+  static size_t pageSize();
+
+  // Wiped regions kept for reuse, at most this many bytes in all; regions
+  // over half of it are always unmapped
+  static constexpr size_t MAX_POOLED_BYTES = 64 * 1024 * 1024;
+  static size_t pooledBytes();
+  // Unmaps every pooled region
+  static void trimPool();
+
+private:
+  unsigned char *region = nullptr;
+  size_t used = 0;
+  size_t mapped = 0;
+  bool locked = false;
+};
+
+#endif // SECUREBUFFER_H
@@ -0,0 +1,46 @@
+#include "SecureBufferDevice.h"
+#include <cstring>
+
+SecureBufferDevice::SecureBufferDevice(SencPlaintext &&plaintext,
+                                       QObject *parent)
+    : QIODevice(parent), plaintext(std::move(plaintext)) {}
+
+SecureBufferDevice::~SecureBufferDevice() {
+  QIODevice::close();
+  plaintext.clear();
+}
+
+bool SecureBufferDevice::open(OpenMode mode) {
+  if (mode & (QIODevice::WriteOnly | QIODevice::Append)) {
+    setErrorString("SecureBufferDevice is read-only");
+    return false;
+  }
+  return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+qint64 SecureBufferDevice::size() const {
+  return static_cast<qint64>(plaintext.contentSize());
+}
+
+const char *SecureBufferDevice::constData() const {
+  return reinterpret_cast<const char *>(plaintext.content());
+}
+
+QString SecureBufferDevice::originalName() const {
+  return QString::fromStdString(plaintext.originalName);
+}
+
+qint64 SecureBufferDevice::readData(char *data, qint64 maxSize) {
+  qint64 available = size() - pos();
+  qint64 count = qMin(maxSize, available);
+  if (count <= 0) {
+    return available < 0 ? -1 : 0;
+  }
+  std::memcpy(data, constData() + pos(), static_cast<size_t>(count));
+  return count;
+}
+
+qint64 SecureBufferDevice::writeData([[maybe_unused]] const char *data,
+                                     [[maybe_unused]] qint64 maxSize) {
+  return -1;
+}
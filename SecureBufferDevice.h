@@ -0,0 +1,32 @@
+#ifndef SECUREBUFFERDEVICE_H
+#define SECUREBUFFERDEVICE_H
+
+#include "SencArchive.h"
+#include <QIODevice>
+
+// Read-only, random-access QIODevice over decrypted plaintext held in locked
+// memory. Takes ownership of the plaintext and wipes it on destruction.
+class SecureBufferDevice : public QIODevice {
+  Q_OBJECT
+
+public:
+  explicit SecureBufferDevice(SencPlaintext &&plaintext,
+                              QObject *parent = nullptr);
+  ~SecureBufferDevice();
+
+  bool open(OpenMode mode) override;
+  bool isSequential() const override { return false; }
+  qint64 size() const override;
+
+  const char *constData() const;
+  QString originalName() const;
+
+protected:
+  qint64 readData(char *data, qint64 maxSize) override;
+  qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+  SencPlaintext plaintext;
+};
+
+#endif // SECUREBUFFERDEVICE_H
@@ -1,15 +1,27 @@
 #include "SecureViewer.h"
+#include "SecureBufferDevice.h"
+#include "PerfTrace.h"
+#include "SencArchive.h"
+#include "SencCrypto.h"
+#include "SencStreamDevice.h"
+#include <QAction>
 #include <QApplication>
 #include <QAudioOutput>
+#include <QImageReader>
+#include <QMenu>
 #include <QMediaPlayer>
+#include <QMimeDatabase>
 #include <QScreen>
+#include <QSettings>
 #include <QStackedWidget>
 #include <QStyle>
+#include <QThread>
+#include <QVideoFrame>
+#include <QVideoSink>
 #include <QVideoWidget>
 #include <QtConcurrent>
-#include <array>
-#include <cstdio>
-#include <fstream>
+#include <memory>
+#include <openssl/crypto.h>
 #include <random>
 
 namespace fs = std::filesystem;
@@ -33,6 +45,84 @@ SecureViewer::SecureViewer(QWidget *parent) : QMainWindow(parent) {
   mainStatusBar->addPermanentWidget(new QLabel(" | ", this)); // Separator
   mainStatusBar->addPermanentWidget(searchStatusLabel);
 
+  // Shown only while a batch runs
+  batchProgress = new QProgressBar(this);
+  batchProgress->setMaximumWidth(160);
+  batchProgress->setTextVisible(false);
+  batchStatusLabel = new QLabel(this);
+  batchCancelButton = new QPushButton("Cancel", this);
+  mainStatusBar->addWidget(batchProgress);
+  mainStatusBar->addWidget(batchStatusLabel);
+  mainStatusBar->addWidget(batchCancelButton);
+  batchProgress->hide();
+  batchStatusLabel->hide();
+  batchCancelButton->hide();
+  connect(batchCancelButton, &QPushButton::clicked, &batchQueue,
+          &BatchJobQueue::cancel);
+  connect(&batchQueue, &BatchJobQueue::progress, this,
+          &SecureViewer::handleBatchProgress);
+  connect(&batchQueue, &BatchJobQueue::finished, this,
+          &SecureViewer::handleBatchFinished);
+  connect(&scriptRunner, &ProcessRunner::progress, this,
+          &SecureViewer::handleScriptProgress);
+  connect(&scriptRunner, &ProcessRunner::finished, this,
+          &SecureViewer::handleScriptFinished);
+
+  // Cap on decrypt worker threads; 0 lets the engine use one per core
+  QSettings settings("SecureViewer", "SecureViewer");
+  decryptThreadsSpin = new QSpinBox(this);
+  decryptThreadsSpin->setRange(0, QThread::idealThreadCount());
+  decryptThreadsSpin->setSpecialValueText("Threads: Auto");
+  decryptThreadsSpin->setPrefix("Threads: ");
+  decryptThreadsSpin->setValue(settings.value("decrypt/maxThreads", 0).toInt());
+  decryptThreadsSpin->setToolTip(
+      QString("Maximum threads used to decrypt a file (AES: %1)")
+          .arg(QString::fromStdString(SencCrypto::kernelDescription())));
+  mainStatusBar->addPermanentWidget(new QLabel(" | ", this)); // Separator
+  mainStatusBar->addPermanentWidget(decryptThreadsSpin);
+  connect(decryptThreadsSpin, &QSpinBox::valueChanged, this, [](int value) {
+    QSettings("SecureViewer", "SecureViewer")
+        .setValue("decrypt/maxThreads", value);
+  });
+
+  // Hot-path timings; tracing only runs while the panel is open
+  perfDock = new QDockWidget("Performance", this);
+  perfDock->setObjectName("perfDock");
+  perfDock->setWidget(new PerfPanel(perfDock));
+  addDockWidget(Qt::BottomDockWidgetArea, perfDock);
+  QAction *perfAction = perfDock->toggleViewAction();
+  perfAction->setText("Perf");
+  perfAction->setToolTip("Show how long decrypting, scanning and drawing take");
+  perfButton = new QToolButton(this);
+  perfButton->setDefaultAction(perfAction);
+  mainStatusBar->addPermanentWidget(new QLabel(" | ", this)); // Separator
+  mainStatusBar->addPermanentWidget(perfButton);
+  connect(perfAction, &QAction::toggled, this, [](bool shown) {
+    PerfTrace::setEnabled(shown);
+    QSettings("SecureViewer", "SecureViewer").setValue("perf/panel", shown);
+  });
+  bool perfShown = settings.value("perf/panel", false).toBool();
+  perfDock->setVisible(perfShown);
+  PerfTrace::setEnabled(perfShown);
+
+  // Sidebar neighbours are decrypted ahead of time; video is streamed anyway
+  prefetcher.setDepth(
+      settings.value("prefetch/depth", DecryptPrefetcher::DEFAULT_DEPTH)
+          .toInt());
+  prefetcher.setMemoryBudget(
+      settings
+          .value("prefetch/memoryBudgetMB",
+                 DecryptPrefetcher::DEFAULT_MEMORY_BUDGET / (1024 * 1024))
+          .toLongLong() *
+      1024 * 1024);
+  prefetcher.setNameFilter(
+      [](const QString &name) { return !isVideoFile(name); });
+
+  // Indexing costs a key derivation per archive, and a decrypt for each
+  // preview; keep it to one thread and out of the way
+  indexPool.setMaxThreadCount(1);
+  indexPool.setThreadPriority(QThread::LowestPriority);
+
   // Set minimum sizes to prevent status bar items from collapsing
   timerStatusLabel->setMinimumWidth(150);
   fileStatusLabel->setMinimumWidth(200);
@@ -48,12 +138,14 @@ SecureViewer::SecureViewer(QWidget *parent) : QMainWindow(parent) {
   saveButton = new QPushButton("Save and Encrypt", this);
   saveButton->setEnabled(false);
   uploadButton = new QPushButton("Encrypt File", this);
+  batchButton = new QPushButton("Encrypt Files...", this);
   passwordInput = new QLineEdit(this);
   passwordInput->setPlaceholderText("Enter decryption password here, love :)");
   passwordInput->setEchoMode(QLineEdit::Password);
 
   buttonLayout->addWidget(decryptButton);
   buttonLayout->addWidget(uploadButton);
+  buttonLayout->addWidget(batchButton);
   buttonLayout->addWidget(passwordInput);
   buttonLayout->addWidget(clearButton);
   buttonLayout->addWidget(saveButton);
@@ -61,38 +153,22 @@ SecureViewer::SecureViewer(QWidget *parent) : QMainWindow(parent) {
   contentStack = new QStackedWidget(this);
   textViewer = new QTextEdit(this);
   textViewer->setReadOnly(true);
+  largeTextViewer = new LargeTextView(this);
 
   imageViewer = new QLabel(this);
   imageViewer->setAlignment(Qt::AlignCenter);
   imageViewer->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
   imageViewer->setMinimumSize(200, 200);
+  smoothScaleTimer = new QTimer(this);
+  smoothScaleTimer->setSingleShot(true);
+  smoothScaleTimer->setInterval(SMOOTH_SCALE_DELAY_MS);
+  connect(smoothScaleTimer, &QTimer::timeout, this,
+          [this]() { updateImageScale(Qt::SmoothTransformation); });
 
-  videoPlayer = new QMediaPlayer(this);
-  audioOutput = new QAudioOutput(this);
-  videoPlayer->setAudioOutput(audioOutput);
-  videoWidget = new QVideoWidget(this);
-  videoPlayer->setVideoOutput(videoWidget);
-
-  // Initialize PDF components
-  pdfDocument = new QPdfDocument(this);
-  pdfViewer = new QPdfView(this);
-  pdfViewer->setDocument(pdfDocument);
-
-  // Create scrollable area for PDF
-  pdfScrollArea = new QScrollArea(this);
-  pdfScrollArea->setWidget(pdfViewer);
-  pdfScrollArea->setWidgetResizable(true);
-  pdfScrollArea->setAlignment(Qt::AlignCenter);
-
-  // Ensure PDF viewer stays fixed width but allows vertical scrolling
-  pdfViewer->setSizePolicy(QSizePolicy::Preferred,
-                           QSizePolicy::MinimumExpanding);
-
-  contentStack->addWidget(pdfScrollArea);
-
+  // The media and PDF viewers are built the first time they are needed
   contentStack->addWidget(textViewer);
+  contentStack->addWidget(largeTextViewer);
   contentStack->addWidget(imageViewer);
-  contentStack->addWidget(videoWidget);
 
   mainLayout->addLayout(buttonLayout);
   mainLayout->addWidget(contentStack);
@@ -102,6 +178,8 @@ SecureViewer::SecureViewer(QWidget *parent) : QMainWindow(parent) {
   int timeout = 10 * min;
   autoDeleteTimer->setInterval(timeout);
   autoDeleteTimer->setSingleShot(true);
+  // Cached keys never outlive the content they were used for
+  keyCache.setTimeToLive(std::chrono::milliseconds(timeout));
 
   setupFileSidebar();
   setupDropOverlay();
@@ -113,17 +191,24 @@ SecureViewer::SecureViewer(QWidget *parent) : QMainWindow(parent) {
           [this]() { saveButton->setEnabled(false); });
   connect(uploadButton, &QPushButton::clicked, this,
           &SecureViewer::handleUnencryptedFile);
+  connect(batchButton, &QPushButton::clicked, this, [this]() {
+    QStringList files = QFileDialog::getOpenFileNames(
+        this, "Select Files to Encrypt", "", "All Files (*)");
+    if (!files.isEmpty()) {
+      startBatch(BatchJobQueue::Operation::Encrypt, files);
+    }
+  });
   connect(autoDeleteTimer, &QTimer::timeout, this, &SecureViewer::clearContent);
-  connect(videoPlayer, &QMediaPlayer::errorOccurred, this,
-          &SecureViewer::handleMediaError);
   connect(saveButton, &QPushButton::clicked, this,
           &SecureViewer::saveAndEncrypt);
-  connect(videoPlayer, &QMediaPlayer::playbackStateChanged, this,
-          &SecureViewer::handlePlaybackStateChanged);
   connect(autoDeleteTimer, &QTimer::timeout, this,
           &SecureViewer::updateTimerStatus);
   connect(&fileCache, &FileCache::cacheUpdated, this,
           &SecureViewer::handleCacheUpdated);
+  connect(&fileCache, &FileCache::entriesValidated, this,
+          &SecureViewer::handleEntriesValidated);
+  connect(&fileCache, &FileCache::entriesRemoved, this,
+          &SecureViewer::handleEntriesRemoved);
 
   // Update timer status every second
   QTimer *statusUpdateTimer = new QTimer(this);
@@ -135,6 +220,60 @@ SecureViewer::SecureViewer(QWidget *parent) : QMainWindow(parent) {
   clearContent();
 }
 
+void SecureViewer::ensureVideoPlayer() {
+  if (videoPlayer) {
+    return;
+  }
+  // Creating the player brings up the multimedia backend, which costs more
+  // than the rest of the window put together
+  videoPlayer = new QMediaPlayer(this);
+  audioOutput = new QAudioOutput(this);
+  videoPlayer->setAudioOutput(audioOutput);
+  videoWidget = new QVideoWidget(this);
+  videoPlayer->setVideoOutput(videoWidget);
+  contentStack->addWidget(videoWidget);
+  connect(videoPlayer, &QMediaPlayer::errorOccurred, this,
+          &SecureViewer::handleMediaError);
+  connect(videoPlayer, &QMediaPlayer::playbackStateChanged, this,
+          &SecureViewer::handlePlaybackStateChanged);
+  // The first frame of each video played becomes its preview
+  connect(videoWidget->videoSink(), &QVideoSink::videoFrameChanged, this,
+          [this](const QVideoFrame &frame) {
+            if (videoThumbnailPending && frame.isValid()) {
+              videoThumbnailPending = false;
+              if (!displayedArchive.empty()) {
+                storeThumbnail(displayedArchive);
+              }
+            }
+          });
+}
+
+void SecureViewer::ensurePdfViewer() {
+  if (pdfViewer) {
+    return;
+  }
+  // PDFs load and render off the GUI thread, one visible page at a time
+  pdfViewer = new PdfPageView(this);
+  connect(pdfViewer, &PdfPageView::loaded, this, [this]() {
+    if (!displayedArchive.empty() && needsThumbnail(displayedArchive)) {
+      pdfViewer->requestThumbnail(ThumbnailCache::THUMBNAIL_SIZE);
+    }
+  });
+  connect(pdfViewer, &PdfPageView::thumbnailReady, this,
+          [this](const QImage &image) {
+            if (!displayedArchive.empty()) {
+              storeThumbnail(displayedArchive, image);
+            }
+          });
+  connect(pdfViewer, &PdfPageView::loadFailed, this,
+          [this](const QString &error) {
+            QMessageBox::warning(
+                this, "Error",
+                QString("Failed to load PDF document: %1").arg(error));
+          });
+  contentStack->addWidget(pdfViewer);
+}
+
 void SecureViewer::updateTimerStatus() {
   if (autoDeleteTimer->isActive()) {
     int remainingTime = autoDeleteTimer->remainingTime();
@@ -206,6 +345,18 @@ void SecureViewer::dropEvent(QDropEvent *event) {
 
   if (mimeData->hasUrls()) {
     QList<QUrl> urlList = mimeData->urls();
+    if (urlList.size() > 1 || (!urlList.isEmpty() &&
+                               QFileInfo(urlList.first().toLocalFile())
+                                   .isDir())) {
+      // Several files or a folder become a batch
+      QStringList paths;
+      for (const QUrl &url : urlList) {
+        paths << url.toLocalFile();
+      }
+      event->acceptProposedAction();
+      askForBatch(paths);
+      return;
+    }
     if (!urlList.isEmpty()) {
       QString filePath = urlList.first().toLocalFile();
       if (filePath.endsWith(".senc", Qt::CaseInsensitive)) {
@@ -233,18 +384,44 @@ void SecureViewer::dropEvent(QDropEvent *event) {
   event->acceptProposedAction();
 }
 
-void SecureViewer::handleCacheUpdated() {
-  // Clear and repopulate the file list
-  fileList->clear();
-  QString homePath = QDir::homePath();
-  QStringList encFiles = fileCache.findEncryptedFiles(homePath, true);
-
-  for (const QString &path : encFiles) {
-    addEncFile(path.toStdString());
+void SecureViewer::handleCacheUpdated(const QStringList &added,
+                                      const QStringList &removed,
+                                      const QStringList &modified) {
+  PerfScope scope("handleCacheUpdated");
+  PerfTrace::count("cacheUpdated.paths",
+                   added.size() + removed.size() + modified.size());
+  QString homePath = QDir::homePath() + "/";
+  auto underHome = [&homePath](const QStringList &paths) {
+    QStringList result;
+    for (const QString &path : paths) {
+      if (path.startsWith(homePath)) {
+        result << path;
+      }
+    }
+    return result;
+  };
+
+  fileModel->removePaths(removed);
+  // Decoded previews are keyed by path alone; the rewritten archive's is
+  // looked up again by its new stamp
+  for (const QString &path : removed + modified) {
+    thumbnailPixmaps.remove(path);
   }
+  fileModel->thumbnailsChanged(modified);
+  // A modified archive keeps its row; re-adding only covers one the list
+  // never had. Either way its metadata may have changed.
+  addEncFiles(underHome(added) + underHome(modified));
   updateSearchStatus("Updated");
 }
 
+void SecureViewer::handleEntriesValidated(const QStringList &paths) {
+  fileModel->setStale(paths, false);
+}
+
+void SecureViewer::handleEntriesRemoved(const QStringList &paths) {
+  fileModel->removePaths(paths);
+}
+
 void SecureViewer::handleUnencryptedFile() {
   QString filePath =
       QFileDialog::getOpenFileName(this, "Select File", "", "All Files (*)");
@@ -275,8 +452,75 @@ void SecureViewer::setupFileSidebar() {
   auto *sidebarWidget = new QWidget(this);
   auto *sidebarLayout = new QVBoxLayout(sidebarWidget);
 
-  fileList = new QListWidget(this);
+  // Uniform row heights let the view lay out 50k rows without measuring
+  // each one; only visible rows are ever drawn
+  fileModel = new EncryptedFileModel(this);
+  sortedFiles = new QSortFilterProxyModel(this);
+  sortedFiles->setSourceModel(fileModel);
+  fileList = new QListView(this);
+  fileList->setModel(sortedFiles);
+  fileList->setUniformItemSizes(true);
+  fileList->setEditTriggers(QAbstractItemView::NoEditTriggers);
+  fileList->setSelectionMode(QAbstractItemView::ExtendedSelection);
+  fileList->setContextMenuPolicy(Qt::CustomContextMenu);
+  connect(fileList, &QListView::customContextMenuRequested, this,
+          [this](const QPoint &position) {
+            QStringList paths;
+            for (const QModelIndex &index :
+                 fileList->selectionModel()->selectedIndexes()) {
+              paths << index.data(EncryptedFileModel::PathRole).toString();
+            }
+            if (paths.isEmpty()) {
+              return;
+            }
+            QMenu menu(this);
+            QAction *decrypt = menu.addAction(
+                paths.size() == 1 ? "Decrypt to File"
+                                  : QString("Decrypt %1 Files")
+                                        .arg(paths.size()));
+            if (menu.exec(fileList->viewport()->mapToGlobal(position)) ==
+                decrypt) {
+              startBatch(BatchJobQueue::Operation::Decrypt, paths);
+            }
+          });
   fileList->setMinimumWidth(50); // Keep minimum width
+  fileModel->setThumbnailFunction(
+      [this](const QString &path) { return thumbnailFor(path); });
+
+  // Ordering uses indexed metadata only, never a decrypt
+  sortCombo = new QComboBox(this);
+  sortCombo->addItem("Sort: Found", -1);
+  sortCombo->addItem("Sort: Name", int(EncryptedFileModel::NameSortRole));
+  sortCombo->addItem("Sort: Size", int(EncryptedFileModel::SizeRole));
+  sortCombo->addItem("Group: Type", int(EncryptedFileModel::GroupSortRole));
+  int sortMode = QSettings("SecureViewer", "SecureViewer")
+                     .value("sidebar/sortMode", 0)
+                     .toInt();
+  sortCombo->setCurrentIndex(qBound(0, sortMode, sortCombo->count() - 1));
+  applySortMode(sortCombo->currentIndex());
+  connect(sortCombo, &QComboBox::currentIndexChanged, this, [this](int index) {
+    applySortMode(index);
+    QSettings("SecureViewer", "SecureViewer")
+        .setValue("sidebar/sortMode", index);
+  });
+
+  gridButton = new QToolButton(this);
+  gridButton->setText("Grid");
+  gridButton->setToolTip("Show previews in a grid");
+  gridButton->setCheckable(true);
+  gridButton->setChecked(QSettings("SecureViewer", "SecureViewer")
+                             .value("sidebar/grid", false)
+                             .toBool());
+  setGridMode(gridButton->isChecked());
+  connect(gridButton, &QToolButton::toggled, this, [this](bool grid) {
+    setGridMode(grid);
+    QSettings("SecureViewer", "SecureViewer").setValue("sidebar/grid", grid);
+  });
+
+  auto *sidebarControls = new QHBoxLayout();
+  sidebarControls->addWidget(sortCombo, 1);
+  sidebarControls->addWidget(gridButton);
+  sidebarLayout->addLayout(sidebarControls);
   sidebarLayout->addWidget(fileList);
 
   // Move existing central widget into splitter
@@ -288,16 +532,10 @@ void SecureViewer::setupFileSidebar() {
   sizes << 100 << width() - 100; // Initial split with sidebar at 200px
   splitter->setSizes(sizes);
 
-  // Setup file watcher and search timer
-  fsWatcher = new QFileSystemWatcher(this);
-  searchTimer = new QTimer(this);
-  searchTimer->setInterval(100); // Search chunk every 100ms
-
-  connect(searchTimer, &QTimer::timeout, this,
-          &SecureViewer::searchNextDirectory);
-  connect(fileList, &QListWidget::itemDoubleClicked, this,
-          [this](QListWidgetItem *item) {
-            QString path = item->data(Qt::UserRole).toString();
+  connect(fileList, &QListView::doubleClicked, this,
+          [this](const QModelIndex &index) {
+            QString path =
+                index.data(EncryptedFileModel::PathRole).toString();
             if (!path.isEmpty()) {
               if (passwordInput->text().isEmpty()) {
                 requestPassword();
@@ -308,118 +546,325 @@ void SecureViewer::setupFileSidebar() {
             }
           });
 
-  // Start initial search
-  startFileSearch();
+  // The last persisted index goes on screen as is, greyed out until it is
+  // re-checked. Watching, validation and any crawl wait until the window is
+  // up, so a slow (or network) home directory doesn't hold up the launch.
+  QStringList snapshot;
+  {
+    PerfScope scope("restoreSidebar");
+    snapshot = fileCache.cachedPaths(QDir::homePath());
+    addEncFiles(snapshot);
+  }
+  updateSearchStatus(snapshot.isEmpty()
+                         ? QString("Waiting...")
+                         : QString("Restored (%1 found)").arg(snapshot.size()));
+  QTimer::singleShot(STARTUP_SEARCH_DELAY_MS, this,
+                     &SecureViewer::startFileSearch);
 }
 
 void SecureViewer::startFileSearch() {
   updateSearchStatus("Starting...");
-  fileList->clear();
+  // Rows already listed, restored ones included, are kept; the model drops
+  // the duplicates the search hands back
 
-  // Start search in background thread
+  // Search in a background thread; hits are appended batch by batch as the
+  // crawler finds them instead of after the whole crawl
   searchFuture = QtConcurrent::run([this]() {
     QString homePath = QDir::homePath();
-    QStringList encFiles = fileCache.findEncryptedFiles(homePath);
+    QStringList encFiles = fileCache.findEncryptedFiles(
+        homePath, true,
+        [this](const QStringList &paths, quint64 directories, quint64 found) {
+          QMetaObject::invokeMethod(
+              this,
+              [this, paths, directories, found]() {
+                addEncFiles(paths);
+                updateSearchStatus(QString("Scanning... (%1 found, %2 folders)")
+                                       .arg(found)
+                                       .arg(directories));
+              },
+              Qt::QueuedConnection);
+        });
 
-    // Update UI in main thread
     QMetaObject::invokeMethod(
         this,
-        [this, encFiles]() {
-          for (const QString &path : encFiles) {
-            addEncFile(path.toStdString());
-          }
-          updateSearchStatus("Complete");
+        [this, count = encFiles.size()]() {
+          updateSearchStatus(QString("Complete (%1 found)").arg(count));
         },
         Qt::QueuedConnection);
   });
 }
 
-void SecureViewer::searchNextDirectory() {
-  if (currentSearchIndex >= searchPaths.size()) {
-    searchTimer->stop();
-    updateSearchStatus("Complete");
-    return;
+void SecureViewer::addEncFiles(const QStringList &paths) {
+  // The model drops paths it already lists; each call is one row insert
+  QStringList fresh, stale;
+  for (const QString &path : paths) {
+    (fileCache.isStale(path) ? stale : fresh) << path;
   }
+  fileModel->addPaths(fresh);
+  fileModel->addPaths(stale, true);
+  showMetadata(paths);
+}
 
-  updateSearchStatus(QString("Scanning... (%1/%2)")
-                         .arg(currentSearchIndex)
-                         .arg(searchPaths.size()));
+void SecureViewer::showMetadata(const QStringList &paths) {
+  // A path with nothing indexed is reset too: a changed archive loses its
+  // metadata, and its row falls back to the archive name until re-indexed
+  QHash<QString, EncryptedFileModel::Metadata> known;
+  for (const QString &path : paths) {
+    FileCache::ArchiveMetadata metadata;
+    if (fileCache.metadata(path, metadata)) {
+      known.insert(path, {metadata.originalName, metadata.mimeType,
+                          metadata.originalSize});
+    } else {
+      known.insert(path, {});
+    }
+  }
+  fileModel->setMetadata(known);
+}
+
+void SecureViewer::setGridMode(bool grid) {
+  if (grid) {
+    int cell = ThumbnailCache::THUMBNAIL_SIZE;
+    fileList->setViewMode(QListView::IconMode);
+    fileList->setIconSize(QSize(96, 96));
+    fileList->setGridSize(QSize(cell - 8, cell + 2));
+    fileList->setResizeMode(QListView::Adjust);
+    fileList->setMovement(QListView::Static);
+    fileList->setWordWrap(true);
+  } else {
+    fileList->setViewMode(QListView::ListMode);
+    fileList->setIconSize(QSize(24, 24));
+    fileList->setGridSize(QSize());
+    fileList->setWordWrap(false);
+  }
+}
 
-  try {
-    const fs::path &currentPath = searchPaths[currentSearchIndex++];
+void SecureViewer::applySortMode(int index) {
+  int role = sortCombo->itemData(index).toInt();
+  if (role < 0) {
+    sortedFiles->sort(-1); // back to the order the search found them in
+    return;
+  }
+  sortedFiles->setSortRole(role);
+  sortedFiles->sort(0, role == EncryptedFileModel::SizeRole
+                           ? Qt::DescendingOrder
+                           : Qt::AscendingOrder);
+}
 
-    // Skip if not accessible
-    if (!fs::exists(currentPath) || !fs::is_directory(currentPath)) {
-      return;
-    }
+FileCache::ArchiveMetadata
+SecureViewer::metadataFrom(const std::string &originalName,
+                           const std::string &mimeType, qint64 originalSize) {
+  FileCache::ArchiveMetadata metadata;
+  metadata.originalName =
+      QString::fromStdString(fs::path(originalName).filename().string());
+  metadata.mimeType = QString::fromStdString(mimeType);
+  if (metadata.mimeType.isEmpty()) {
+    // v1 archives don't record a type
+    metadata.mimeType =
+        QMimeDatabase()
+            .mimeTypeForFile(metadata.originalName,
+                             QMimeDatabase::MatchExtension)
+            .name();
+  }
+  metadata.originalSize = originalSize;
+  return metadata;
+}
 
-    // Iterate directory entries
-    for (const auto &entry : fs::directory_iterator(currentPath)) {
-      if (fs::is_directory(entry)) {
-        // Skip certain system directories
-        if (entry.path().filename().string()[0] == '.') {
-          continue;
+void SecureViewer::recordMetadata(const fs::path &encryptedFile,
+                                  const std::string &originalName,
+                                  const std::string &mimeType,
+                                  qint64 originalSize) {
+  QString path = QString::fromStdString(encryptedFile.string());
+  if (!fileCache.hasMetadata(path)) {
+    fileCache.setMetadata(path,
+                          metadataFrom(originalName, mimeType, originalSize));
+  }
+}
+
+void SecureViewer::indexArchives(const QString &password) {
+  // Names, types and previews for archives that were never opened. v2
+  // metadata opens with the key alone and v1 names sit in the first chunk;
+  // previews need the content.
+  QStringList pending;
+  for (int row = 0; row < fileModel->rowCount(); row++) {
+    pending << fileModel->pathAt(row);
+  }
+  quint64 generation = ++indexGeneration;
+
+  indexPool.start(
+      [this, pending, generation, secret = password.toStdString()]() mutable {
+        if (thumbnails.unlock(secret)) {
+          if (indexGeneration != generation) {
+            // Cleared while the key was being derived; the lock() that
+            // came with it ran too early to wipe this one
+            thumbnails.lock();
+            OPENSSL_cleanse(&secret[0], secret.size());
+            return;
+          }
+          QMetaObject::invokeMethod(this, [this]() {
+            thumbnailPixmaps.clear();
+            fileModel->thumbnailsChanged();
+          });
         }
-        searchPaths.push_back(entry.path());
-      } else if (entry.path().extension() == ".senc") {
-        addEncFile(entry.path());
-      }
+        for (const QString &path : pending) {
+          if (indexGeneration != generation) {
+            break;
+          }
+          indexArchive(path, secret);
+        }
+        OPENSSL_cleanse(&secret[0], secret.size());
+      });
+}
+
+void SecureViewer::indexArchive(const QString &path,
+                                const std::string &password) {
+  qint64 lastModified = 0;
+  qint64 size = 0;
+  if (!fileCache.stamp(path, lastModified, size)) {
+    return;
+  }
+  bool needMetadata = !fileCache.hasMetadata(path);
+  bool needThumbnail = thumbnails.isUnlocked() &&
+                       !thumbnails.contains(path, lastModified, size);
+  if (!needMetadata && !needThumbnail) {
+    return;
+  }
+
+  auto archive = std::make_unique<SencArchive>();
+  SencKey key;
+  SencLayout layout;
+  std::string error;
+  if (!archive->open(path.toStdString(), error) ||
+      archive->format() == SencArchive::Format::Unknown ||
+      !keyCache.deriveKey(*archive, password, key, error) ||
+      !archive->readLayout(key, layout, error)) {
+    return; // unreadable, or a different password
+  }
+  FileCache::ArchiveMetadata metadata =
+      metadataFrom(layout.originalName, layout.mimeType,
+                   static_cast<qint64>(layout.contentSize));
+  if (needMetadata) {
+    fileCache.setMetadata(path, metadata);
+  }
+  if (!needThumbnail) {
+    return;
+  }
+
+  // Videos are left to storeThumbnail(): Qt Multimedia wants the GUI
+  // thread, and the player on screen has a frame soon enough
+  QImage preview;
+  if ((metadata.mimeType.startsWith("image/") ||
+       metadata.mimeType == "application/pdf") &&
+      layout.contentSize <= MAX_PREVIEW_SOURCE_SIZE) {
+    SencPlaintext plaintext;
+    if (!archive->decrypt(key, plaintext, error)) {
+      return;
     }
-  } catch (const fs::filesystem_error &) {
-    // Skip inaccessible directories
+    preview = ThumbnailCache::fromContent(
+        QByteArray::fromRawData(
+            reinterpret_cast<const char *>(plaintext.content()),
+            static_cast<qsizetype>(plaintext.contentSize())),
+        metadata.mimeType);
+  }
+  if (thumbnails.insert(path, lastModified, size, preview)) {
+    QMetaObject::invokeMethod(this, [this, path]() {
+      thumbnailPixmaps.remove(path);
+      fileModel->thumbnailsChanged({path});
+    });
   }
 }
 
-void SecureViewer::addEncFile(const fs::path &path) {
-  QString qpath = QString::fromStdString(path.string());
+bool SecureViewer::needsThumbnail(const fs::path &encryptedFile) {
+  QString path = QString::fromStdString(encryptedFile.string());
+  qint64 lastModified = 0;
+  qint64 size = 0;
+  return thumbnails.isUnlocked() &&
+         fileCache.stamp(path, lastModified, size) &&
+         !thumbnails.contains(path, lastModified, size);
+}
 
-  // Check if already in list
-  for (int i = 0; i < fileList->count(); i++) {
-    if (fileList->item(i)->data(Qt::UserRole).toString() == qpath) {
-      return;
+void SecureViewer::storeThumbnail(const fs::path &encryptedFile,
+                                  const QImage &rendered) {
+  // What is on screen is already decrypted; a preview of it is nearly free
+  QString path = QString::fromStdString(encryptedFile.string());
+  qint64 lastModified = 0;
+  qint64 size = 0;
+  if (!thumbnails.isUnlocked() ||
+      !fileCache.stamp(path, lastModified, size) ||
+      thumbnails.contains(path, lastModified, size)) {
+    return;
+  }
+
+  // PDF previews come rendered, from the view's own worker
+  QImage preview = rendered;
+  if (preview.isNull()) {
+    if (contentStack->currentWidget() == imageViewer && imagePyramid) {
+      preview = imagePyramid->render(QSize(ThumbnailCache::THUMBNAIL_SIZE,
+                                           ThumbnailCache::THUMBNAIL_SIZE));
+    } else if (contentStack->currentWidget() == videoWidget) {
+      preview = videoWidget->videoSink()->videoFrame().toImage();
     }
   }
+  if (thumbnails.insert(path, lastModified, size, preview)) {
+    thumbnailPixmaps.remove(path);
+    fileModel->thumbnailsChanged({path});
+  }
+}
 
-  // Add to list
-  auto *item =
-      new QListWidgetItem(QString::fromStdString(path.filename().string()));
-  item->setData(Qt::UserRole, qpath);
-  fileList->addItem(item);
+QPixmap SecureViewer::thumbnailFor(const QString &path) {
+  // Asked for visible rows only; misses are remembered too, so scrolling
+  // back over a row costs nothing
+  if (QPixmap *cached = thumbnailPixmaps.object(path)) {
+    return *cached;
+  }
+  QPixmap preview;
+  qint64 lastModified = 0;
+  qint64 size = 0;
+  QImage image;
+  if (fileCache.stamp(path, lastModified, size) &&
+      thumbnails.find(path, lastModified, size, image)) {
+    preview = QPixmap::fromImage(image);
+  }
+  thumbnailPixmaps.insert(path, new QPixmap(preview));
+  return preview;
 }
 
 void SecureViewer::resizeEvent(QResizeEvent *event) {
   QMainWindow::resizeEvent(event);
-  if (contentStack->currentWidget() == imageViewer && !originalImage.isNull()) {
-    updateImageScale();
+  if (contentStack->currentWidget() == imageViewer && imagePyramid) {
+    // Nearest-neighbour while the window is being dragged, one smooth pass
+    // once it settles
+    updateImageScale(Qt::FastTransformation);
+    smoothScaleTimer->start();
   }
   dropOverlay->setGeometry(rect());
-  if (contentStack->currentWidget() == pdfScrollArea) {
-    QSize viewSize = size();
-    pdfViewer->setMinimumWidth(viewSize.width() * 0.9);
-    pdfViewer->setMinimumHeight(viewSize.height() * 0.9);
-    pdfViewer->setZoomMode(QPdfView::ZoomMode::FitToWidth);
-  }
 }
 
-void SecureViewer::updateImageScale() {
-  if (originalImage.isNull())
+void SecureViewer::updateImageScale(Qt::TransformationMode mode) {
+  if (!imagePyramid)
     return;
+  PerfScope scope(mode == Qt::FastTransformation ? "updateImageScale.fast"
+                                                 : "updateImageScale.smooth");
 
-  QSize viewSize = imageViewer->size();
-  QSize imageSize = originalImage.size();
-
-  double widthRatio = static_cast<double>(viewSize.width()) / imageSize.width();
-  double heightRatio =
-      static_cast<double>(viewSize.height()) / imageSize.height();
-
-  double ratio = std::min(widthRatio, heightRatio);
-
-  int newWidth = static_cast<int>(imageSize.width() * ratio);
-  int newHeight = static_cast<int>(imageSize.height() * ratio);
+  // Drawn from the nearest pyramid level, never the full-size image
+  imageViewer->setPixmap(
+      imagePyramid->renderPixmap(imageViewer->size(), mode));
+}
 
-  QPixmap scaled = originalImage.scaled(
-      newWidth, newHeight, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-  imageViewer->setPixmap(scaled);
+void SecureViewer::buildImagePyramid(const QImage &image) {
+  quint64 generation = ++pyramidGeneration;
+  QtConcurrent::run([image]() {
+    return std::make_shared<const ImagePyramid>(image);
+  }).then(this, [this, generation](
+                    std::shared_ptr<const ImagePyramid> pyramid) {
+    if (generation != pyramidGeneration) {
+      return; // the image was cleared or replaced meanwhile
+    }
+    imagePyramid = std::move(pyramid);
+    updateImageScale();
+    if (!displayedArchive.empty()) {
+      storeThumbnail(displayedArchive);
+    }
+  });
 }
 
 void SecureViewer::handlePlaybackStateChanged(
@@ -431,101 +876,140 @@ void SecureViewer::handlePlaybackStateChanged(
 }
 
 bool SecureViewer::displayContent(const fs::path &filePath) {
-  QString filename = QString::fromStdString(filePath.filename().string());
+  displayedArchive.clear();
+  auto *file = new QFile(QString::fromStdString(filePath.string()), this);
+  if (!file->open(QIODevice::ReadOnly)) {
+    delete file;
+    QMessageBox::warning(this, "Error", "Failed to open file");
+    return false;
+  }
+  return displayContent(QString::fromStdString(filePath.filename().string()),
+                        file);
+}
+
+bool SecureViewer::displayContent(const QString &filename, QIODevice *device) {
+  PerfScope scope("displayContent");
+  // The viewers read straight from the device, so it stays alive until the
+  // content is cleared
+  releaseContentDevice();
+  contentDevice = device;
+
   updateFileStatus(filename);
-  QString extension =
-      QString::fromStdString(filePath.extension().string()).toLower();
+  QString extension = "." + QFileInfo(filename).suffix().toLower();
 
   // At the start of the method, ensure textViewer is always read-only
   textViewer->setReadOnly(true);
 
   if (extension == ".png" || extension == ".jpg" || extension == ".jpeg" ||
       extension == ".gif" || extension == ".bmp" || extension == ".webp") {
-    originalImage.load(QString::fromStdString(filePath.string()));
-    if (originalImage.isNull()) {
+    QImageReader reader(device);
+    QImage image = reader.read();
+    if (image.isNull()) {
       QMessageBox::warning(this, "Error", "Failed to load image");
       return false;
     }
-    updateImageScale();
+    // A nearest-neighbour preview costs a few milliseconds even for huge
+    // images; the pyramid replaces it when it is ready
+    imageViewer->setPixmap(QPixmap::fromImage(image.scaled(
+        imageViewer->size(), Qt::KeepAspectRatio, Qt::FastTransformation)));
     contentStack->setCurrentWidget(imageViewer);
-
-    if (contentStack->currentWidget() == imageViewer &&
-        !originalImage.isNull()) {
-      updateImageScale();
-    }
-
+    buildImagePyramid(image);
     return true;
   }
 
-  else if (extension == ".mp4" || extension == ".avi" || extension == ".mkv" ||
-           extension == ".mov" || extension == ".webm") {
-    videoPlayer->setSource(
-        QUrl::fromLocalFile(QString::fromStdString(filePath.string())));
+  else if (isVideoFile(filename)) {
+    // The URL is only a hint so the backend can pick a demuxer
+    ensureVideoPlayer();
+    videoPlayer->setSourceDevice(device, QUrl::fromLocalFile(filename));
     audioOutput->setVolume(1.0);
     videoPlayer->play();
     contentStack->setCurrentWidget(videoWidget);
+    videoThumbnailPending = true;
     return true;
   } else if (extension == ".pdf") {
-    QFile file(QString::fromStdString(filePath.string()));
-    if (!file.open(QIODevice::ReadOnly)) {
-      QMessageBox::warning(this, "Error", "Failed to open PDF file");
-      return false;
-    }
-
-    // Load the PDF document in try-catch block
-    try {
-      pdfDocument->load(&file);
-    } catch (const std::exception &e) {
-      QMessageBox::warning(this, "Error",
-                           QString("Failed to load PDF document: %1")
-                               .arg(QString::fromStdString(e.what())));
-      file.close();
-      return false;
+    // Parsed in place on a worker; loadFailed() reports a bad file
+    const char *bytes = contentBytes(device);
+    ensurePdfViewer();
+    pdfViewer->load(bytes ? QByteArray::fromRawData(bytes, device->size())
+                          : device->readAll());
+    contentStack->setCurrentWidget(pdfViewer);
+    return true;
+  } else {
+    const char *bytes = contentBytes(device);
+    qint64 size = device->size();
+    bool binary = bytes && LargeTextView::looksBinary(bytes, size);
+    if (bytes && (binary || size > MAX_TEXT_EDIT_SIZE)) {
+      largeTextViewer->setData(bytes, size,
+                               binary ? LargeTextView::Mode::Hex
+                                      : LargeTextView::Mode::Text);
+      contentStack->setCurrentWidget(largeTextViewer);
+    } else if (bytes) {
+      textViewer->setText(QString::fromUtf8(bytes, size));
+      contentStack->setCurrentWidget(textViewer);
+    } else {
+      textViewer->setText(QString::fromUtf8(device->readAll()));
+      contentStack->setCurrentWidget(textViewer);
     }
+    return true;
+  }
+  return false;
+}
 
-    file.close();
-
-    // Configure the view for multiple pages
-    pdfViewer->setPageMode(
-        QPdfView::PageMode::SinglePage); // Changed from SinglePage to MultiPage
-    pdfViewer->setZoomMode(QPdfView::ZoomMode::FitToWidth);
+const char *SecureViewer::contentBytes(QIODevice *device) {
+  // Decrypted content is already in memory and plain files can be mapped;
+  // neither needs copying through readAll
+  if (auto *buffer = qobject_cast<SecureBufferDevice *>(device)) {
+    return buffer->constData();
+  }
+  if (auto *file = qobject_cast<QFile *>(device)) {
+    return reinterpret_cast<const char *>(file->map(0, file->size()));
+  }
+  return nullptr;
+}
 
-    // Set page spacing
-    pdfViewer->setPageSpacing(20); // Add some spacing between pages
+bool SecureViewer::isVideoFile(const QString &filename) {
+  QString extension = "." + QFileInfo(filename).suffix().toLower();
+  return extension == ".mp4" || extension == ".avi" || extension == ".mkv" ||
+         extension == ".mov" || extension == ".webm";
+}
 
-    // Calculate and set a reasonable size for the viewer
-    QSize viewSize = size();
-    pdfViewer->setMinimumWidth(viewSize.width() * 0.9);
-    pdfViewer->setMinimumHeight(viewSize.height() * 0.9);
+void SecureViewer::releaseContentDevice() {
+  // Detach every viewer before the device (and its plaintext) goes away
+  largeTextViewer->clear();
+  videoThumbnailPending = false;
+  if (videoPlayer) {
+    videoPlayer->stop();
+    videoPlayer->setSourceDevice(nullptr);
+  }
+  if (pdfViewer) {
+    pdfViewer->clear();
+  }
+  imagePyramid.reset();
+  ++pyramidGeneration;
 
-    contentStack->setCurrentWidget(pdfScrollArea);
-    return true;
-  } else {
-    try {
-      std::ifstream file(filePath, std::ios::binary);
-      if (file) {
-        std::string content((std::istreambuf_iterator<char>(file)),
-                            std::istreambuf_iterator<char>());
-        textViewer->setText(QString::fromStdString(content));
-        contentStack->setCurrentWidget(textViewer);
-        return true;
-      }
-    } catch (const std::exception &e) {
-      QMessageBox::critical(this, "Error",
-                            QString("Failed to read file: %1").arg(e.what()));
-      return false;
-    }
+  if (contentDevice) {
+    contentDevice->close();
+    delete contentDevice;
+    contentDevice = nullptr;
   }
-  return false;
 }
 
 SecureViewer::~SecureViewer() {
-  cleanupTempFiles();
-  if (fs::exists(tempDir)) {
-    fs::remove_all(tempDir);
+  // The search posts its batches to this window; it has to be out of
+  // findEncryptedFiles before anything here goes away
+  fileCache.cancelSearches();
+  searchFuture.waitForFinished();
+  ++indexGeneration;
+  indexPool.waitForDone();
+  prefetcher.clear();
+  scriptRunner.killAll();
+  for (const ScriptDecrypt &decrypt : scriptDecrypts) {
+    wiper.wipe({decrypt.directory});
   }
-  if (pdfDocument) {
-    pdfDocument->close();
+  cleanupTempFiles();
+  wiper.wipe({tempDir});
+  if (pdfViewer) {
+    pdfViewer->clear();
   }
 }
 
@@ -547,45 +1031,191 @@ fs::path SecureViewer::createSecureTempDir() {
 
 bool SecureViewer::decryptFile(const fs::path &encryptedFile,
                                const QString &password) {
-  clearContent();
+  PerfScope scope("decryptFile");
+  // Keep cached keys and prefetched files: the next open is what they are for
+  clearDisplay();
   if (!fs::exists(encryptedFile)) {
     QMessageBox::critical(this, "Error", "File not found!");
     return false;
   }
 
+  // Only trust the last component of the stored name
+  auto displayName = [&encryptedFile](const std::string &storedName) {
+    QString name =
+        QString::fromStdString(fs::path(storedName).filename().string());
+    if (name.isEmpty()) {
+      name = QString::fromStdString(encryptedFile.stem().string());
+    }
+    return name;
+  };
+
+  // Plaintext stays in locked memory; nothing is written to disk. Media is
+  // decrypted lazily as the player reads and seeks, everything else up front
+  // (or already was, by the prefetcher).
+  QString originalName;
+  QIODevice *device = nullptr;
+  SencPlaintext plaintext;
+  if (prefetcher.take(QString::fromStdString(encryptedFile.string()),
+                      password, plaintext)) {
+    PerfTrace::count("decryptFile.prefetchHits");
+    originalName = displayName(plaintext.originalName);
+    recordMetadata(encryptedFile, plaintext.originalName, std::string(),
+                   static_cast<qint64>(plaintext.contentSize()));
+    device = new SecureBufferDevice(std::move(plaintext), this);
+  } else {
+    auto archive = std::make_unique<SencArchive>();
+    std::string error;
+    if (!archive->open(encryptedFile, error)) {
+      QMessageBox::critical(this, "Error",
+                            QString("Decryption failed:\n%1")
+                                .arg(QString::fromStdString(error)));
+      return false;
+    }
+
+    // Archives we can't parse natively still carry their own decrypt script
+    if (archive->format() == SencArchive::Format::Unknown) {
+      return decryptFileWithScript(encryptedFile, password);
+    }
+    archive->setMaxThreads(
+        static_cast<unsigned>(decryptThreadsSpin->value()));
+
+    SencKey key;
+    SencLayout layout;
+    std::string secret = password.toStdString();
+    bool ok = false;
+    {
+      PerfScope kdfScope("decryptFile.deriveKey");
+      ok = keyCache.deriveKey(*archive, secret, key, error);
+    }
+    ok = ok && archive->readLayout(key, layout, error);
+    if (ok) {
+      // Only keys that actually opened the archive are worth remembering
+      keyCache.insert(*archive, secret, key);
+    }
+    OPENSSL_cleanse(&secret[0], secret.size());
+    if (!ok) {
+      QMessageBox::critical(this, "Error",
+                            QString("Decryption failed:\n%1")
+                                .arg(QString::fromStdString(error)));
+      return false;
+    }
+
+    originalName = displayName(layout.originalName);
+    recordMetadata(encryptedFile, layout.originalName, layout.mimeType,
+                   static_cast<qint64>(layout.contentSize));
+    // The metadata block decides how to open the payload, before any of it
+    // is decrypted
+    QString mimeType = QString::fromStdString(layout.mimeType);
+    if (isVideoFile(originalName) || mimeType.startsWith("video/") ||
+        mimeType.startsWith("audio/")) {
+      device = new SencStreamDevice(std::move(archive), key, layout, this);
+    } else {
+      PerfScope decryptScope("decryptFile.decrypt");
+      if (!archive->decrypt(key, plaintext, error)) {
+        QMessageBox::critical(this, "Error",
+                              QString("Decryption failed:\n%1")
+                                  .arg(QString::fromStdString(error)));
+        return false;
+      }
+      device = new SecureBufferDevice(std::move(plaintext), this);
+    }
+  }
+  device->open(QIODevice::ReadOnly);
+  displayedArchive = encryptedFile;
+  if (!displayContent(originalName, device)) {
+    return false;
+  }
+
+  saveButton->setEnabled(false);
+  // Reset the timer
+  autoDeleteTimer->stop();
+  // Start the timer
+  autoDeleteTimer->start();
+  prefetchAfter(encryptedFile, password);
+  storeThumbnail(encryptedFile);
+  if (!archivesIndexed) {
+    // Once per password: it has just been shown to work
+    archivesIndexed = true;
+    indexArchives(password);
+  }
+  return true;
+}
+
+void SecureViewer::prefetchAfter(const fs::path &encryptedFile,
+                                 const QString &password) {
+  // Neighbours in the order the sidebar shows them
+  int sourceRow =
+      fileModel->rowOf(QString::fromStdString(encryptedFile.string()));
+  int row = sortedFiles->mapFromSource(fileModel->index(sourceRow)).row();
+
+  QStringList next;
+  for (int i = row + 1; row >= 0 && i < sortedFiles->rowCount() &&
+                        next.size() < prefetcher.depth();
+       i++) {
+    next.append(sortedFiles->index(i, 0)
+                    .data(EncryptedFileModel::PathRole)
+                    .toString());
+  }
+  prefetcher.prefetch(next, password);
+}
+
+bool SecureViewer::decryptFileWithScript(const fs::path &encryptedFile,
+                                         const QString &password) {
   fs::path tempDecryptDir = createSecureTempDir();
   fs::permissions(tempDecryptDir, fs::perms::owner_read |
                                       fs::perms::owner_write |
                                       fs::perms::owner_exec);
-  tempFiles.push_back(tempDecryptDir);
 
   fs::path tempEncFile = tempDecryptDir / encryptedFile.filename();
-  fs::copy_file(encryptedFile, tempEncFile);
+  std::string copyError;
+  if (!SencArchive::cloneFile(encryptedFile, tempEncFile, copyError)) {
+    wiper.wipe({tempDecryptDir});
+    QMessageBox::critical(this, "Error", QString::fromStdString(copyError));
+    return false;
+  }
   fs::permissions(tempEncFile, fs::perms::owner_read | fs::perms::owner_write |
                                    fs::perms::owner_exec);
 
-  std::string cmd = "cd \"" + tempDecryptDir.string() +
-                    "\" && "
-                    "echo \"" +
-                    escapeShellArg(password.toStdString()) +
-                    "\" | "
-                    "./\"" +
-                    tempEncFile.filename().string() + "\" 2>&1";
-
-  std::string output;
-  bool success = execCommand(cmd, output);
-
-  if (!success) {
-    QMessageBox::critical(
-        this, "Error",
-        QString("Decryption failed:\n%1").arg(QString::fromStdString(output)));
-    return false;
+  // The script prompts for the password on stdin and extracts next to itself
+  ProcessRunner::Job job;
+  job.program = QString::fromStdString(tempEncFile.string());
+  job.workingDirectory = QString::fromStdString(tempDecryptDir.string());
+  job.input = password.toUtf8() + '\n';
+  currentScriptJob = scriptRunner.start(std::move(job));
+  scriptDecrypts.insert(currentScriptJob, {tempDecryptDir, tempEncFile});
+  updateFileStatus("Decrypting with embedded script...");
+  return true;
+}
+
+void SecureViewer::handleScriptProgress(int id, qint64 elapsedMs) {
+  if (id == currentScriptJob) {
+    updateFileStatus(QString("Decrypting with embedded script... %1s")
+                         .arg(elapsedMs / 1000));
+  }
+}
+
+void SecureViewer::handleScriptFinished(int id, bool ok, const QString &output,
+                                        bool cancelled) {
+  ScriptDecrypt decrypt = scriptDecrypts.take(id);
+  if (id != currentScriptJob || cancelled) {
+    // Superseded by another file or cleared; nothing of it is shown
+    wiper.wipe({decrypt.directory});
+    return;
+  }
+  currentScriptJob = -1;
+  tempFiles.push_back(decrypt.directory);
+  updateFileStatus("None");
+
+  if (!ok) {
+    QMessageBox::critical(this, "Error",
+                          QString("Decryption failed:\n%1").arg(output));
+    return;
   }
 
   bool foundDecrypted = false;
-  for (const auto &entry : fs::directory_iterator(tempDecryptDir)) {
+  for (const auto &entry : fs::directory_iterator(decrypt.directory)) {
     if (entry.is_regular_file() && entry.path().extension() != ".senc" &&
-        entry.path() != tempEncFile) {
+        entry.path() != decrypt.copy) {
       auto writeTime = fs::last_write_time(entry.path());
       auto now = fs::file_time_type::clock::now();
       if (now - writeTime < std::chrono::seconds(10)) {
@@ -605,86 +1235,18 @@ bool SecureViewer::decryptFile(const fs::path &encryptedFile,
 
   if (!foundDecrypted) {
     QMessageBox::critical(this, "Error", "No decrypted file found!");
-    return false;
-  }
-
-  return true;
-}
-
-std::string SecureViewer::escapeShellArg(const std::string &arg) {
-  std::string escaped;
-  escaped.reserve(arg.length() + 4);
-
-  for (char c : arg) {
-    switch (c) {
-    case '\'':
-      escaped += "'\\''";
-      break;
-    case '\\':
-    case '"':
-    case '$':
-    case '`':
-      escaped += '\\';
-      [[fallthrough]];
-    default:
-      escaped += c;
-    }
-  }
-
-  return escaped;
-}
-
-bool SecureViewer::execCommand(const std::string &cmd, std::string &output) {
-  std::array<char, 4096> buffer;
-  output.clear();
-
-  FILE *pipe = popen(cmd.c_str(), "r");
-  if (!pipe) {
-    output = "Failed to execute command";
-    return false;
   }
-
-  while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-    output += buffer.data();
-  }
-
-  int status = pclose(pipe);
-  return status == 0;
 }
 
 void SecureViewer::cleanupTempFiles() {
-  for (const auto &path : tempFiles) {
-    try {
-      if (fs::exists(path)) {
-        if (fs::is_directory(path)) {
-          for (const auto &entry : fs::directory_iterator(path)) {
-            if (fs::is_regular_file(entry)) {
-              std::ofstream file(entry.path(),
-                                 std::ios::binary | std::ios::out);
-              if (file) {
-                auto size = fs::file_size(entry.path());
-                std::vector<char> zeros(4096, 0);
-                while (size > 0) {
-                  size_t toWrite = std::min(size, zeros.size());
-                  file.write(zeros.data(), toWrite);
-                  size -= toWrite;
-                }
-                file.close();
-              }
-            }
-          }
-        }
-        fs::remove_all(path);
-      }
-    } catch (const std::exception &e) {
-      qWarning() << "Error during cleanup:" << e.what();
-    }
-  }
+  releaseContentDevice();
+
+  // Overwriting happens in the background; nothing here waits on the disk
+  wiper.wipe(tempFiles);
   tempFiles.clear();
 
   textViewer->clear();
   imageViewer->clear();
-  videoPlayer->stop();
 }
 
 void SecureViewer::requestPassword() {
@@ -718,20 +1280,40 @@ void SecureViewer::openFile() {
 }
 
 void SecureViewer::clearContent() {
+  // Wipe everything decrypted ahead of time along with what is on screen,
+  // and stop using the password for indexing
+  ++indexGeneration;
+  archivesIndexed = false;
+  thumbnails.lock();
+  thumbnailPixmaps.clear();
+  fileModel->thumbnailsChanged();
+  prefetcher.clear();
+  clearDisplay();
+  keyCache.clear();
+  // The pooled slabs are only worth their locked memory while files are
+  // being opened
+  SecureBuffer::trimPool();
+}
+
+void SecureViewer::clearDisplay() {
   updateFileStatus("None");
   updateTimerStatus();
+  // Its directory is wiped once the script has actually exited
+  if (currentScriptJob >= 0) {
+    scriptRunner.cancel(currentScriptJob);
+    currentScriptJob = -1;
+  }
   cleanupTempFiles();
-  videoPlayer->stop();
-  audioOutput->setVolume(0.0);
+  if (audioOutput) {
+    audioOutput->setVolume(0.0);
+  }
   textViewer->clear();
   imageViewer->clear();
   autoDeleteTimer->stop();
   textViewer->setReadOnly(true);
   currentFilePath.clear();
+  displayedArchive.clear();
   contentStack->setCurrentWidget(textViewer);
-  if (pdfDocument) {
-    pdfDocument->close();
-  }
   if (!currentFilePath.isEmpty()) {
     QString sencPath = QFileInfo(currentFilePath).absolutePath() + "/" +
                        QFileInfo(currentFilePath).baseName() + ".senc";
@@ -745,73 +1327,129 @@ void SecureViewer::saveAndEncrypt() {
   }
 }
 
-void SecureViewer::saveAndEncryptFile(const QString &filePath) {
+bool SecureViewer::askNewPassword(QString &password) {
   bool ok;
-  QString password = QInputDialog::getText(
+  password = QInputDialog::getText(
       this, "Encryption Password",
       "Enter password (minimum 6 characters):", QLineEdit::Password, "", &ok);
   if (!ok || password.length() < 6) {
     QMessageBox::warning(this, "Warning", "Invalid password!");
-    return;
+    return false;
   }
   QString verify =
       QInputDialog::getText(this, "Verify Password",
                             "Verify password:", QLineEdit::Password, "", &ok);
   if (!ok || verify != password) {
     QMessageBox::critical(this, "Error", "Passwords do not match!");
-    return;
+    return false;
   }
+  return true;
+}
 
-  QString tempPwdFile =
-      QStandardPaths::writableLocation(QStandardPaths::TempLocation) +
-      "/temp_pwd_" + QString::number(QCoreApplication::applicationPid());
-  QFile pwdFile(tempPwdFile);
-  if (pwdFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
-    QTextStream out(&pwdFile);
-    out << password << "\n" << password << "\n";
-    pwdFile.close();
-  } else {
-    QMessageBox::critical(this, "Error",
-                          "Failed to create temporary password file!");
-    return;
+void SecureViewer::saveAndEncryptFile(const QString &filePath) {
+  // A batch of one; the original goes away once its archive is written
+  if (startBatch(BatchJobQueue::Operation::Encrypt, {filePath})) {
+    clearContent();
+    saveButton->setEnabled(false);
   }
+}
 
-  // Get the directory of the file
-  fs::path filedir = fs::path(filePath.toStdString()).parent_path();
-
-  // Get the path to the senc binary relative to the application
-  QString appPath = QCoreApplication::applicationDirPath();
-  QString sencPath = appPath + "/bin/senc";
-
-  // Execute senc directly on the file in its location
-  std::string cmd = "cd \"" + filedir.string() + "\" && " + "cat \"" +
-                    fs::path(tempPwdFile.toStdString()).string() + "\" | " +
-                    "\"" + sencPath.toStdString() + "\" \"" +
-                    fs::path(filePath.toStdString()).filename().string() +
-                    "\" 2>&1";
+void SecureViewer::askForBatch(const QStringList &paths) {
+  QMessageBox box(QMessageBox::Question, "Batch",
+                  QString("%1 item(s) dropped. Encrypting replaces every "
+                          "file with an archive; decrypting writes the "
+                          "content of every archive next to it.")
+                      .arg(paths.size()),
+                  QMessageBox::Cancel, this);
+  QPushButton *encrypt = box.addButton("Encrypt", QMessageBox::AcceptRole);
+  QPushButton *decrypt = box.addButton("Decrypt", QMessageBox::AcceptRole);
+  box.exec();
+  if (box.clickedButton() == encrypt) {
+    startBatch(BatchJobQueue::Operation::Encrypt, paths);
+  } else if (box.clickedButton() == decrypt) {
+    startBatch(BatchJobQueue::Operation::Decrypt, paths);
+  }
+}
 
-  std::string output;
-  bool success = execCommand(cmd, output);
+bool SecureViewer::startBatch(BatchJobQueue::Operation operation,
+                              const QStringList &paths) {
+  if (batchQueue.isRunning()) {
+    QMessageBox::information(this, "Batch",
+                             "Wait for the current batch to finish.");
+    return false;
+  }
+  QString password;
+  if (operation == BatchJobQueue::Operation::Encrypt) {
+    if (!askNewPassword(password)) {
+      return false;
+    }
+  } else {
+    if (passwordInput->text().isEmpty()) {
+      requestPassword();
+    }
+    password = passwordInput->text();
+    if (password.isEmpty()) {
+      return false;
+    }
+  }
 
-  if (success) {
-    QMessageBox::information(this, "Success", "File encrypted successfully!");
-    clearContent();
+  batchQueue.start(operation, paths, password);
+  batchProgress->setRange(0, 0);
+  batchProgress->show();
+  batchStatusLabel->show();
+  batchCancelButton->show();
+  return true;
+}
 
-    // Get the new .senc file path
-    QString sencPath = QFileInfo(filePath).absolutePath() + "/" +
-                       QFileInfo(filePath).baseName() + ".senc";
-    fileCache.addToCache(sencPath);
+void SecureViewer::handleBatchProgress(int done, int total, qint64 bytesDone,
+                                       qint64 bytesTotal,
+                                       double bytesPerSecond) {
+  if (total < 0) {
+    batchStatusLabel->setText("Listing files...");
+    return;
+  }
+  batchProgress->setRange(0, qMax(1, total));
+  batchProgress->setValue(done);
+  double megabytes = 1024.0 * 1024.0;
+  batchStatusLabel->setText(QString("%1 / %2 files, %3 / %4 MB, %5 MB/s")
+                                .arg(done)
+                                .arg(total)
+                                .arg(bytesDone / megabytes, 0, 'f', 1)
+                                .arg(bytesTotal / megabytes, 0, 'f', 1)
+                                .arg(bytesPerSecond / megabytes, 0, 'f', 1));
+}
 
-    startFileSearch();
-    saveButton->setEnabled(false);
-  } else {
-    QMessageBox::critical(
-        this, "Error",
-        QString("Encryption failed:\n%1").arg(QString::fromStdString(output)));
+void SecureViewer::handleBatchFinished(BatchJobQueue::Operation operation,
+                                       const QStringList &created,
+                                       const QStringList &failures,
+                                       bool cancelled) {
+  batchProgress->hide();
+  batchStatusLabel->hide();
+  batchCancelButton->hide();
+
+  bool encrypted = operation == BatchJobQueue::Operation::Encrypt;
+  if (encrypted) {
+    // One cache update for the whole batch instead of a rescan per file
+    fileCache.addToCache(created);
   }
+  QString summary = QString("%1 %2 file(s)")
+                        .arg(encrypted ? "Encrypted" : "Decrypted")
+                        .arg(created.size());
+  if (!failures.isEmpty()) {
+    summary += QString(", %1 failed").arg(failures.size());
+  }
+  if (cancelled) {
+    summary += ", cancelled";
+  }
+  mainStatusBar->showMessage(summary, 10000);
 
-  // Clean up temporary password file
-  QFile::remove(tempPwdFile);
+  if (!failures.isEmpty()) {
+    QStringList shown = failures.mid(0, 10);
+    if (failures.size() > shown.size()) {
+      shown << QString("...and %1 more").arg(failures.size() - shown.size());
+    }
+    QMessageBox::warning(this, "Batch", summary + ":\n\n" + shown.join("\n"));
+  }
 }
 
 int main(int argc, char *argv[]) {
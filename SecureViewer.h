@@ -1,25 +1,38 @@
 #ifndef SECUREVIEWER_H
 #define SECUREVIEWER_H
+#include "BatchJobQueue.h"
+#include "DecryptPrefetcher.h"
+#include "EncryptedFileModel.h"
 #include "FileCache.h"
+#include "ImagePyramid.h"
+#include "LargeTextView.h"
+#include "PdfPageView.h"
+#include "PerfPanel.h"
+#include "ProcessRunner.h"
+#include "SecureWiper.h"
+#include "SencKeyCache.h"
+#include "ThumbnailCache.h"
 #include <QApplication>
+#include <QCache>
+#include <QComboBox>
+#include <QDockWidget>
 #include <QDragEnterEvent>
 #include <QDropEvent>
 #include <QFileDialog>
-#include <QFileSystemWatcher>
 #include <QFuture>
+#include <QHash>
 #include <QHBoxLayout>
 #include <QInputDialog>
 #include <QLabel>
 #include <QLineEdit>
-#include <QListWidget>
+#include <QListView>
 #include <QMainWindow>
 #include <QMediaPlayer>
 #include <QMessageBox>
 #include <QMimeData>
-#include <QPdfDocument>
-#include <QPdfView>
+#include <QProgressBar>
 #include <QPushButton>
-#include <QScrollArea>
+#include <QSortFilterProxyModel>
 #include <QSpinBox>
 #include <QSplitter>
 #include <QStackedWidget>
@@ -27,10 +40,14 @@
 #include <QStatusBar>
 #include <QString>
 #include <QTextEdit>
+#include <QThreadPool>
 #include <QTimer>
+#include <QToolButton>
 #include <QVBoxLayout>
 #include <QVideoWidget>
+#include <atomic>
 #include <filesystem>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -55,7 +72,18 @@ private slots:
   void handleUnencryptedFile();
   void saveAndEncrypt();
   void handlePlaybackStateChanged(QMediaPlayer::PlaybackState state);
-  void handleCacheUpdated();
+  void handleCacheUpdated(const QStringList &added, const QStringList &removed,
+                          const QStringList &modified);
+  void handleEntriesValidated(const QStringList &paths);
+  void handleEntriesRemoved(const QStringList &paths);
+  void handleBatchProgress(int done, int total, qint64 bytesDone,
+                           qint64 bytesTotal, double bytesPerSecond);
+  void handleBatchFinished(BatchJobQueue::Operation operation,
+                           const QStringList &created,
+                           const QStringList &failures, bool cancelled);
+  void handleScriptProgress(int id, qint64 elapsedMs);
+  void handleScriptFinished(int id, bool ok, const QString &output,
+                            bool cancelled);
 
 private:
   QWidget *centralWidget;
@@ -64,51 +92,128 @@ private:
   QPushButton *clearButton;
   QPushButton *saveButton;
   QPushButton *uploadButton;
+  QPushButton *batchButton;
   QLineEdit *passwordInput;
   QStackedWidget *contentStack;
   QTextEdit *textViewer;
+  // Binary content, and text too large to lay out in a QTextEdit
+  LargeTextView *largeTextViewer;
+  static constexpr qint64 MAX_TEXT_EDIT_SIZE = 4 * 1024 * 1024;
   QLabel *imageViewer;
-  QMediaPlayer *videoPlayer;
-  QVideoWidget *videoWidget;
+  // Built on first use by ensureVideoPlayer() / ensurePdfViewer()
+  QMediaPlayer *videoPlayer = nullptr;
+  QVideoWidget *videoWidget = nullptr;
+  // Set while the video on screen waits for a frame to preview
+  bool videoThumbnailPending = false;
   QTimer *autoDeleteTimer;
   std::filesystem::path tempDir;
   std::vector<std::filesystem::path> tempFiles;
+  // Its destructor waits out the wipes queued by ours
+  SecureWiper wiper;
   QString currentFilePath;
+  QIODevice *contentDevice = nullptr;
   QLabel *dropOverlay;
-  QPixmap originalImage;
-  QAudioOutput *audioOutput;
-  QPdfDocument *pdfDocument;
-  QPdfView *pdfViewer;
-  QScrollArea *pdfScrollArea;
-  QListWidget *fileList;
-  QFileSystemWatcher *fsWatcher;
-  QTimer *searchTimer;
-  std::vector<fs::path> searchPaths;
-  size_t currentSearchIndex;
+  // The image on screen; built off the GUI thread, replaced or dropped
+  // whenever the generation moves on
+  std::shared_ptr<const ImagePyramid> imagePyramid;
+  quint64 pyramidGeneration = 0;
+  QTimer *smoothScaleTimer;
+  static constexpr int SMOOTH_SCALE_DELAY_MS = 150;
+  // The archive whose content is on screen, if any
+  fs::path displayedArchive;
+  QAudioOutput *audioOutput = nullptr;
+  PdfPageView *pdfViewer = nullptr;
+  QListView *fileList;
+  EncryptedFileModel *fileModel;
+  QSortFilterProxyModel *sortedFiles;
+  QComboBox *sortCombo;
   QStatusBar *mainStatusBar;
   QLabel *timerStatusLabel;
   QLabel *fileStatusLabel;
   QLabel *searchStatusLabel;
+  QSpinBox *decryptThreadsSpin;
+  QDockWidget *perfDock;
+  QToolButton *perfButton;
+  QProgressBar *batchProgress;
+  QLabel *batchStatusLabel;
+  QPushButton *batchCancelButton;
   FileCache fileCache;
+  SencKeyCache keyCache;
+  DecryptPrefetcher prefetcher{keyCache};
+  BatchJobQueue batchQueue{keyCache};
   QFuture<void> searchFuture;
+  // How long after construction the search (watching, re-checking the
+  // restored sidebar, crawling on a first run) starts
+  static constexpr int STARTUP_SEARCH_DELAY_MS = 500;
+  // Archives the engine can't read run their own script; its directory
+  // joins tempFiles once the result is on screen
+  struct ScriptDecrypt {
+    fs::path directory;
+    fs::path copy; // the archive, run from inside `directory`
+  };
+  ProcessRunner scriptRunner;
+  QHash<int, ScriptDecrypt> scriptDecrypts;
+  int currentScriptJob = -1;
+  // Indexes metadata and builds previews of archives not opened yet, with
+  // the password in use; bumping the generation stops a pass
+  QThreadPool indexPool;
+  std::atomic<quint64> indexGeneration{0};
+  bool archivesIndexed = false;
+  ThumbnailCache thumbnails;
+  // Decoded previews, misses included; cleared whenever the key changes
+  QCache<QString, QPixmap> thumbnailPixmaps{512};
+  QToolButton *gridButton;
+  // Larger images and PDFs don't get a background preview
+  static constexpr quint64 MAX_PREVIEW_SOURCE_SIZE = 64 * 1024 * 1024;
 
   std::filesystem::path createSecureTempDir();
-  bool execCommand(const std::string &cmd, std::string &output);
   bool decryptFile(const std::filesystem::path &encryptedFile,
                    const QString &password);
+  void prefetchAfter(const std::filesystem::path &encryptedFile,
+                     const QString &password);
+  bool decryptFileWithScript(const std::filesystem::path &encryptedFile,
+                             const QString &password);
   void cleanupTempFiles();
-  std::string escapeShellArg(const std::string &arg);
+  void clearDisplay();
+  void ensureVideoPlayer();
+  void ensurePdfViewer();
   bool displayContent(const std::filesystem::path &filePath);
+  bool displayContent(const QString &filename, QIODevice *device);
+  void releaseContentDevice();
+  static const char *contentBytes(QIODevice *device);
+  static bool isVideoFile(const QString &filename);
   void showDropOverlay(bool show);
   void setupDropOverlay();
   void saveAndEncryptFile(const QString &filePath);
+  bool askNewPassword(QString &password);
+  void askForBatch(const QStringList &paths);
+  bool startBatch(BatchJobQueue::Operation operation,
+                  const QStringList &paths);
   void resizeEvent(QResizeEvent *event) override;
-  void updateImageScale();
+  void updateImageScale(
+      Qt::TransformationMode mode = Qt::SmoothTransformation);
+  void buildImagePyramid(const QImage &image);
   void requestPassword();
   void setupFileSidebar();
   void startFileSearch();
-  void searchNextDirectory();
-  void addEncFile(const fs::path &path);
+  void addEncFiles(const QStringList &paths);
+  void applySortMode(int index);
+  void showMetadata(const QStringList &paths);
+  static FileCache::ArchiveMetadata
+  metadataFrom(const std::string &originalName, const std::string &mimeType,
+               qint64 originalSize);
+  void recordMetadata(const fs::path &encryptedFile,
+                      const std::string &originalName,
+                      const std::string &mimeType, qint64 originalSize);
+  void indexArchives(const QString &password);
+  void indexArchive(const QString &path, const std::string &password);
+  bool needsThumbnail(const fs::path &encryptedFile);
+  // `rendered`, when given, is the preview; otherwise it is taken from the
+  // image or video on screen
+  void storeThumbnail(const fs::path &encryptedFile,
+                      const QImage &rendered = QImage());
+  QPixmap thumbnailFor(const QString &path);
+  void setGridMode(bool grid);
   void updateTimerStatus();
   void updateFileStatus(const QString &status);
   void updateSearchStatus(const QString &status);
@@ -0,0 +1,113 @@
+#include "SecureWiper.h"
+#include <QThread>
+#include <QtGlobal>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+// Writes stay page aligned, in offset and size, so they go out as whole
+// blocks rather than read-modify-write cycles
+constexpr size_t PAGE_ALIGNMENT = 4096;
+alignas(PAGE_ALIGNMENT) const unsigned char zeros[SecureWiper::BLOCK_SIZE] = {};
+
+bool flush(int fd) {
+#ifdef F_FULLFSYNC
+  // fsync() on macOS stops at the drive's cache
+  if (fcntl(fd, F_FULLFSYNC) == 0) {
+    return true;
+  }
+#endif
+  return fsync(fd) == 0;
+}
+} // namespace
+
+SecureWiper::SecureWiper() {
+  pool.setMaxThreadCount(1);
+  pool.setThreadPriority(QThread::LowPriority);
+}
+
+SecureWiper::~SecureWiper() { pool.waitForDone(); }
+
+void SecureWiper::wipe(const std::vector<fs::path> &paths) {
+  for (const auto &path : paths) {
+    pool.start([path]() { wipePath(path); });
+  }
+}
+
+void SecureWiper::waitForDone() { pool.waitForDone(); }
+
+void SecureWiper::wipePath(const fs::path &path) {
+  std::error_code ec;
+  auto status = fs::symlink_status(path, ec);
+  if (ec) {
+    return; // already gone
+  }
+
+  std::string error;
+  if (fs::is_directory(status)) {
+    std::vector<fs::path> files;
+    for (auto it = fs::recursive_directory_iterator(path, ec);
+         !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+      if (it->is_regular_file(ec) && !it->is_symlink(ec)) {
+        files.push_back(it->path());
+      }
+    }
+    for (const auto &file : files) {
+      if (!wipeFile(file, error)) {
+        qWarning("Error during cleanup: %s", error.c_str());
+      }
+    }
+  } else if (fs::is_regular_file(status) && !wipeFile(path, error)) {
+    qWarning("Error during cleanup: %s", error.c_str());
+  }
+
+  fs::remove_all(path, ec);
+  if (ec) {
+    qWarning("Error during cleanup: %s", ec.message().c_str());
+  }
+}
+
+bool SecureWiper::wipeFile(const fs::path &path, std::string &error) {
+  int fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC | O_NOFOLLOW);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    error = "Failed to open " + path.string() + ": " + std::strerror(errno);
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    return false;
+  }
+
+  // Rounding up to a whole page may grow the file slightly; it is about to
+  // go anyway
+  uint64_t size = (static_cast<uint64_t>(st.st_size) + PAGE_ALIGNMENT - 1) /
+                  PAGE_ALIGNMENT * PAGE_ALIGNMENT;
+  bool ok = true;
+  for (uint64_t offset = 0; ok && offset < size;) {
+    size_t chunk = std::min<uint64_t>(size - offset, BLOCK_SIZE);
+    ssize_t n = pwrite(fd, zeros, chunk, static_cast<off_t>(offset));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    ok = n > 0;
+    offset += ok ? n : 0;
+  }
+  ok = ok && flush(fd);
+  if (!ok) {
+    error = "Failed to overwrite " + path.string() + ": " +
+            std::strerror(errno);
+  }
+  ::close(fd);
+
+  if (::unlink(path.c_str()) != 0 && ok) {
+    error = "Failed to remove " + path.string() + ": " + std::strerror(errno);
+    ok = false;
+  }
+  return ok;
+}
@@ -0,0 +1,43 @@
+#ifndef SECUREWIPER_H
+#define SECUREWIPER_H
+
+#include <QThreadPool>
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Overwrites and deletes decrypted temp files on a background thread, so
+// clearing the viewer doesn't wait on the disk.
+//
+// Files are overwritten in place with zeros in large block-aligned writes and
+// flushed before they are unlinked; directories are walked and then removed.
+// Nothing is truncated first, which would only hand the old blocks back to
+// the filesystem with the plaintext still on them. On copy-on-write or
+// wear-levelled storage no overwrite is a guarantee, which is why the viewer
+// decrypts into locked memory wherever it can.
+//
+// The destructor waits for queued wipes, so nothing is left behind on exit.
+class SecureWiper {
+public:
+  SecureWiper();
+  ~SecureWiper();
+  SecureWiper(const SecureWiper &) = delete;
+  SecureWiper &operator=(const SecureWiper &) = delete;
+
+  // Queues files or whole directories; returns immediately
+  void wipe(const std::vector<std::filesystem::path> &paths);
+  void waitForDone();
+
+  // Overwrites one regular file in place and unlinks it
+  static bool wipeFile(const std::filesystem::path &path, std::string &error);
+
+  static constexpr size_t BLOCK_SIZE = 1024 * 1024;
+
+private:
+  static void wipePath(const std::filesystem::path &path);
+
+  QThreadPool pool;
+};
+
+#endif // SECUREWIPER_H
@@ -0,0 +1,953 @@
+#include "SencArchive.h"
+#include "SencCrypto.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <mutex>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#ifdef __APPLE__
+#include <copyfile.h>
+#include <sys/clonefile.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+// The self-extracting script header is a couple of KB; don't scan the whole
+// payload looking for the marker if the file isn't an archive.
+constexpr size_t MAX_HEADER_SCAN = 64 * 1024;
+// Ciphertext is read and decrypted in blocks of this size (EVP takes int
+// lengths, so it also bounds each update call)
+constexpr size_t READ_BLOCK_SIZE = 8 * 1024 * 1024;
+// Below this many chunks, spinning up workers costs more than it saves
+constexpr uint64_t PARALLEL_MIN_CHUNKS = 4;
+// Archives this large are read around the page cache instead of being mapped.
+// They are mostly videos played through once, and caching them would only
+// push everything else out.
+constexpr uint64_t UNCACHED_MIN_SIZE = 1024ULL * 1024 * 1024;
+// Read/write fallback for cloneFile()
+constexpr size_t COPY_BLOCK_SIZE = 1024 * 1024;
+const char CANCELLED_ERROR[] = "Decryption cancelled";
+
+const char OPENSSL_SALT_MAGIC[] = "Salted__";
+constexpr size_t OPENSSL_SALT_MAGIC_SIZE = 8;
+constexpr size_t AES_BLOCK_SIZE = 16;
+
+uint32_t loadLE32(const unsigned char *p) {
+  return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 |
+         uint32_t(p[3]) << 24;
+}
+
+uint64_t loadLE64(const unsigned char *p) {
+  return uint64_t(loadLE32(p)) | uint64_t(loadLE32(p + 4)) << 32;
+}
+
+void makeNonce(const unsigned char *header, uint32_t index,
+               unsigned char *nonce) {
+  // noncePrefix sits at offset 48 of the v2 header
+  std::memcpy(nonce, header + 48, SencArchive::V2_NONCE_PREFIX_SIZE);
+  nonce[8] = static_cast<unsigned char>(index >> 24);
+  nonce[9] = static_cast<unsigned char>(index >> 16);
+  nonce[10] = static_cast<unsigned char>(index >> 8);
+  nonce[11] = static_cast<unsigned char>(index);
+}
+
+// One AES-256-GCM open with the header as AAD. `ctx` must already hold the key.
+bool gcmOpen(EVP_CIPHER_CTX *ctx, const unsigned char *header, uint32_t index,
+             const unsigned char *in, size_t inSize, unsigned char *out) {
+  unsigned char nonce[SencArchive::V2_NONCE_SIZE];
+  makeNonce(header, index, nonce);
+
+  int outLen = 0;
+  size_t dataSize = inSize - SencArchive::V2_TAG_SIZE;
+  unsigned char tag[SencArchive::V2_TAG_SIZE];
+  std::memcpy(tag, in + dataSize, sizeof(tag));
+
+  return EVP_DecryptInit_ex(ctx, nullptr, nullptr, nullptr, nonce) == 1 &&
+         EVP_DecryptUpdate(ctx, nullptr, &outLen, header,
+                           SencArchive::V2_HEADER_SIZE) == 1 &&
+         EVP_DecryptUpdate(ctx, out, &outLen, in,
+                           static_cast<int>(dataSize)) == 1 &&
+         EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, sizeof(tag), tag) ==
+             1 &&
+         EVP_DecryptFinal_ex(ctx, out + outLen, &outLen) == 1;
+}
+
+// Runs fn(i) for every i in [0, count) on up to `threads` threads (the caller
+// included). Work is handed out one index at a time so uneven chunks balance;
+// stops early once any call fails.
+bool parallelFor(uint64_t count, unsigned threads,
+                 const std::function<bool(uint64_t)> &fn) {
+  std::atomic<uint64_t> next{0};
+  std::atomic<bool> failed{false};
+  auto worker = [&]() {
+    for (uint64_t i = next++; i < count && !failed; i = next++) {
+      if (!fn(i)) {
+        failed = true;
+      }
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (unsigned t = 1; t < threads; ++t) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (auto &thread : pool) {
+    thread.join();
+  }
+  return !failed;
+}
+
+// v1 streams start with the original filename on its own line
+bool splitV1Name(SencPlaintext &plaintext, std::string &error) {
+  auto newline = std::find(plaintext.buffer.begin(), plaintext.buffer.end(),
+                           static_cast<unsigned char>('\n'));
+  if (newline == plaintext.buffer.end()) {
+    plaintext.clear();
+    error = "Decrypted data has no filename header";
+    return false;
+  }
+  plaintext.originalName.assign(plaintext.buffer.begin(), newline);
+  plaintext.contentOffset = (newline - plaintext.buffer.begin()) + 1;
+  return true;
+}
+
+EVP_CIPHER_CTX *newGcmContext(const SencKey &key) {
+  EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+  if (ctx && EVP_DecryptInit_ex(ctx, SencCrypto::aes256Gcm(), nullptr,
+                                key.key, nullptr) != 1) {
+    EVP_CIPHER_CTX_free(ctx);
+    return nullptr;
+  }
+  return ctx;
+}
+
+bool writeAll(int fd, const unsigned char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = ::write(fd, data, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+} // namespace
+
+void SencPlaintext::clear() {
+  buffer.clear();
+  originalName.clear();
+  contentOffset = 0;
+}
+
+void SencKey::clear() {
+  OPENSSL_cleanse(key, sizeof(key));
+  OPENSSL_cleanse(iv, sizeof(iv));
+}
+
+SencArchive::~SencArchive() { close(); }
+
+bool SencArchive::readAt(uint64_t offset, void *buffer, size_t size) const {
+  auto *out = static_cast<unsigned char *>(buffer);
+  while (size > 0) {
+    ssize_t n = pread(fd, out, size, static_cast<off_t>(offset));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+#ifdef POSIX_FADV_DONTNEED
+    if (uncached) {
+      posix_fadvise(fd, static_cast<off_t>(offset), n, POSIX_FADV_DONTNEED);
+    }
+#endif
+    out += n;
+    offset += n;
+    size -= n;
+  }
+  return true;
+}
+
+const unsigned char *SencArchive::bytesAt(uint64_t offset, size_t size,
+                                          unsigned char *scratch) const {
+  if (mapping) {
+    return offset + size <= mappingSize ? mapping + offset : nullptr;
+  }
+  return readAt(offset, scratch, size) ? scratch : nullptr;
+}
+
+void SencArchive::adviseAccess(uint64_t fileSize) {
+  // Whole-file decrypts and playback both run front to back
+#ifdef __APPLE__
+  fcntl(fd, F_RDAHEAD, 1);
+#elif defined(POSIX_FADV_SEQUENTIAL)
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  if (fileSize >= UNCACHED_MIN_SIZE) {
+#ifdef __APPLE__
+    fcntl(fd, F_NOCACHE, 1);
+#endif
+    uncached = true;
+    return;
+  }
+
+  // Decrypting straight out of the mapping saves copying every block into a
+  // read buffer first; pread stays as the fallback
+  void *p = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (p == MAP_FAILED) {
+    return;
+  }
+  madvise(p, fileSize, MADV_SEQUENTIAL);
+  mapping = static_cast<const unsigned char *>(p);
+  mappingSize = fileSize;
+}
+
+bool SencArchive::open(const fs::path &path, std::string &error) {
+  close();
+
+  fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    error = "Failed to open " + path.string() + ": " + std::strerror(errno);
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    error = "Failed to stat " + path.string() + ": " + std::strerror(errno);
+    close();
+    return false;
+  }
+  uint64_t fileSize = static_cast<uint64_t>(st.st_size);
+  archivePath = path;
+
+  // The marker sits on its own line right before the payload
+  std::vector<unsigned char> head(
+      std::min<uint64_t>(fileSize, MAX_HEADER_SCAN));
+  if (!readAt(0, head.data(), head.size())) {
+    error = "Failed to read " + path.string();
+    close();
+    return false;
+  }
+  std::string marker = std::string("\n") + DATA_MARKER + "\n";
+  auto it = std::search(head.begin(), head.end(), marker.begin(), marker.end());
+  if (it == head.end()) {
+    error = "Invalid archive format";
+    close();
+    return false;
+  }
+  payloadOffset = (it - head.begin()) + marker.size();
+  payloadSize = fileSize - payloadOffset;
+
+  unsigned char prefix[V2_HEADER_SIZE];
+  size_t prefixSize = std::min<uint64_t>(payloadSize, sizeof(prefix));
+  if (!readAt(payloadOffset, prefix, prefixSize)) {
+    error = "Failed to read " + path.string();
+    close();
+    return false;
+  }
+
+  if (prefixSize >= OPENSSL_SALT_MAGIC_SIZE + V1_SALT_SIZE &&
+      std::memcmp(prefix, OPENSSL_SALT_MAGIC, OPENSSL_SALT_MAGIC_SIZE) == 0) {
+    std::memcpy(v1Salt, prefix + OPENSSL_SALT_MAGIC_SIZE, V1_SALT_SIZE);
+    archiveFormat = Format::V1;
+    adviseAccess(fileSize);
+    return true;
+  }
+
+  if (prefixSize == V2_HEADER_SIZE &&
+      std::memcmp(prefix, V2_MAGIC, sizeof(V2_MAGIC)) == 0) {
+    if (!parseV2Header(prefix, fileSize, error)) {
+      close();
+      return false;
+    }
+    archiveFormat = Format::V2;
+    adviseAccess(fileSize);
+    return true;
+  }
+
+  // Looks like an archive, but not one we can decrypt natively. Keep the path
+  // so the caller can fall back to running the embedded script.
+  ::close(fd);
+  fd = -1;
+  return true;
+}
+
+bool SencArchive::parseV2Header(const unsigned char *header, uint64_t fileSize,
+                                std::string &error) {
+  uint32_t headerSize = loadLE32(header + 8);
+  v2ChunkSize = loadLE32(header + 12);
+  v2Iterations = loadLE32(header + 16);
+  v2MetadataSize = loadLE32(header + 20);
+  v2ContentSize = loadLE64(header + 24);
+
+  if (headerSize != V2_HEADER_SIZE || v2ChunkSize < V2_MIN_CHUNK_SIZE ||
+      v2ChunkSize > V2_MAX_CHUNK_SIZE || v2Iterations == 0 ||
+      v2MetadataSize < V2_TAG_SIZE) {
+    error = "Corrupt archive header";
+    return false;
+  }
+
+  std::memcpy(v2Header, header, V2_HEADER_SIZE);
+  uint64_t chunks = v2ChunkCount();
+  if (chunks >= V2_METADATA_INDEX) {
+    error = "Corrupt archive header";
+    return false;
+  }
+
+  uint64_t expected = payloadOffset + V2_HEADER_SIZE + v2MetadataSize +
+                      v2ContentSize + chunks * V2_TAG_SIZE;
+  if (fileSize != expected) {
+    error = fileSize < expected ? "Encrypted data is truncated"
+                                : "Archive has trailing data";
+    return false;
+  }
+  return true;
+}
+
+void SencArchive::close() {
+  if (mapping) {
+    munmap(const_cast<unsigned char *>(mapping), mappingSize);
+  }
+  mapping = nullptr;
+  mappingSize = 0;
+  uncached = false;
+  if (fd >= 0) {
+    ::close(fd);
+  }
+  fd = -1;
+  archivePath.clear();
+  payloadOffset = 0;
+  payloadSize = 0;
+  archiveFormat = Format::Unknown;
+  v2ChunkSize = 0;
+  v2Iterations = 0;
+  v2MetadataSize = 0;
+  v2ContentSize = 0;
+}
+
+uint64_t SencArchive::v1CiphertextSize() const {
+  return payloadSize - OPENSSL_SALT_MAGIC_SIZE - V1_SALT_SIZE;
+}
+
+uint64_t SencArchive::v2ChunkCount() const {
+  if (v2ChunkSize == 0) {
+    return 0;
+  }
+  return std::max<uint64_t>(1, (v2ContentSize + v2ChunkSize - 1) / v2ChunkSize);
+}
+
+size_t SencArchive::chunkSize() const {
+  switch (archiveFormat) {
+  case Format::V1:
+    return V1_CHUNK_SIZE;
+  case Format::V2:
+    return v2ChunkSize;
+  case Format::Unknown:
+    break;
+  }
+  return 0;
+}
+
+uint64_t SencArchive::chunkCount() const {
+  switch (archiveFormat) {
+  case Format::V1:
+    return (v1CiphertextSize() + V1_CHUNK_SIZE - 1) / V1_CHUNK_SIZE;
+  case Format::V2:
+    return v2ChunkCount();
+  case Format::Unknown:
+    break;
+  }
+  return 0;
+}
+
+bool SencArchive::readLayout(const SencKey &key, SencLayout &layout,
+                             std::string &error) const {
+  layout = SencLayout();
+  if (archiveFormat == Format::V2) {
+    SencMetadata metadata;
+    if (!readMetadata(key, metadata, error)) {
+      return false;
+    }
+    layout.originalName = metadata.originalName;
+    layout.mimeType = metadata.mimeType;
+    layout.contentSize = v2ContentSize;
+    return true;
+  }
+  if (archiveFormat != Format::V1) {
+    error = "Unsupported archive format";
+    return false;
+  }
+
+  uint64_t chunks = chunkCount();
+  uint64_t ciphertextSize = v1CiphertextSize();
+  if (chunks == 0 || ciphertextSize % AES_BLOCK_SIZE != 0) {
+    error = "Encrypted data is truncated";
+    return false;
+  }
+
+  // The padding in the last chunk gives the stream size (and is the only
+  // password check CBC offers)
+  SecureBuffer chunk;
+  size_t chunkBytes = 0;
+  if (!chunk.allocate(V1_CHUNK_SIZE) ||
+      !decryptChunk(key, chunks - 1, chunk.data(), chunkBytes, error)) {
+    return false;
+  }
+  uint64_t streamSize = (chunks - 1) * V1_CHUNK_SIZE + chunkBytes;
+
+  // The filename line has to fit in the first chunk
+  if (chunks > 1 &&
+      !decryptChunk(key, 0, chunk.data(), chunkBytes, error)) {
+    return false;
+  }
+  auto newline = std::find(chunk.data(), chunk.data() + chunkBytes,
+                           static_cast<unsigned char>('\n'));
+  if (newline == chunk.data() + chunkBytes) {
+    error = "Decrypted data has no filename header";
+    return false;
+  }
+  layout.originalName.assign(chunk.data(), newline);
+  layout.contentOffset = (newline - chunk.data()) + 1;
+  layout.contentSize = streamSize - layout.contentOffset;
+  return true;
+}
+
+bool SencArchive::extract(const SencKey &key, const fs::path &output,
+                          std::string &error) const {
+  SencLayout layout;
+  if (!readLayout(key, layout, error)) {
+    return false;
+  }
+  int out = ::open(output.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                   0644);
+  if (out < 0) {
+    error = "Failed to create " + output.string() + ": " +
+            std::strerror(errno);
+    return false;
+  }
+
+  // One chunk of plaintext in memory at a time, whatever the file size
+  SecureBuffer chunk;
+  size_t size = chunkSize();
+  bool ok = chunk.allocate(size);
+  uint64_t end = layout.contentOffset + layout.contentSize;
+  for (uint64_t i = layout.contentOffset / size;
+       ok && i < chunkCount() && i * size < end; ++i) {
+    if (cancelled()) {
+      error = CANCELLED_ERROR;
+      ok = false;
+      break;
+    }
+    size_t bytes = 0;
+    ok = decryptChunk(key, i, chunk.data(), bytes, error);
+    uint64_t start = i * size;
+    uint64_t from = std::max(start, layout.contentOffset) - start;
+    uint64_t to = std::min(start + bytes, end) - start;
+    if (ok && to > from && !writeAll(out, chunk.data() + from, to - from)) {
+      error = "Failed to write " + output.string() + ": " +
+              std::strerror(errno);
+      ok = false;
+    }
+  }
+  if (::close(out) != 0 && ok) {
+    error = "Failed to write " + output.string();
+    ok = false;
+  }
+  if (!ok) {
+    ::unlink(output.c_str());
+  }
+  return ok;
+}
+
+bool SencArchive::cloneFile(const fs::path &source, const fs::path &target,
+                            std::string &error) {
+#ifdef __APPLE__
+  // Copy-on-write on APFS; copyfile() does a plain copy where that fails
+  if (clonefile(source.c_str(), target.c_str(), 0) == 0 ||
+      copyfile(source.c_str(), target.c_str(), nullptr,
+               COPYFILE_DATA | COPYFILE_EXCL) == 0) {
+    return true;
+  }
+  error = "Failed to copy " + source.string() + ": " + std::strerror(errno);
+  return false;
+#else
+  int in = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (in < 0 || fstat(in, &st) != 0) {
+    error = "Failed to open " + source.string() + ": " + std::strerror(errno);
+    if (in >= 0) {
+      ::close(in);
+    }
+    return false;
+  }
+  int out = ::open(target.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                   st.st_mode & 0777);
+  if (out < 0) {
+    error = "Failed to create " + target.string() + ": " +
+            std::strerror(errno);
+    ::close(in);
+    return false;
+  }
+
+  // copy_file_range stays in the kernel and shares extents where the
+  // filesystem can; anything it refuses goes through a buffer instead
+  uint64_t remaining = static_cast<uint64_t>(st.st_size);
+  bool ok = true;
+  while (remaining > 0) {
+    ssize_t n = copy_file_range(in, nullptr, out, nullptr, remaining, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    remaining -= n;
+  }
+  std::vector<unsigned char> block(remaining > 0 ? COPY_BLOCK_SIZE : 0);
+  while (ok && remaining > 0) {
+    ssize_t n = ::read(in, block.data(), block.size());
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    ok = n > 0 && writeAll(out, block.data(), n);
+    remaining -= ok ? n : 0;
+  }
+  ::close(in);
+  if (::close(out) != 0) {
+    ok = false;
+  }
+  if (!ok) {
+    error = "Failed to copy " + source.string() + ": " + std::strerror(errno);
+    ::unlink(target.c_str());
+  }
+  return ok;
+#endif
+}
+
+bool SencArchive::deriveKey(const std::string &password, SencKey &key,
+                            std::string &error) const {
+  key.clear();
+  int ok = 0;
+  switch (archiveFormat) {
+  case Format::V1: {
+    // openssl enc -pbkdf2 derives key and IV in one PBKDF2-HMAC-SHA256 call
+    unsigned char keyIv[SencKey::KEY_SIZE + SencKey::IV_SIZE];
+    ok = PKCS5_PBKDF2_HMAC(password.data(), static_cast<int>(password.size()),
+                           v1Salt, V1_SALT_SIZE, V1_PBKDF2_ITERATIONS,
+                           SencCrypto::sha256(), sizeof(keyIv), keyIv);
+    std::memcpy(key.key, keyIv, SencKey::KEY_SIZE);
+    std::memcpy(key.iv, keyIv + SencKey::KEY_SIZE, SencKey::IV_SIZE);
+    OPENSSL_cleanse(keyIv, sizeof(keyIv));
+    break;
+  }
+  case Format::V2:
+    // salt sits at offset 32 of the v2 header
+    ok = PKCS5_PBKDF2_HMAC(password.data(), static_cast<int>(password.size()),
+                           v2Header + 32, V2_SALT_SIZE,
+                           static_cast<int>(v2Iterations),
+                           SencCrypto::sha256(), SencKey::KEY_SIZE, key.key);
+    break;
+  case Format::Unknown:
+    error = "Unsupported archive format";
+    return false;
+  }
+
+  if (ok != 1) {
+    key.clear();
+    error = "Key derivation failed";
+    return false;
+  }
+  return true;
+}
+
+std::string SencArchive::kdfContext() const {
+  switch (archiveFormat) {
+  case Format::V1:
+    return std::string("v1:") +
+           std::string(reinterpret_cast<const char *>(v1Salt), V1_SALT_SIZE);
+  case Format::V2:
+    return "v2:" + std::to_string(v2Iterations) + ":" +
+           std::string(reinterpret_cast<const char *>(v2Header + 32),
+                       V2_SALT_SIZE);
+  case Format::Unknown:
+    break;
+  }
+  return std::string();
+}
+
+bool SencArchive::decrypt(const std::string &password, SencPlaintext &plaintext,
+                          std::string &error) const {
+  SencKey key;
+  return deriveKey(password, key, error) && decrypt(key, plaintext, error);
+}
+
+bool SencArchive::decrypt(const SencKey &key, SencPlaintext &plaintext,
+                          std::string &error) const {
+  plaintext.clear();
+  unsigned threads = threadsFor(chunkCount());
+  if (threads > 1) {
+    return decryptParallel(key, plaintext, threads, error);
+  }
+
+  switch (archiveFormat) {
+  case Format::V1:
+    return decryptV1(key, plaintext, error);
+  case Format::V2:
+    return decryptV2(key, plaintext, error);
+  case Format::Unknown:
+    break;
+  }
+  error = "Unsupported archive format";
+  return false;
+}
+
+unsigned SencArchive::threadsFor(uint64_t chunks) const {
+  if (chunks < PARALLEL_MIN_CHUNKS) {
+    return 1;
+  }
+  unsigned threads = maxThreads;
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  return static_cast<unsigned>(std::min<uint64_t>(threads, chunks));
+}
+
+bool SencArchive::decryptParallel(const SencKey &key, SencPlaintext &plaintext,
+                                  unsigned threads, std::string &error) const {
+  // Chunks decrypt independently straight into their final position in the
+  // output, so there is nothing to reassemble afterwards
+  SencMetadata metadata;
+  uint64_t capacity = 0;
+  if (archiveFormat == Format::V2) {
+    if (!readMetadata(key, metadata, error)) {
+      return false;
+    }
+    capacity = v2ContentSize;
+  } else {
+    capacity = v1CiphertextSize();
+    if (capacity % AES_BLOCK_SIZE != 0) {
+      error = "Encrypted data is truncated";
+      return false;
+    }
+  }
+
+  if (!plaintext.buffer.allocate(capacity)) {
+    error = "Out of memory for decrypted data";
+    return false;
+  }
+
+  uint64_t chunks = chunkCount();
+  size_t size = chunkSize();
+  size_t lastChunkSize = 0;
+  std::mutex errorMutex;
+  bool ok = parallelFor(chunks, threads, [&](uint64_t i) {
+    size_t written = 0;
+    std::string chunkError;
+    if (cancelled()) {
+      chunkError = CANCELLED_ERROR;
+    } else if (decryptChunk(key, i, plaintext.buffer.data() + i * size,
+                            written, chunkError)) {
+      if (i == chunks - 1) {
+        lastChunkSize = written;
+      }
+      return true;
+    }
+    std::lock_guard<std::mutex> lock(errorMutex);
+    if (error.empty()) {
+      error = chunkError;
+    }
+    return false;
+  });
+
+  if (!ok) {
+    plaintext.clear();
+    return false;
+  }
+  plaintext.buffer.resize((chunks - 1) * size + lastChunkSize);
+
+  if (archiveFormat == Format::V1) {
+    return splitV1Name(plaintext, error);
+  }
+  plaintext.originalName = metadata.originalName;
+  plaintext.contentOffset = 0;
+  return true;
+}
+
+bool SencArchive::decryptV1(const SencKey &key, SencPlaintext &plaintext,
+                            std::string &error) const {
+  uint64_t ciphertextOffset =
+      payloadOffset + OPENSSL_SALT_MAGIC_SIZE + V1_SALT_SIZE;
+  uint64_t ciphertextSize = v1CiphertextSize();
+
+  if (ciphertextSize == 0 || ciphertextSize % AES_BLOCK_SIZE != 0) {
+    error = "Encrypted data is truncated";
+    return false;
+  }
+
+  EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+  bool ok = ctx && EVP_DecryptInit_ex(ctx, SencCrypto::aes256Cbc(), nullptr,
+                                      key.key, key.iv) == 1;
+
+  // Single pass straight into the output buffer
+  if (ok && !plaintext.buffer.allocate(ciphertextSize + AES_BLOCK_SIZE)) {
+    EVP_CIPHER_CTX_free(ctx);
+    error = "Out of memory for decrypted data";
+    return false;
+  }
+
+  size_t blockSize = std::min<uint64_t>(ciphertextSize, READ_BLOCK_SIZE);
+  std::vector<unsigned char> block(mapping ? 0 : blockSize);
+  size_t written = 0;
+  for (uint64_t offset = 0; ok && offset < ciphertextSize;) {
+    size_t chunk = std::min<uint64_t>(ciphertextSize - offset, blockSize);
+    const unsigned char *in = nullptr;
+    if (cancelled() ||
+        !(in = bytesAt(ciphertextOffset + offset, chunk, block.data()))) {
+      EVP_CIPHER_CTX_free(ctx);
+      plaintext.clear();
+      error = cancelled() ? CANCELLED_ERROR : "Failed to read encrypted data";
+      return false;
+    }
+    int outLen = 0;
+    ok = EVP_DecryptUpdate(ctx, plaintext.buffer.data() + written, &outLen,
+                           in, static_cast<int>(chunk)) == 1;
+    written += outLen;
+    offset += chunk;
+  }
+  if (ok) {
+    int outLen = 0;
+    ok = EVP_DecryptFinal_ex(ctx, plaintext.buffer.data() + written,
+                             &outLen) == 1;
+    written += outLen;
+  }
+  EVP_CIPHER_CTX_free(ctx);
+
+  if (!ok) {
+    plaintext.clear();
+    error = "Decryption failed - incorrect password?";
+    return false;
+  }
+  plaintext.buffer.resize(written);
+  return splitV1Name(plaintext, error);
+}
+
+bool SencArchive::readMetadata(const SencKey &key, SencMetadata &metadata,
+                               std::string &error) const {
+  metadata = SencMetadata();
+  if (archiveFormat != Format::V2) {
+    error = "Archive has no metadata block";
+    return false;
+  }
+
+  std::vector<unsigned char> scratch(mapping ? 0 : v2MetadataSize);
+  const unsigned char *sealed =
+      bytesAt(payloadOffset + V2_HEADER_SIZE, v2MetadataSize, scratch.data());
+  if (!sealed) {
+    error = "Failed to read encrypted data";
+    return false;
+  }
+
+  SecureBuffer opened;
+  EVP_CIPHER_CTX *ctx = newGcmContext(key);
+  bool ok = ctx && opened.allocate(v2MetadataSize) &&
+            gcmOpen(ctx, v2Header, V2_METADATA_INDEX, sealed, v2MetadataSize,
+                    opened.data());
+  EVP_CIPHER_CTX_free(ctx);
+  if (!ok) {
+    error = "Decryption failed - incorrect password?";
+    return false;
+  }
+
+  // Sequence of u16 type, u32 length, value; unknown types are skipped
+  const unsigned char *p = opened.data();
+  const unsigned char *end = p + v2MetadataSize - V2_TAG_SIZE;
+  while (end - p >= 6) {
+    uint16_t type = uint16_t(p[0] | p[1] << 8);
+    uint32_t length = loadLE32(p + 2);
+    p += 6;
+    if (length > static_cast<size_t>(end - p)) {
+      error = "Corrupt metadata block";
+      return false;
+    }
+    const char *value = reinterpret_cast<const char *>(p);
+    if (type == V2_META_ORIGINAL_NAME) {
+      metadata.originalName.assign(value, length);
+    } else if (type == V2_META_MIME_TYPE) {
+      metadata.mimeType.assign(value, length);
+    }
+    p += length;
+  }
+  metadata.originalSize = v2ContentSize;
+  return true;
+}
+
+bool SencArchive::decryptChunk(const SencKey &key, uint64_t index,
+                               unsigned char *out, size_t &outSize,
+                               std::string &error) const {
+  outSize = 0;
+  if (index >= chunkCount()) {
+    error = "Chunk out of range";
+    return false;
+  }
+  if (archiveFormat == Format::V1) {
+    return decryptV1Chunk(key, index, out, outSize, error);
+  }
+
+  uint64_t start = index * v2ChunkSize;
+  size_t plainSize = std::min<uint64_t>(v2ChunkSize, v2ContentSize - start);
+  uint64_t offset = payloadOffset + V2_HEADER_SIZE + v2MetadataSize +
+                    index * (v2ChunkSize + V2_TAG_SIZE);
+
+  size_t sealedSize = plainSize + V2_TAG_SIZE;
+  std::vector<unsigned char> scratch(mapping ? 0 : sealedSize);
+  const unsigned char *sealed = bytesAt(offset, sealedSize, scratch.data());
+  if (!sealed) {
+    error = "Failed to read encrypted data";
+    return false;
+  }
+
+  EVP_CIPHER_CTX *ctx = newGcmContext(key);
+  bool ok = ctx && gcmOpen(ctx, v2Header, static_cast<uint32_t>(index),
+                           sealed, sealedSize, out);
+  EVP_CIPHER_CTX_free(ctx);
+  if (!ok) {
+    OPENSSL_cleanse(out, plainSize);
+    error = "Chunk failed authentication";
+    return false;
+  }
+  outSize = plainSize;
+  return true;
+}
+
+bool SencArchive::decryptV1Chunk(const SencKey &key, uint64_t index,
+                                 unsigned char *out, size_t &outSize,
+                                 std::string &error) const {
+  uint64_t ciphertextOffset =
+      payloadOffset + OPENSSL_SALT_MAGIC_SIZE + V1_SALT_SIZE;
+  uint64_t ciphertextSize = v1CiphertextSize();
+  uint64_t start = index * V1_CHUNK_SIZE;
+  size_t size = std::min<uint64_t>(V1_CHUNK_SIZE, ciphertextSize - start);
+  bool last = start + size == ciphertextSize;
+  if (size % AES_BLOCK_SIZE != 0) {
+    error = "Encrypted data is truncated";
+    return false;
+  }
+
+  // CBC only chains through the previous ciphertext block, so read it along
+  // with the slice and use it as the IV
+  size_t ivSize = index > 0 ? AES_BLOCK_SIZE : 0;
+  std::vector<unsigned char> scratch(mapping ? 0 : ivSize + size);
+  const unsigned char *sealed = bytesAt(ciphertextOffset + start - ivSize,
+                                        ivSize + size, scratch.data());
+  if (!sealed) {
+    error = "Failed to read encrypted data";
+    return false;
+  }
+  const unsigned char *iv = index > 0 ? sealed : key.iv;
+  const unsigned char *slice = sealed + ivSize;
+
+  EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+  int outLen = 0;
+  bool ok = ctx &&
+            EVP_DecryptInit_ex(ctx, SencCrypto::aes256Cbc(), nullptr,
+                               key.key, iv) == 1 &&
+            EVP_CIPHER_CTX_set_padding(ctx, 0) == 1 &&
+            EVP_DecryptUpdate(ctx, out, &outLen, slice,
+                              static_cast<int>(size)) == 1;
+  EVP_CIPHER_CTX_free(ctx);
+  if (!ok) {
+    error = "Failed to decrypt chunk";
+    return false;
+  }
+
+  outSize = size;
+  if (last) {
+    // PKCS#7 padding, checked the way EVP_DecryptFinal does
+    unsigned char pad = out[size - 1];
+    bool padOk = pad >= 1 && pad <= AES_BLOCK_SIZE;
+    for (size_t i = 0; padOk && i < pad; ++i) {
+      padOk = out[size - 1 - i] == pad;
+    }
+    if (!padOk) {
+      OPENSSL_cleanse(out, size);
+      outSize = 0;
+      error = "Decryption failed - incorrect password?";
+      return false;
+    }
+    outSize -= pad;
+  }
+  return true;
+}
+
+bool SencArchive::decryptV2(const SencKey &key, SencPlaintext &plaintext,
+                            std::string &error) const {
+  SencMetadata metadata;
+  if (!readMetadata(key, metadata, error)) {
+    return false;
+  }
+
+  if (!plaintext.buffer.allocate(v2ContentSize)) {
+    error = "Out of memory for decrypted data";
+    return false;
+  }
+
+  EVP_CIPHER_CTX *ctx = newGcmContext(key);
+  if (!ctx) {
+    plaintext.clear();
+    error = "Failed to initialise cipher";
+    return false;
+  }
+
+  uint64_t chunks = chunkCount();
+  uint64_t offset = payloadOffset + V2_HEADER_SIZE + v2MetadataSize;
+  std::vector<unsigned char> scratch(mapping ? 0 : v2ChunkSize + V2_TAG_SIZE);
+  bool ok = true;
+  for (uint64_t i = 0; ok && i < chunks; ++i) {
+    uint64_t start = i * v2ChunkSize;
+    size_t plainSize = std::min<uint64_t>(v2ChunkSize, v2ContentSize - start);
+    size_t sealedSize = plainSize + V2_TAG_SIZE;
+    if (cancelled()) {
+      error = CANCELLED_ERROR;
+      ok = false;
+      break;
+    }
+    const unsigned char *sealed = bytesAt(offset, sealedSize, scratch.data());
+    if (!sealed) {
+      error = "Failed to read encrypted data";
+      ok = false;
+      break;
+    }
+    ok = gcmOpen(ctx, v2Header, static_cast<uint32_t>(i), sealed, sealedSize,
+                 plaintext.buffer.data() + start);
+    if (!ok) {
+      error = "Chunk failed authentication";
+    }
+    offset += sealedSize;
+  }
+  EVP_CIPHER_CTX_free(ctx);
+
+  if (!ok) {
+    plaintext.clear();
+    return false;
+  }
+  plaintext.originalName = metadata.originalName;
+  plaintext.contentOffset = 0;
+  return true;
+}
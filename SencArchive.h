@@ -0,0 +1,190 @@
+#ifndef SENCARCHIVE_H
+#define SENCARCHIVE_H
+
+#include "SecureBuffer.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+// Decrypted contents of a .senc archive. For v1 the buffer starts with the
+// original filename on its own line, followed by the file content; for v2 the
+// name comes from the metadata block and the buffer is content only. The
+// buffer lives in locked memory and is wiped by clear().
+struct SencPlaintext {
+  std::string originalName;
+  SecureBuffer buffer;
+  size_t contentOffset = 0;
+
+  const unsigned char *content() const { return buffer.data() + contentOffset; }
+  size_t contentSize() const { return buffer.size() - contentOffset; }
+  void clear();
+};
+
+// Key material derived from the password for one archive
+struct SencKey {
+  static constexpr size_t KEY_SIZE = 32;
+  static constexpr size_t IV_SIZE = 16;
+
+  unsigned char key[KEY_SIZE] = {};
+  unsigned char iv[IV_SIZE] = {}; // v1 only; v2 uses per-chunk nonces
+
+  SencKey() = default;
+  SencKey(const SencKey &other) = default;
+  SencKey &operator=(const SencKey &other) = default;
+  ~SencKey() { clear(); }
+  void clear();
+};
+
+// Fields of the encrypted v2 metadata block. Readers skip records they don't
+// know, so fields can be added without a format bump.
+struct SencMetadata {
+  std::string originalName;
+  std::string mimeType; // empty when the writer didn't record one
+  uint64_t originalSize = 0; // from the authenticated header
+};
+
+// Where the file content sits inside the decrypted stream
+struct SencLayout {
+  std::string originalName;
+  std::string mimeType; // v2 only
+  uint64_t contentOffset = 0;
+  uint64_t contentSize = 0;
+};
+
+// Native reader for the self-extracting archives written by bin/senc.
+//
+// v1: the script header is followed by `openssl enc -aes-256-cbc -pbkdf2`
+// output ("Salted__", 8-byte salt, one CBC stream). The decrypted stream is the
+// original filename, a newline, then the content.
+//
+// v2: the script header is followed by a fixed V2_HEADER_SIZE byte header
+// (little-endian):
+//   magic[8] "SENCv2\0\0", u32 headerSize, u32 chunkSize, u32 kdfIterations,
+//   u32 metadataSize, u64 contentSize, salt[16], noncePrefix[8], reserved[8]
+// then the AES-256-GCM metadata block (metadataSize bytes including its tag),
+// then ceil(contentSize / chunkSize) chunks of chunkSize bytes plus a 16-byte
+// tag each (the last chunk may be short; an empty file still has one chunk).
+// Chunks are fixed size, so chunk i lives at a computable offset and can be
+// decrypted on its own. Each nonce is noncePrefix || be32(i) (the metadata
+// block uses index 0xffffffff) and the header is authenticated as AAD, so
+// chunks can't be reordered, truncated or moved between files.
+class SencArchive {
+public:
+  enum class Format { Unknown, V1, V2 };
+
+  SencArchive() = default;
+  ~SencArchive();
+  SencArchive(const SencArchive &) = delete;
+  SencArchive &operator=(const SencArchive &) = delete;
+
+  bool open(const std::filesystem::path &path, std::string &error);
+  void close();
+
+  Format format() const { return archiveFormat; }
+  const std::filesystem::path &path() const { return archivePath; }
+
+  // Caps the worker threads used by decrypt(); 0 means one per core
+  void setMaxThreads(unsigned count) { maxThreads = count; }
+  unsigned maxThreadCount() const { return maxThreads; }
+  // decrypt() gives up between blocks once `*flag` becomes true
+  void setCancelFlag(const std::atomic<bool> *flag) { cancelFlag = flag; }
+
+  bool deriveKey(const std::string &password, SencKey &key,
+                 std::string &error) const;
+  // KDF inputs apart from the password (format, iterations, salt). Archives
+  // with equal contexts derive the same key from the same password.
+  std::string kdfContext() const;
+  bool decrypt(const std::string &password, SencPlaintext &plaintext,
+               std::string &error) const;
+  bool decrypt(const SencKey &key, SencPlaintext &plaintext,
+               std::string &error) const;
+
+  // Random access. The decrypted stream is split into chunkSize() pieces:
+  // the GCM chunks for v2, and for v1 slices of the CBC stream, each decrypted
+  // with the preceding ciphertext block as its IV. Stream offsets include the
+  // v1 filename line; readLayout() says where the content starts.
+  size_t chunkSize() const;
+  uint64_t chunkCount() const;
+  bool readLayout(const SencKey &key, SencLayout &layout,
+                  std::string &error) const;
+  bool readMetadata(const SencKey &key, SencMetadata &metadata,
+                    std::string &error) const;
+  // Writes the content to a new file at `output`, which must not exist, one
+  // chunk at a time; removes it again on failure. Honours the cancel flag.
+  bool extract(const SencKey &key, const std::filesystem::path &output,
+               std::string &error) const;
+  // `out` must hold chunkSize() bytes; thread-safe for concurrent readers
+  bool decryptChunk(const SencKey &key, uint64_t index, unsigned char *out,
+                    size_t &outSize, std::string &error) const;
+
+  // Copies a file to `target`, which must not exist, sharing its blocks where
+  // the filesystem allows (clonefile on APFS, copy_file_range on Linux)
+  static bool cloneFile(const std::filesystem::path &source,
+                        const std::filesystem::path &target,
+                        std::string &error);
+
+  static constexpr const char *DATA_MARKER = "__ENCRYPTED_DATA_BELOW__";
+  // openssl enc defaults when -pbkdf2 is given without -iter / -md
+  static constexpr int V1_PBKDF2_ITERATIONS = 10000;
+  static constexpr size_t V1_SALT_SIZE = 8;
+  static constexpr size_t V1_CHUNK_SIZE = 1024 * 1024;
+
+  static constexpr char V2_MAGIC[8] = {'S', 'E', 'N', 'C', 'v', '2', 0, 0};
+  static constexpr size_t V2_HEADER_SIZE = 64;
+  static constexpr size_t V2_SALT_SIZE = 16;
+  static constexpr size_t V2_NONCE_PREFIX_SIZE = 8;
+  static constexpr size_t V2_NONCE_SIZE = 12;
+  static constexpr size_t V2_TAG_SIZE = 16;
+  static constexpr size_t V2_MIN_CHUNK_SIZE = 4 * 1024;
+  static constexpr size_t V2_MAX_CHUNK_SIZE = 64 * 1024 * 1024;
+  static constexpr uint32_t V2_METADATA_INDEX = 0xffffffff;
+  static constexpr uint16_t V2_META_ORIGINAL_NAME = 1;
+  static constexpr uint16_t V2_META_MIME_TYPE = 2;
+
+private:
+  bool readAt(uint64_t offset, void *buffer, size_t size) const;
+  // `size` bytes at `offset`: a pointer into the mapping when the file is
+  // mapped, otherwise read into `scratch`. nullptr on a short file.
+  const unsigned char *bytesAt(uint64_t offset, size_t size,
+                               unsigned char *scratch) const;
+  void adviseAccess(uint64_t fileSize);
+  bool parseV2Header(const unsigned char *header, uint64_t fileSize,
+                     std::string &error);
+  bool decryptV1(const SencKey &key, SencPlaintext &plaintext,
+                 std::string &error) const;
+  bool decryptV2(const SencKey &key, SencPlaintext &plaintext,
+                 std::string &error) const;
+  unsigned threadsFor(uint64_t chunks) const;
+  bool decryptParallel(const SencKey &key, SencPlaintext &plaintext,
+                       unsigned threads, std::string &error) const;
+  bool decryptV1Chunk(const SencKey &key, uint64_t index, unsigned char *out,
+                      size_t &outSize, std::string &error) const;
+  uint64_t v1CiphertextSize() const;
+  uint64_t v2ChunkCount() const;
+  bool cancelled() const { return cancelFlag && *cancelFlag; }
+
+  std::filesystem::path archivePath;
+  int fd = -1;
+  // Archives under 1 GiB are mapped read-only; larger ones are read with
+  // pread and kept out of the page cache. A mapped archive truncated
+  // underneath us faults the reader, as with any mmap.
+  const unsigned char *mapping = nullptr;
+  size_t mappingSize = 0;
+  bool uncached = false;
+  uint64_t payloadOffset = 0;
+  uint64_t payloadSize = 0;
+  Format archiveFormat = Format::Unknown;
+  unsigned maxThreads = 0;
+  const std::atomic<bool> *cancelFlag = nullptr;
+
+  unsigned char v1Salt[V1_SALT_SIZE] = {};
+  unsigned char v2Header[V2_HEADER_SIZE] = {};
+  size_t v2ChunkSize = 0;
+  uint32_t v2Iterations = 0;
+  uint32_t v2MetadataSize = 0;
+  uint64_t v2ContentSize = 0;
+};
+
+#endif // SENCARCHIVE_H
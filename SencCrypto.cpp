@@ -0,0 +1,91 @@
+#include "SencCrypto.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#elif defined(__aarch64__) && defined(__APPLE__)
+#include <sys/sysctl.h>
+#elif defined(__aarch64__) && defined(__linux__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+
+namespace {
+SencCpuFeatures detectCpuFeatures() {
+  SencCpuFeatures features;
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    features.aes = ecx & bit_AES;
+    features.clmul = ecx & bit_PCLMUL;
+  }
+  if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    features.sha256 = ebx & (1u << 29);
+    // VAES (bit 9) and VPCLMULQDQ (bit 10)
+    features.vaes = (ecx & (1u << 9)) && (ecx & (1u << 10));
+  }
+#elif defined(__aarch64__) && defined(__APPLE__)
+  auto has = [](const char *name) {
+    int value = 0;
+    size_t size = sizeof(value);
+    return sysctlbyname(name, &value, &size, nullptr, 0) == 0 && value != 0;
+  };
+  features.aes = has("hw.optional.arm.FEAT_AES");
+  features.clmul = has("hw.optional.arm.FEAT_PMULL");
+  features.sha256 = has("hw.optional.arm.FEAT_SHA256");
+#elif defined(__aarch64__) && defined(__linux__)
+  unsigned long hwcap = getauxval(AT_HWCAP);
+  features.aes = hwcap & HWCAP_AES;
+  features.clmul = hwcap & HWCAP_PMULL;
+  features.sha256 = hwcap & HWCAP_SHA2;
+#endif
+  return features;
+}
+} // namespace
+
+const EVP_CIPHER *SencCrypto::aes256Cbc() {
+  static const EVP_CIPHER *cipher =
+      EVP_CIPHER_fetch(nullptr, "AES-256-CBC", nullptr);
+  return cipher ? cipher : EVP_aes_256_cbc();
+}
+
+const EVP_CIPHER *SencCrypto::aes256Gcm() {
+  static const EVP_CIPHER *cipher =
+      EVP_CIPHER_fetch(nullptr, "AES-256-GCM", nullptr);
+  return cipher ? cipher : EVP_aes_256_gcm();
+}
+
+const EVP_MD *SencCrypto::sha256() {
+  static const EVP_MD *md = EVP_MD_fetch(nullptr, "SHA256", nullptr);
+  return md ? md : EVP_sha256();
+}
+
+const SencCpuFeatures &SencCrypto::cpuFeatures() {
+  static const SencCpuFeatures features = detectCpuFeatures();
+  return features;
+}
+
+std::string SencCrypto::kernelDescription() {
+  const SencCpuFeatures &features = cpuFeatures();
+  if (!features.aes) {
+    return "portable (no AES instructions)";
+  }
+
+#if defined(__aarch64__)
+  std::string description = "ARMv8 AES";
+  if (features.clmul) {
+    description += " + PMULL";
+  }
+  if (features.sha256) {
+    description += " + SHA2";
+  }
+#else
+  std::string description = features.vaes ? "VAES" : "AES-NI";
+  if (features.clmul) {
+    description += features.vaes ? " + VPCLMULQDQ" : " + PCLMUL";
+  }
+  if (features.sha256) {
+    description += " + SHA-NI";
+  }
+#endif
+  return description;
+}
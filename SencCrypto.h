@@ -0,0 +1,34 @@
+#ifndef SENCCRYPTO_H
+#define SENCCRYPTO_H
+
+#include <openssl/evp.h>
+#include <string>
+
+// CPU crypto extensions relevant to the decrypt hot loop
+struct SencCpuFeatures {
+  bool aes = false;    // AES-NI / ARMv8 AES
+  bool clmul = false;  // PCLMULQDQ / ARMv8 PMULL (GCM's GHASH)
+  bool sha256 = false; // SHA-NI / ARMv8 SHA2 (PBKDF2)
+  bool vaes = false;   // x86 VAES + VPCLMULQDQ (wide GCM kernels)
+};
+
+// Shared crypto primitives for SencArchive and SencWriter.
+//
+// The AES-CBC, AES-GCM and SHA-256 kernels come from libcrypto, which ships
+// AES-NI/VAES + PCLMUL code for x86 and AES/PMULL/SHA2 code for arm64 and
+// picks one at startup from its own CPUID probe, falling back to the portable
+// C implementation. The algorithms are fetched from the provider once here;
+// OpenSSL 3 would otherwise repeat the lookup on every cipher init, which is
+// once per chunk on the random-access path.
+class SencCrypto {
+public:
+  static const EVP_CIPHER *aes256Cbc();
+  static const EVP_CIPHER *aes256Gcm();
+  static const EVP_MD *sha256();
+
+  static const SencCpuFeatures &cpuFeatures();
+  // e.g. "AES-NI + PCLMUL + SHA-NI", or "portable (no AES instructions)"
+  static std::string kernelDescription();
+};
+
+#endif // SENCCRYPTO_H
@@ -0,0 +1,164 @@
+#include "SencKeyCache.h"
+#include "SencCrypto.h"
+#include <cstring>
+#include <openssl/crypto.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+namespace {
+constexpr size_t SECRET_SIZE = 32;
+} // namespace
+
+SencKeyCache::SencKeyCache(size_t capacity) : capacity(capacity) {}
+
+SencKeyCache::~SencKeyCache() { clear(); }
+
+void SencKeyCache::setTimeToLive(std::chrono::milliseconds ttl) {
+  std::lock_guard<std::mutex> lock(mutex);
+  timeToLive = ttl;
+}
+
+bool SencKeyCache::deriveKey(const SencArchive &archive,
+                             const std::string &password, SencKey &key,
+                             std::string &error) {
+  if (lookup(archive, password, key)) {
+    return true;
+  }
+  return archive.deriveKey(password, key, error);
+}
+
+bool SencKeyCache::lookup(const SencArchive &archive,
+                          const std::string &password, SencKey &key) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (storage.empty()) {
+    return false;
+  }
+  unsigned char tag[TAG_SIZE];
+  if (!makeTag(archive, password, tag)) {
+    return false;
+  }
+
+  Clock::time_point now = Clock::now();
+  expire(now);
+  bool found = false;
+  Entry *table = entries();
+  for (size_t i = 0; i < capacity && !found; ++i) {
+    Entry &entry = table[i];
+    if (entry.used && CRYPTO_memcmp(entry.tag, tag, TAG_SIZE) == 0) {
+      std::memcpy(key.key, entry.key, SencKey::KEY_SIZE);
+      std::memcpy(key.iv, entry.iv, SencKey::IV_SIZE);
+      entry.lastUsed = now;
+      found = true;
+    }
+  }
+  OPENSSL_cleanse(tag, sizeof(tag));
+  return found;
+}
+
+void SencKeyCache::insert(const SencArchive &archive,
+                          const std::string &password, const SencKey &key) {
+  std::lock_guard<std::mutex> lock(mutex);
+  unsigned char tag[TAG_SIZE];
+  if (capacity == 0 || !ensureStorage() ||
+      !makeTag(archive, password, tag)) {
+    return;
+  }
+
+  Clock::time_point now = Clock::now();
+  expire(now);
+  // Reuse the matching entry, else a free one, else the least recently used
+  Entry *table = entries();
+  Entry *slot = nullptr;
+  for (size_t i = 0; i < capacity; ++i) {
+    Entry &entry = table[i];
+    if (entry.used && CRYPTO_memcmp(entry.tag, tag, TAG_SIZE) == 0) {
+      slot = &entry;
+      break;
+    }
+    if (!slot || (slot->used && (!entry.used ||
+                                 entry.lastUsed < slot->lastUsed))) {
+      slot = &entry;
+    }
+  }
+
+  std::memcpy(slot->tag, tag, TAG_SIZE);
+  std::memcpy(slot->key, key.key, SencKey::KEY_SIZE);
+  std::memcpy(slot->iv, key.iv, SencKey::IV_SIZE);
+  slot->lastUsed = now;
+  slot->used = true;
+  OPENSSL_cleanse(tag, sizeof(tag));
+}
+
+void SencKeyCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  // SecureBuffer zeroes the secret and every entry before unmapping
+  storage.clear();
+}
+
+size_t SencKeyCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (storage.empty()) {
+    return 0;
+  }
+  const Entry *table =
+      reinterpret_cast<const Entry *>(storage.data() + SECRET_SIZE);
+  size_t count = 0;
+  for (size_t i = 0; i < capacity; ++i) {
+    count += table[i].used ? 1 : 0;
+  }
+  return count;
+}
+
+bool SencKeyCache::ensureStorage() {
+  if (!storage.empty()) {
+    return true;
+  }
+  // Fresh anonymous pages are zeroed, so every entry starts out unused
+  if (!storage.allocate(SECRET_SIZE + capacity * sizeof(Entry))) {
+    return false;
+  }
+  if (RAND_bytes(storage.data(), SECRET_SIZE) != 1) {
+    storage.clear();
+    return false;
+  }
+  return true;
+}
+
+bool SencKeyCache::makeTag(const SencArchive &archive,
+                           const std::string &password,
+                           unsigned char *tag) const {
+  std::string context = archive.kdfContext();
+  if (context.empty()) {
+    return false;
+  }
+
+  // The context length goes first so (context, password) splits can't collide
+  std::string length = std::to_string(context.size()) + ":";
+  std::string message;
+  message.reserve(length.size() + context.size() + password.size());
+  message += length;
+  message += context;
+  message += password;
+  unsigned int tagSize = 0;
+  bool ok = HMAC(SencCrypto::sha256(), storage.data(),
+                 static_cast<int>(SECRET_SIZE),
+                 reinterpret_cast<const unsigned char *>(message.data()),
+                 message.size(), tag, &tagSize) != nullptr &&
+            tagSize == TAG_SIZE;
+  OPENSSL_cleanse(&message[0], message.size());
+  return ok;
+}
+
+SencKeyCache::Entry *SencKeyCache::entries() {
+  return reinterpret_cast<Entry *>(storage.data() + SECRET_SIZE);
+}
+
+void SencKeyCache::expire(Clock::time_point now) {
+  Entry *table = entries();
+  for (size_t i = 0; i < capacity; ++i) {
+    Entry &entry = table[i];
+    if (entry.used && now - entry.lastUsed >= timeToLive) {
+      OPENSSL_cleanse(&entry, sizeof(entry));
+    }
+  }
+}
@@ -0,0 +1,64 @@
+#ifndef SENCKEYCACHE_H
+#define SENCKEYCACHE_H
+
+#include "SecureBuffer.h"
+#include "SencArchive.h"
+#include <chrono>
+#include <mutex>
+#include <string>
+
+// Bounded cache of derived keys, so reopening an archive (or a sibling
+// written with the same salt) skips PBKDF2.
+//
+// Entries are looked up by HMAC-SHA256(kdfContext || password) under a random
+// per-process secret; the password itself is never stored. Entries and the
+// secret live in one locked SecureBuffer, expire `timeToLive` after their last
+// use, and are all wiped by clear(). Thread-safe.
+class SencKeyCache {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit SencKeyCache(size_t capacity = DEFAULT_CAPACITY);
+  ~SencKeyCache();
+  SencKeyCache(const SencKeyCache &) = delete;
+  SencKeyCache &operator=(const SencKeyCache &) = delete;
+
+  void setTimeToLive(std::chrono::milliseconds ttl);
+
+  // Uses the cached key for the archive when there is one, otherwise derives
+  // it. Only keys that went on to decrypt something should be insert()ed.
+  bool deriveKey(const SencArchive &archive, const std::string &password,
+                 SencKey &key, std::string &error);
+  bool lookup(const SencArchive &archive, const std::string &password,
+              SencKey &key);
+  void insert(const SencArchive &archive, const std::string &password,
+              const SencKey &key);
+  void clear();
+  size_t size() const;
+
+  static constexpr size_t DEFAULT_CAPACITY = 64;
+  static constexpr size_t TAG_SIZE = 32;
+
+private:
+  // Plain bytes so entries can live directly in the locked buffer
+  struct Entry {
+    unsigned char tag[TAG_SIZE];
+    unsigned char key[SencKey::KEY_SIZE];
+    unsigned char iv[SencKey::IV_SIZE];
+    Clock::time_point lastUsed;
+    bool used;
+  };
+
+  bool ensureStorage();
+  bool makeTag(const SencArchive &archive, const std::string &password,
+               unsigned char *tag) const;
+  Entry *entries();
+  void expire(Clock::time_point now);
+
+  mutable std::mutex mutex;
+  SecureBuffer storage; // secret followed by `capacity` entries
+  size_t capacity;
+  std::chrono::milliseconds timeToLive{10 * 60 * 1000};
+};
+
+#endif // SENCKEYCACHE_H
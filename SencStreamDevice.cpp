@@ -0,0 +1,152 @@
+#include "SencStreamDevice.h"
+#include <QMutexLocker>
+#include <cstring>
+
+SencStreamDevice::SencStreamDevice(std::unique_ptr<SencArchive> archive,
+                                   const SencKey &key,
+                                   const SencLayout &layout, QObject *parent)
+    : QIODevice(parent), archive(std::move(archive)), key(key),
+      layout(layout) {
+  // Read-ahead only needs to stay a few chunks in front of the player
+  prefetchPool.setMaxThreadCount(2);
+}
+
+SencStreamDevice::~SencStreamDevice() {
+  closing = true;
+  prefetchPool.clear();
+  prefetchPool.waitForDone();
+  QIODevice::close();
+
+  QMutexLocker lock(&cacheMutex);
+  cache.clear();
+  recentChunks.clear();
+  key.clear();
+}
+
+bool SencStreamDevice::open(OpenMode mode) {
+  if (mode & (QIODevice::WriteOnly | QIODevice::Append)) {
+    setErrorString("SencStreamDevice is read-only");
+    return false;
+  }
+  // QIODevice's own buffer would keep another plaintext copy around
+  return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+qint64 SencStreamDevice::size() const {
+  return static_cast<qint64>(layout.contentSize);
+}
+
+QString SencStreamDevice::originalName() const {
+  return QString::fromStdString(layout.originalName);
+}
+
+qint64 SencStreamDevice::readData(char *data, qint64 maxSize) {
+  quint64 chunkSize = archive->chunkSize();
+  qint64 remaining = qMin(maxSize, size() - pos());
+  qint64 total = 0;
+  quint64 lastIndex = 0;
+
+  while (total < remaining) {
+    quint64 offset = layout.contentOffset + pos() + total;
+    quint64 index = offset / chunkSize;
+    size_t within = offset % chunkSize;
+
+    std::string error;
+    Chunk current = chunk(index, error);
+    if (!current) {
+      setErrorString(QString::fromStdString(error));
+      return total > 0 ? total : -1;
+    }
+    if (within >= current->size()) {
+      break;
+    }
+
+    qint64 count =
+        qMin<qint64>(remaining - total, current->size() - within);
+    std::memcpy(data + total, current->data() + within,
+                static_cast<size_t>(count));
+    total += count;
+    lastIndex = index;
+  }
+
+  if (total > 0) {
+    prefetchFrom(lastIndex + 1);
+  }
+  return total;
+}
+
+qint64 SencStreamDevice::writeData([[maybe_unused]] const char *data,
+                                   [[maybe_unused]] qint64 maxSize) {
+  return -1;
+}
+
+SencStreamDevice::Chunk SencStreamDevice::chunk(quint64 index,
+                                                std::string &error) {
+  {
+    QMutexLocker lock(&cacheMutex);
+    auto it = cache.constFind(index);
+    if (it != cache.constEnd()) {
+      recentChunks.removeOne(index);
+      recentChunks.append(index);
+      return it.value();
+    }
+  }
+
+  // Cache miss (usually a seek): decrypt on the caller's thread
+  Chunk decrypted = decryptChunk(index, error);
+  if (decrypted) {
+    insertChunk(index, decrypted);
+  }
+  return decrypted;
+}
+
+SencStreamDevice::Chunk
+SencStreamDevice::decryptChunk(quint64 index, std::string &error) const {
+  auto buffer = std::make_shared<SecureBuffer>();
+  size_t written = 0;
+  if (!buffer->allocate(archive->chunkSize())) {
+    error = "Out of memory for decrypted data";
+    return nullptr;
+  }
+  if (!archive->decryptChunk(key, index, buffer->data(), written, error)) {
+    return nullptr;
+  }
+  buffer->resize(written);
+  return buffer;
+}
+
+void SencStreamDevice::insertChunk(quint64 index, const Chunk &chunk) {
+  QMutexLocker lock(&cacheMutex);
+  if (!cache.contains(index)) {
+    recentChunks.append(index);
+  }
+  cache.insert(index, chunk);
+  while (recentChunks.size() > CACHE_CHUNKS) {
+    cache.remove(recentChunks.takeFirst());
+  }
+}
+
+void SencStreamDevice::prefetchFrom(quint64 index) {
+  quint64 end = qMin<quint64>(index + READ_AHEAD_CHUNKS, archive->chunkCount());
+  for (quint64 i = index; i < end; ++i) {
+    {
+      QMutexLocker lock(&cacheMutex);
+      if (cache.contains(i) || pendingChunks.contains(i)) {
+        continue;
+      }
+      pendingChunks.insert(i);
+    }
+
+    prefetchPool.start([this, i]() {
+      if (!closing) {
+        std::string error;
+        Chunk decrypted = decryptChunk(i, error);
+        if (decrypted && !closing) {
+          insertChunk(i, decrypted);
+        }
+      }
+      QMutexLocker lock(&cacheMutex);
+      pendingChunks.remove(i);
+    });
+  }
+}
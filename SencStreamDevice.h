@@ -0,0 +1,60 @@
+#ifndef SENCSTREAMDEVICE_H
+#define SENCSTREAMDEVICE_H
+
+#include "SencArchive.h"
+#include <QHash>
+#include <QIODevice>
+#include <QList>
+#include <QMutex>
+#include <QSet>
+#include <QThreadPool>
+#include <atomic>
+#include <memory>
+
+// Random-access QIODevice that decrypts an archive lazily, one chunk at a
+// time, as the consumer reads and seeks. Decrypted chunks live in a small LRU
+// of locked buffers, and the chunks after the last read are decrypted ahead
+// of time on a worker thread so sequential playback rarely waits.
+class SencStreamDevice : public QIODevice {
+  Q_OBJECT
+
+public:
+  // Takes ownership of an opened archive; `layout` comes from readLayout()
+  SencStreamDevice(std::unique_ptr<SencArchive> archive, const SencKey &key,
+                   const SencLayout &layout, QObject *parent = nullptr);
+  ~SencStreamDevice();
+
+  bool open(OpenMode mode) override;
+  bool isSequential() const override { return false; }
+  qint64 size() const override;
+
+  QString originalName() const;
+
+  static constexpr int CACHE_CHUNKS = 16;
+  static constexpr int READ_AHEAD_CHUNKS = 4;
+
+protected:
+  qint64 readData(char *data, qint64 maxSize) override;
+  qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+  using Chunk = std::shared_ptr<SecureBuffer>;
+
+  Chunk chunk(quint64 index, std::string &error);
+  Chunk decryptChunk(quint64 index, std::string &error) const;
+  void insertChunk(quint64 index, const Chunk &chunk);
+  void prefetchFrom(quint64 index);
+
+  std::unique_ptr<SencArchive> archive;
+  SencKey key;
+  SencLayout layout;
+
+  QMutex cacheMutex;
+  QHash<quint64, Chunk> cache;
+  QList<quint64> recentChunks; // least recently used first
+  QSet<quint64> pendingChunks;
+  QThreadPool prefetchPool;
+  std::atomic<bool> closing{false};
+};
+
+#endif // SENCSTREAMDEVICE_H
@@ -0,0 +1,175 @@
+// senc-native: command line front end for the native .senc engine.
+//
+//   senc-native encrypt <input_file>    writes <input_file>.senc (v2)
+//   senc-native encrypt --v1 <input>    the same as v1, readable by openssl
+//   senc-native decrypt <archive.senc>  extracts next to the archive
+//   senc-native info                    prints the crypto kernels in use
+//
+// Passwords are read from the terminal with echo off, or one per line from
+// stdin when it isn't a terminal (SecureViewer pipes them in that way).
+#include "SencArchive.h"
+#include "SencCrypto.h"
+#include "SencWriter.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <openssl/crypto.h>
+#include <string>
+#include <termios.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+bool readPassword(const char *prompt, std::string &password) {
+  bool tty = isatty(STDIN_FILENO);
+  termios saved{};
+  if (tty) {
+    std::cout << prompt << std::flush;
+    tcgetattr(STDIN_FILENO, &saved);
+    termios silent = saved;
+    silent.c_lflag &= ~ECHO;
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &silent);
+  }
+  bool ok = static_cast<bool>(std::getline(std::cin, password));
+  if (tty) {
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved);
+    std::cout << std::endl;
+  }
+  return ok;
+}
+
+int encrypt(const fs::path &input, bool v1) {
+  fs::path output = input.string() + ".senc";
+  if (!fs::is_regular_file(input)) {
+    std::cerr << "Error: Input file '" << input.string()
+              << "' does not exist." << std::endl;
+    return 1;
+  }
+  if (fs::exists(output)) {
+    std::cerr << "Error: Output file '" << output.string()
+              << "' already exists." << std::endl;
+    return 1;
+  }
+
+  std::string password, verify;
+  if (!readPassword("Enter encryption password: ", password) ||
+      !readPassword("Verify encryption password: ", verify)) {
+    std::cerr << "Error: No password given." << std::endl;
+    return 1;
+  }
+  if (password != verify) {
+    std::cerr << "Error: Passwords do not match. Original file preserved."
+              << std::endl;
+    return 1;
+  }
+
+  SencWriter writer;
+  SencMetadata metadata;
+  metadata.originalName = input.filename().string();
+  metadata.mimeType = SencWriter::mimeTypeFor(metadata.originalName);
+  std::string error;
+  bool written =
+      v1 ? writer.encryptV1(input, output, metadata.originalName, password,
+                            error)
+         : writer.encryptV2(input, output, metadata, password, error);
+  OPENSSL_cleanse(&password[0], password.size());
+  OPENSSL_cleanse(&verify[0], verify.size());
+  if (!written) {
+    std::cerr << "Error: " << error << ". Original file preserved."
+              << std::endl;
+    return 1;
+  }
+
+  std::cout << "Self-decrypting archive created as '" << output.string()
+            << "'" << std::endl;
+  // Same contract as bin/senc: the plaintext original goes away on success
+  fs::remove(input);
+  return 0;
+}
+
+int decrypt(const fs::path &archivePath) {
+  SencArchive archive;
+  std::string error;
+  if (!archive.open(archivePath, error)) {
+    std::cerr << "Error: " << error << std::endl;
+    return 1;
+  }
+  if (archive.format() == SencArchive::Format::Unknown) {
+    std::cerr << "Error: Unsupported archive format" << std::endl;
+    return 1;
+  }
+
+  std::string password;
+  if (!readPassword("Enter decryption password: ", password)) {
+    std::cerr << "Error: No password given." << std::endl;
+    return 1;
+  }
+
+  SencPlaintext plaintext;
+  if (!archive.decrypt(password, plaintext, error)) {
+    std::cerr << "Error: " << error << std::endl;
+    return 1;
+  }
+
+  fs::path name = fs::path(plaintext.originalName).filename();
+  if (name.empty()) {
+    name = archivePath.stem();
+  }
+  fs::path outputPath = archivePath.parent_path() / name;
+  std::cout << "Decrypting to: " << outputPath.string() << std::endl;
+
+  int fd = ::open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0666);
+  bool ok = fd >= 0;
+  const unsigned char *p = plaintext.content();
+  size_t remaining = plaintext.contentSize();
+  while (ok && remaining > 0) {
+    ssize_t n = ::write(fd, p, remaining);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    ok = n > 0;
+    if (ok) {
+      p += n;
+      remaining -= n;
+    }
+  }
+  if (fd >= 0 && ::close(fd) != 0) {
+    ok = false;
+  }
+  if (!ok) {
+    std::cerr << "Error: Failed to write " << outputPath.string() << ": "
+              << std::strerror(errno) << std::endl;
+    fs::remove(outputPath);
+    return 1;
+  }
+
+  std::cout << "File successfully decrypted" << std::endl;
+  return 0;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc == 3 && std::strcmp(argv[1], "encrypt") == 0) {
+    return encrypt(argv[2], false);
+  }
+  if (argc == 4 && std::strcmp(argv[1], "encrypt") == 0 &&
+      std::strcmp(argv[2], "--v1") == 0) {
+    return encrypt(argv[3], true);
+  }
+  if (argc == 3 && std::strcmp(argv[1], "decrypt") == 0) {
+    return decrypt(argv[2]);
+  }
+  if (argc == 2 && std::strcmp(argv[1], "info") == 0) {
+    std::cout << "AES kernels: " << SencCrypto::kernelDescription() << "\n"
+              << "libcrypto: " << OpenSSL_version(OPENSSL_VERSION)
+              << std::endl;
+    return 0;
+  }
+  std::cerr << "Usage: " << argv[0] << " encrypt [--v1] <input_file>\n"
+            << "       " << argv[0] << " decrypt <archive.senc>\n"
+            << "       " << argv[0] << " info" << std::endl;
+  return 1;
+}
@@ -0,0 +1,491 @@
+#include "SencWriter.h"
+#include "SecureBuffer.h"
+#include "SencArchive.h"
+#include "SencCrypto.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+// Byte for byte what bin/senc has always written, so v1 archives made here
+// still decrypt with nothing but zsh and openssl
+const char V1_SCRIPT_HEADER[] = R"SENC(#!/bin/zsh
+#
+# Secure self-decrypting archive
+# This script is designed to safely decrypt its own contents
+# 
+# Usage: ./filename.senc
+#
+
+# Verify we're running on macOS or Linux
+if [[ "$(uname)" != "Darwin" && "$(uname)" != "Linux" ]]; then
+    echo "This script requires macOS or Linux"
+    exit 1
+fi
+
+# Verify openssl is available
+if ! command -v openssl > /dev/null; then
+    echo "Error: openssl command not found"
+    exit 1
+fi
+
+# Find the line number where the encrypted data begins
+SCRIPT_END=$(awk '/^__ENCRYPTED_DATA_BELOW__/ { print NR; exit 0; }' "$0")
+
+if [[ -z "$SCRIPT_END" ]]; then
+    echo "Error: Invalid archive format"
+    exit 1
+fi
+
+# Create a secure temporary directory
+if command -v mktemp > /dev/null; then
+    TEMP_DIR=$(mktemp -d)
+else
+    echo "Error: mktemp command not found"
+    exit 1
+fi
+
+cleanup() {
+    rm -rf "$TEMP_DIR"
+}
+trap cleanup EXIT
+
+# Extract the encrypted data
+tail -n +$((SCRIPT_END + 1)) "$0" > "$TEMP_DIR/data.enc"
+
+# Decrypt all content at once to a temporary file
+DECRYPTED_FILE="$TEMP_DIR/decrypted_data"
+if ! openssl enc -d -aes-256-cbc -pbkdf2 -in "$TEMP_DIR/data.enc" -out "$DECRYPTED_FILE"; then
+    echo "Error: Decryption failed - incorrect password?"
+    exit 1
+fi
+
+# Get the original filename from the first line and combine with current directory
+ORIGINAL_NAME=$(head -n 1 "$DECRYPTED_FILE")
+OUTPUT_PATH="$(dirname "$0")/$ORIGINAL_NAME"
+echo "Decrypting to: $OUTPUT_PATH"
+
+# Extract the actual content (everything after the first line)
+tail -n +2 "$DECRYPTED_FILE" > "$OUTPUT_PATH"
+
+if [[ $? -eq 0 && -s "$OUTPUT_PATH" ]]; then
+    echo "File successfully decrypted"
+    exit 0
+else
+    echo "Error: Decryption failed"
+    [[ -f "$OUTPUT_PATH" ]] && rm "$OUTPUT_PATH"
+    exit 1
+fi
+
+)SENC";
+
+// v2 payloads can't be opened by `openssl enc`, so the embedded script hands
+// the archive to the native tool instead.
+const char V2_SCRIPT_HEADER[] = R"SENC(#!/bin/zsh
+#
+# Secure self-decrypting archive (senc v2)
+# The payload is AES-256-GCM in independently authenticated chunks, which
+# openssl enc can't read, so decryption is done by senc-native.
+#
+# Usage: ./filename.senc
+#
+
+SENC_NATIVE="$(command -v senc-native)"
+BUNDLED="/Applications/SecureViewer.app/Contents/MacOS/bin/senc-native"
+if [[ -z "$SENC_NATIVE" && -x "$BUNDLED" ]]; then
+    SENC_NATIVE="$BUNDLED"
+fi
+
+if [[ -z "$SENC_NATIVE" ]]; then
+    echo "Error: senc-native not found (it ships with SecureViewer)"
+    exit 1
+fi
+
+exec "$SENC_NATIVE" decrypt "$0"
+
+)SENC";
+
+void storeLE32(unsigned char *p, uint32_t v) {
+  p[0] = static_cast<unsigned char>(v);
+  p[1] = static_cast<unsigned char>(v >> 8);
+  p[2] = static_cast<unsigned char>(v >> 16);
+  p[3] = static_cast<unsigned char>(v >> 24);
+}
+
+void storeLE64(unsigned char *p, uint64_t v) {
+  storeLE32(p, static_cast<uint32_t>(v));
+  storeLE32(p + 4, static_cast<uint32_t>(v >> 32));
+}
+
+bool writeAll(int fd, const void *data, size_t size) {
+  auto *p = static_cast<const unsigned char *>(data);
+  while (size > 0) {
+    ssize_t n = ::write(fd, p, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+size_t readFull(int fd, unsigned char *data, size_t size) {
+  size_t total = 0;
+  while (total < size) {
+    ssize_t n = ::read(fd, data + total, size - total);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    total += n;
+  }
+  return total;
+}
+
+// Seals `in` with the header as AAD and appends the tag after the ciphertext
+bool gcmSeal(EVP_CIPHER_CTX *ctx, const unsigned char *header, uint32_t index,
+             const unsigned char *in, size_t inSize, unsigned char *out) {
+  unsigned char nonce[SencArchive::V2_NONCE_SIZE];
+  std::memcpy(nonce, header + 48, SencArchive::V2_NONCE_PREFIX_SIZE);
+  nonce[8] = static_cast<unsigned char>(index >> 24);
+  nonce[9] = static_cast<unsigned char>(index >> 16);
+  nonce[10] = static_cast<unsigned char>(index >> 8);
+  nonce[11] = static_cast<unsigned char>(index);
+
+  int outLen = 0;
+  int finalLen = 0;
+  return EVP_EncryptInit_ex(ctx, nullptr, nullptr, nullptr, nonce) == 1 &&
+         EVP_EncryptUpdate(ctx, nullptr, &outLen, header,
+                           SencArchive::V2_HEADER_SIZE) == 1 &&
+         EVP_EncryptUpdate(ctx, out, &outLen, in, static_cast<int>(inSize)) ==
+             1 &&
+         EVP_EncryptFinal_ex(ctx, out + outLen, &finalLen) == 1 &&
+         EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG,
+                             SencArchive::V2_TAG_SIZE, out + inSize) == 1;
+}
+} // namespace
+
+std::string SencWriter::mimeTypeFor(const std::string &name) {
+  // The types the viewer has a dedicated viewer for, plus common documents
+  static const std::pair<const char *, const char *> types[] = {
+      {".png", "image/png"},        {".jpg", "image/jpeg"},
+      {".jpeg", "image/jpeg"},      {".gif", "image/gif"},
+      {".bmp", "image/bmp"},        {".webp", "image/webp"},
+      {".mp4", "video/mp4"},        {".m4v", "video/x-m4v"},
+      {".mov", "video/quicktime"},  {".avi", "video/x-msvideo"},
+      {".mkv", "video/x-matroska"}, {".webm", "video/webm"},
+      {".mp3", "audio/mpeg"},       {".m4a", "audio/mp4"},
+      {".wav", "audio/wav"},        {".pdf", "application/pdf"},
+      {".txt", "text/plain"},       {".md", "text/markdown"},
+      {".csv", "text/csv"},         {".json", "application/json"},
+      {".html", "text/html"},       {".zip", "application/zip"},
+  };
+  std::string extension = fs::path(name).extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  for (const auto &[suffix, type] : types) {
+    if (extension == suffix) {
+      return type;
+    }
+  }
+  return std::string();
+}
+
+bool SencWriter::shareKey(const std::string &password, std::string &error) {
+  static_assert(sizeof(sharedSalt) == SencArchive::V2_SALT_SIZE);
+  sharedKey.clear();
+  if (iterations == 0) {
+    error = "Invalid encryption settings";
+    return false;
+  }
+  if (RAND_bytes(sharedSalt, sizeof(sharedSalt)) != 1) {
+    error = "Failed to generate random salt";
+    return false;
+  }
+  if (!sharedKey.allocate(SencKey::KEY_SIZE) ||
+      PKCS5_PBKDF2_HMAC(password.data(), static_cast<int>(password.size()),
+                        sharedSalt, sizeof(sharedSalt),
+                        static_cast<int>(iterations), SencCrypto::sha256(),
+                        SencKey::KEY_SIZE, sharedKey.data()) != 1) {
+    sharedKey.clear();
+    error = "Key derivation failed";
+    return false;
+  }
+  sharedIterations = iterations;
+  return true;
+}
+
+bool SencWriter::encryptV1(const fs::path &input, const fs::path &output,
+                           const std::string &originalName,
+                           const std::string &password,
+                           std::string &error) const {
+  if (originalName.empty() || originalName.find('\n') != std::string::npos) {
+    error = "Invalid original file name";
+    return false;
+  }
+  int in = ::open(input.c_str(), O_RDONLY | O_CLOEXEC);
+  if (in < 0) {
+    error = "Failed to open " + input.string() + ": " + std::strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (fstat(in, &st) != 0 || !S_ISREG(st.st_mode)) {
+    ::close(in);
+    error = "Input '" + input.string() + "' is not a regular file";
+    return false;
+  }
+
+  // What `openssl enc -aes-256-cbc -salt -pbkdf2` does: key and IV from one
+  // PBKDF2-HMAC-SHA256 call, salt stored after "Salted__"
+  unsigned char salt[SencArchive::V1_SALT_SIZE];
+  unsigned char keyIv[SencKey::KEY_SIZE + SencKey::IV_SIZE];
+  if (RAND_bytes(salt, sizeof(salt)) != 1) {
+    ::close(in);
+    error = "Failed to generate random salt";
+    return false;
+  }
+  if (PKCS5_PBKDF2_HMAC(password.data(), static_cast<int>(password.size()),
+                        salt, sizeof(salt), SencArchive::V1_PBKDF2_ITERATIONS,
+                        SencCrypto::sha256(), sizeof(keyIv), keyIv) != 1) {
+    ::close(in);
+    error = "Key derivation failed";
+    return false;
+  }
+  EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+  bool ok = ctx && EVP_EncryptInit_ex(ctx, SencCrypto::aes256Cbc(), nullptr,
+                                      keyIv, keyIv + SencKey::KEY_SIZE) == 1;
+  OPENSSL_cleanse(keyIv, sizeof(keyIv));
+
+  int out = ok ? ::open(output.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                        0755)
+               : -1;
+  if (out < 0) {
+    EVP_CIPHER_CTX_free(ctx);
+    ::close(in);
+    error = ok ? "Failed to create " + output.string() + ": " +
+                     std::strerror(errno)
+               : "Failed to initialise cipher";
+    return false;
+  }
+
+  std::string preamble = std::string(V1_SCRIPT_HEADER) +
+                         SencArchive::DATA_MARKER + "\n" + "Salted__" +
+                         std::string(reinterpret_cast<char *>(salt),
+                                     sizeof(salt));
+  ok = writeAll(out, preamble.data(), preamble.size());
+
+  // Plaintext is read once, straight into page-aligned buffers, and each
+  // block is written as soon as it is sealed; nothing is staged on disk
+  SecureBuffer plain;
+  SecureBuffer sealed;
+  ok = ok && plain.allocate(V1_BLOCK_SIZE) &&
+       sealed.allocate(V1_BLOCK_SIZE + EVP_MAX_BLOCK_LENGTH);
+  int sealedLen = 0;
+  std::string nameLine = originalName + "\n";
+  ok = ok &&
+       EVP_EncryptUpdate(
+           ctx, sealed.data(), &sealedLen,
+           reinterpret_cast<const unsigned char *>(nameLine.data()),
+           static_cast<int>(nameLine.size())) == 1 &&
+       writeAll(out, sealed.data(), sealedLen);
+  uint64_t total = 0;
+  while (ok) {
+    size_t n = readFull(in, plain.data(), V1_BLOCK_SIZE);
+    total += n;
+    ok = n == 0 ||
+         (EVP_EncryptUpdate(ctx, sealed.data(), &sealedLen, plain.data(),
+                            static_cast<int>(n)) == 1 &&
+          writeAll(out, sealed.data(), sealedLen));
+    if (n < V1_BLOCK_SIZE) {
+      break;
+    }
+  }
+  // A short read is either the end or an error; only the size tells which
+  if (ok && total != static_cast<uint64_t>(st.st_size)) {
+    error = "Input changed while encrypting";
+    ok = false;
+  }
+  ok = ok && EVP_EncryptFinal_ex(ctx, sealed.data(), &sealedLen) == 1 &&
+       writeAll(out, sealed.data(), sealedLen);
+
+  EVP_CIPHER_CTX_free(ctx);
+  ::close(in);
+  // One flush, once everything is written
+  if (ok && ::fsync(out) != 0) {
+    ok = false;
+  }
+  if (::close(out) != 0) {
+    ok = false;
+  }
+  if (!ok) {
+    if (error.empty()) {
+      error = "Failed to write " + output.string();
+    }
+    ::unlink(output.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool SencWriter::encryptV2(const fs::path &input, const fs::path &output,
+                           const SencMetadata &fields,
+                           const std::string &password,
+                           std::string &error) const {
+  if (chunkSize < SencArchive::V2_MIN_CHUNK_SIZE ||
+      chunkSize > SencArchive::V2_MAX_CHUNK_SIZE || iterations == 0) {
+    error = "Invalid encryption settings";
+    return false;
+  }
+
+  int in = ::open(input.c_str(), O_RDONLY | O_CLOEXEC);
+  if (in < 0) {
+    error = "Failed to open " + input.string() + ": " + std::strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (fstat(in, &st) != 0 || !S_ISREG(st.st_mode)) {
+    ::close(in);
+    error = "Input '" + input.string() + "' is not a regular file";
+    return false;
+  }
+  uint64_t contentSize = static_cast<uint64_t>(st.st_size);
+  uint64_t chunks = std::max<uint64_t>(1, (contentSize + chunkSize - 1) /
+                                              chunkSize);
+  if (chunks >= SencArchive::V2_METADATA_INDEX) {
+    ::close(in);
+    error = "Input is too large for the chunk size";
+    return false;
+  }
+
+  // Metadata block: u16 type, u32 length, value
+  std::vector<unsigned char> metadata;
+  auto addField = [&metadata](uint16_t type, const std::string &value) {
+    size_t at = metadata.size();
+    metadata.resize(at + 6 + value.size());
+    metadata[at] = static_cast<unsigned char>(type & 0xff);
+    metadata[at + 1] = static_cast<unsigned char>(type >> 8);
+    storeLE32(metadata.data() + at + 2, static_cast<uint32_t>(value.size()));
+    std::memcpy(metadata.data() + at + 6, value.data(), value.size());
+  };
+  addField(SencArchive::V2_META_ORIGINAL_NAME, fields.originalName);
+  if (!fields.mimeType.empty()) {
+    addField(SencArchive::V2_META_MIME_TYPE, fields.mimeType);
+  }
+
+  unsigned char header[SencArchive::V2_HEADER_SIZE] = {};
+  std::memcpy(header, SencArchive::V2_MAGIC, sizeof(SencArchive::V2_MAGIC));
+  storeLE32(header + 8, SencArchive::V2_HEADER_SIZE);
+  storeLE32(header + 12, static_cast<uint32_t>(chunkSize));
+  bool shared = !sharedKey.empty();
+  storeLE32(header + 16, shared ? sharedIterations : iterations);
+  storeLE32(header + 20, static_cast<uint32_t>(metadata.size() +
+                                               SencArchive::V2_TAG_SIZE));
+  storeLE64(header + 24, contentSize);
+  if (shared) {
+    std::memcpy(header + 32, sharedSalt, SencArchive::V2_SALT_SIZE);
+  }
+  if ((!shared && RAND_bytes(header + 32, SencArchive::V2_SALT_SIZE) != 1) ||
+      RAND_bytes(header + 48, SencArchive::V2_NONCE_PREFIX_SIZE) != 1) {
+    ::close(in);
+    error = "Failed to generate random salt";
+    return false;
+  }
+
+  unsigned char key[SencKey::KEY_SIZE];
+  if (shared) {
+    std::memcpy(key, sharedKey.data(), sizeof(key));
+  } else if (PKCS5_PBKDF2_HMAC(
+                 password.data(), static_cast<int>(password.size()),
+                 header + 32, SencArchive::V2_SALT_SIZE,
+                 static_cast<int>(iterations), SencCrypto::sha256(),
+                 sizeof(key), key) != 1) {
+    ::close(in);
+    error = "Key derivation failed";
+    return false;
+  }
+  EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+  bool ok = ctx && EVP_EncryptInit_ex(ctx, SencCrypto::aes256Gcm(), nullptr,
+                                      key, nullptr) == 1;
+  OPENSSL_cleanse(key, sizeof(key));
+
+  int out = ok ? ::open(output.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                        0755)
+               : -1;
+  if (out < 0) {
+    EVP_CIPHER_CTX_free(ctx);
+    ::close(in);
+    error = ok ? "Failed to create " + output.string() + ": " +
+                     std::strerror(errno)
+               : "Failed to initialise cipher";
+    return false;
+  }
+
+  std::string preamble =
+      std::string(V2_SCRIPT_HEADER) + SencArchive::DATA_MARKER + "\n";
+  ok = writeAll(out, preamble.data(), preamble.size()) &&
+       writeAll(out, header, sizeof(header));
+
+  std::vector<unsigned char> sealedMeta(metadata.size() +
+                                        SencArchive::V2_TAG_SIZE);
+  ok = ok && gcmSeal(ctx, header, SencArchive::V2_METADATA_INDEX,
+                     metadata.data(), metadata.size(), sealedMeta.data()) &&
+       writeAll(out, sealedMeta.data(), sealedMeta.size());
+  OPENSSL_cleanse(metadata.data(), metadata.size());
+
+  SecureBuffer plain;
+  std::vector<unsigned char> sealed(chunkSize + SencArchive::V2_TAG_SIZE);
+  ok = ok && plain.allocate(chunkSize);
+  uint64_t remaining = contentSize;
+  for (uint64_t i = 0; ok && i < chunks; ++i) {
+    size_t want = std::min<uint64_t>(remaining, chunkSize);
+    if (readFull(in, plain.data(), want) != want) {
+      error = "Input changed while encrypting";
+      ok = false;
+      break;
+    }
+    ok = gcmSeal(ctx, header, static_cast<uint32_t>(i), plain.data(), want,
+                 sealed.data()) &&
+         writeAll(out, sealed.data(), want + SencArchive::V2_TAG_SIZE);
+    remaining -= want;
+  }
+  // Anything left means the file grew after we sized the header
+  unsigned char probe;
+  if (ok && readFull(in, &probe, 1) != 0) {
+    error = "Input changed while encrypting";
+    ok = false;
+  }
+
+  EVP_CIPHER_CTX_free(ctx);
+  ::close(in);
+  if (ok && ::fsync(out) != 0) {
+    ok = false;
+  }
+  if (::close(out) != 0) {
+    ok = false;
+  }
+
+  if (!ok) {
+    if (error.empty()) {
+      error = "Failed to write " + output.string();
+    }
+    ::unlink(output.c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,61 @@
+#ifndef SENCWRITER_H
+#define SENCWRITER_H
+
+#include "SecureBuffer.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+struct SencMetadata;
+
+// Native writer for .senc archives. See SencArchive.h for the layouts.
+class SencWriter {
+public:
+  static constexpr size_t DEFAULT_CHUNK_SIZE = 1024 * 1024;
+  static constexpr uint32_t DEFAULT_V2_ITERATIONS = 600000;
+
+  void setChunkSize(size_t size) { chunkSize = size; }
+  void setIterations(uint32_t count) { iterations = count; }
+
+  // Derives one key, over one salt, for every following encryptV2() call, so
+  // a batch pays for PBKDF2 once instead of per file (and readers with a key
+  // cache open the whole batch with one derivation as well). Each archive
+  // still gets its own random nonce prefix. The `password` passed to
+  // encryptV2() is ignored while a shared key is set.
+  bool shareKey(const std::string &password, std::string &error);
+  void clearSharedKey() { sharedKey.clear(); }
+
+  // Encrypts `input` into a new v1 archive at `output`, which must not
+  // exist: the bin/senc script header and `openssl enc -aes-256-cbc -pbkdf2`
+  // output over "<originalName>\n<content>", so it decrypts anywhere with
+  // zsh and openssl. Streams the input once and fsyncs once.
+  bool encryptV1(const std::filesystem::path &input,
+                 const std::filesystem::path &output,
+                 const std::string &originalName, const std::string &password,
+                 std::string &error) const;
+
+  // Encrypts `input` into a new v2 archive at `output`, which must not exist.
+  // The name and MIME type of `metadata` go into the encrypted metadata
+  // block; the size is taken from `input`.
+  bool encryptV2(const std::filesystem::path &input,
+                 const std::filesystem::path &output,
+                 const SencMetadata &metadata, const std::string &password,
+                 std::string &error) const;
+
+  // Best guess from the extension, for the metadata block; empty if unknown
+  static std::string mimeTypeFor(const std::string &name);
+
+private:
+  // Read and encryption block for v1; large enough that syscalls don't
+  // dominate
+  static constexpr size_t V1_BLOCK_SIZE = 4 * 1024 * 1024;
+
+  size_t chunkSize = DEFAULT_CHUNK_SIZE;
+  uint32_t iterations = DEFAULT_V2_ITERATIONS;
+  unsigned char sharedSalt[16] = {};
+  uint32_t sharedIterations = 0;
+  SecureBuffer sharedKey;
+};
+
+#endif // SENCWRITER_H
@@ -0,0 +1,331 @@
+#include "ThumbnailCache.h"
+#include "SencCrypto.h"
+#include <QBuffer>
+#include <QDir>
+#include <QImageReader>
+#include <QMutexLocker>
+#include <QPdfDocument>
+#include <QStandardPaths>
+#include <QtEndian>
+#include <cstring>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+ThumbnailCache::ThumbnailCache() {
+  QString cacheDir =
+      QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+  QDir().mkpath(cacheDir);
+  file.setFileName(cacheDir + "/thumbnails.bin");
+  openFile();
+}
+
+ThumbnailCache::~ThumbnailCache() {
+  lock();
+  if (mapping) {
+    file.unmap(mapping);
+  }
+  file.close();
+}
+
+bool ThumbnailCache::openFile() {
+  if (!file.open(QIODevice::ReadWrite | QIODevice::Unbuffered)) {
+    return false;
+  }
+
+  char header[HEADER_SIZE];
+  if (file.size() < HEADER_SIZE ||
+      file.read(header, HEADER_SIZE) != HEADER_SIZE ||
+      std::memcmp(header, MAGIC, sizeof(MAGIC)) != 0) {
+    salt.clear();
+    return startOver();
+  }
+  salt = QByteArray(header + 8, SALT_SIZE);
+  iterations = qFromLittleEndian<quint32>(header + 24);
+  scanRecords();
+  return true;
+}
+
+bool ThumbnailCache::startOver() {
+  // The salt survives unless there is none yet, so an unlocked key stays
+  // valid across a reset
+  if (mapping) {
+    file.unmap(mapping);
+    mapping = nullptr;
+    mappingSize = 0;
+  }
+  records.clear();
+  if (salt.size() != SALT_SIZE) {
+    salt.resize(SALT_SIZE);
+    iterations = KDF_ITERATIONS;
+    if (RAND_bytes(reinterpret_cast<unsigned char *>(salt.data()),
+                   SALT_SIZE) != 1) {
+      salt.clear();
+      return false;
+    }
+  }
+
+  char header[HEADER_SIZE] = {};
+  std::memcpy(header, MAGIC, sizeof(MAGIC));
+  std::memcpy(header + 8, salt.constData(), SALT_SIZE);
+  qToLittleEndian<quint32>(iterations, header + 24);
+  return file.resize(0) && file.seek(0) &&
+         file.write(header, HEADER_SIZE) == HEADER_SIZE;
+}
+
+void ThumbnailCache::scanRecords() {
+  if (!mapped(file.size())) {
+    return;
+  }
+
+  qint64 offset = HEADER_SIZE;
+  const qint64 fixed = 4 + ID_SIZE + NONCE_SIZE;
+  while (mappingSize - offset >= fixed) {
+    quint32 sealedSize = qFromLittleEndian<quint32>(mapping + offset);
+    if (sealedSize < TAG_SIZE || sealedSize > mappingSize - offset - fixed) {
+      break; // torn final record
+    }
+    QByteArray id(reinterpret_cast<const char *>(mapping + offset + 4),
+                  ID_SIZE);
+    records.insert(id, Record{offset + 4 + ID_SIZE, sealedSize});
+    offset += fixed + sealedSize;
+  }
+  if (offset != mappingSize) {
+    file.unmap(mapping);
+    mapping = nullptr;
+    mappingSize = 0;
+    file.resize(offset);
+  }
+}
+
+bool ThumbnailCache::mapped(qint64 end) const {
+  if (end > mappingSize) {
+    // Appends land past the old mapping; map the file as it is now
+    if (mapping) {
+      file.unmap(mapping);
+    }
+    mappingSize = file.size();
+    mapping = mappingSize > 0 ? file.map(0, mappingSize) : nullptr;
+    if (!mapping) {
+      mappingSize = 0;
+    }
+  }
+  return mapping && end <= mappingSize;
+}
+
+bool ThumbnailCache::unlock(const std::string &password) {
+  QByteArray saltCopy;
+  quint32 rounds;
+  {
+    QMutexLocker locker(&mutex);
+    saltCopy = salt;
+    rounds = iterations;
+  }
+  if (saltCopy.size() != SALT_SIZE) {
+    return false;
+  }
+
+  SecureBuffer derived;
+  if (!derived.allocate(2 * KEY_SIZE) ||
+      PKCS5_PBKDF2_HMAC(password.data(), static_cast<int>(password.size()),
+                        reinterpret_cast<const unsigned char *>(
+                            saltCopy.constData()),
+                        SALT_SIZE, static_cast<int>(rounds),
+                        SencCrypto::sha256(), 2 * KEY_SIZE,
+                        derived.data()) != 1) {
+    return false;
+  }
+
+  QMutexLocker locker(&mutex);
+  keys = std::move(derived);
+  return true;
+}
+
+void ThumbnailCache::lock() {
+  QMutexLocker locker(&mutex);
+  keys.clear();
+}
+
+bool ThumbnailCache::isUnlocked() const {
+  QMutexLocker locker(&mutex);
+  return !keys.empty();
+}
+
+QByteArray ThumbnailCache::idFor(const QString &path, qint64 lastModified,
+                                 qint64 size) const {
+  QByteArray message = path.toUtf8();
+  message.append('\0');
+  char stamp[16];
+  qToLittleEndian<qint64>(lastModified, stamp);
+  qToLittleEndian<qint64>(size, stamp + 8);
+  message.append(stamp, sizeof(stamp));
+
+  QByteArray id(ID_SIZE, Qt::Uninitialized);
+  unsigned int idSize = 0;
+  if (!HMAC(SencCrypto::sha256(), keys.data() + KEY_SIZE, KEY_SIZE,
+            reinterpret_cast<const unsigned char *>(message.constData()),
+            message.size(), reinterpret_cast<unsigned char *>(id.data()),
+            &idSize) ||
+      idSize != ID_SIZE) {
+    return QByteArray();
+  }
+  return id;
+}
+
+bool ThumbnailCache::contains(const QString &path, qint64 lastModified,
+                              qint64 size) const {
+  QMutexLocker locker(&mutex);
+  return !keys.empty() && records.contains(idFor(path, lastModified, size));
+}
+
+bool ThumbnailCache::find(const QString &path, qint64 lastModified,
+                          qint64 size, QImage &image) const {
+  QMutexLocker locker(&mutex);
+  if (keys.empty()) {
+    return false;
+  }
+  QByteArray id = idFor(path, lastModified, size);
+  auto it = records.constFind(id);
+  if (it == records.constEnd() ||
+      !mapped(it->offset + NONCE_SIZE + it->sealedSize)) {
+    return false;
+  }
+
+  const unsigned char *nonce = mapping + it->offset;
+  const unsigned char *sealed = nonce + NONCE_SIZE;
+  int plainSize = static_cast<int>(it->sealedSize) - TAG_SIZE;
+  SecureBuffer plain;
+  EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+  int outLen = 0;
+  int finalLen = 0;
+  bool ok =
+      ctx && plain.allocate(plainSize) &&
+      EVP_DecryptInit_ex(ctx, SencCrypto::aes256Gcm(), nullptr, keys.data(),
+                         nonce) == 1 &&
+      EVP_DecryptUpdate(ctx, nullptr, &outLen,
+                        reinterpret_cast<const unsigned char *>(id.constData()),
+                        ID_SIZE) == 1 &&
+      EVP_DecryptUpdate(ctx, plain.data(), &outLen, sealed, plainSize) == 1 &&
+      EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, TAG_SIZE,
+                          const_cast<unsigned char *>(sealed + plainSize)) ==
+          1 &&
+      EVP_DecryptFinal_ex(ctx, plain.data() + outLen, &finalLen) == 1;
+  EVP_CIPHER_CTX_free(ctx);
+  if (!ok) {
+    return false;
+  }
+  image = QImage::fromData(plain.data(), plainSize);
+  return !image.isNull();
+}
+
+bool ThumbnailCache::insert(const QString &path, qint64 lastModified,
+                            qint64 size, const QImage &image) {
+  if (image.isNull()) {
+    return false;
+  }
+  QByteArray encoded;
+  QBuffer buffer(&encoded);
+  buffer.open(QIODevice::WriteOnly);
+  QImage preview = scaled(image);
+  if (!preview.save(&buffer, preview.hasAlphaChannel() ? "PNG" : "JPG", 85)) {
+    return false;
+  }
+
+  QMutexLocker locker(&mutex);
+  QByteArray id = keys.empty() ? QByteArray() : idFor(path, lastModified, size);
+  if (id.isEmpty()) {
+    OPENSSL_cleanse(encoded.data(), encoded.size());
+    return false;
+  }
+
+  // u32 sealedSize, id, nonce, ciphertext, tag
+  const int headerSize = 4 + ID_SIZE + NONCE_SIZE;
+  QByteArray record(headerSize + encoded.size() + TAG_SIZE, Qt::Uninitialized);
+  auto *out = reinterpret_cast<unsigned char *>(record.data());
+  qToLittleEndian<quint32>(encoded.size() + TAG_SIZE, out);
+  std::memcpy(out + 4, id.constData(), ID_SIZE);
+  unsigned char *nonce = out + 4 + ID_SIZE;
+  unsigned char *sealed = nonce + NONCE_SIZE;
+
+  EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+  int outLen = 0;
+  int finalLen = 0;
+  bool ok =
+      ctx && RAND_bytes(nonce, NONCE_SIZE) == 1 &&
+      EVP_EncryptInit_ex(ctx, SencCrypto::aes256Gcm(), nullptr, keys.data(),
+                         nonce) == 1 &&
+      EVP_EncryptUpdate(ctx, nullptr, &outLen,
+                        reinterpret_cast<const unsigned char *>(id.constData()),
+                        ID_SIZE) == 1 &&
+      EVP_EncryptUpdate(
+          ctx, sealed, &outLen,
+          reinterpret_cast<const unsigned char *>(encoded.constData()),
+          encoded.size()) == 1 &&
+      EVP_EncryptFinal_ex(ctx, sealed + outLen, &finalLen) == 1 &&
+      EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, TAG_SIZE,
+                          sealed + encoded.size()) == 1;
+  EVP_CIPHER_CTX_free(ctx);
+  OPENSSL_cleanse(encoded.data(), encoded.size());
+  if (!ok) {
+    return false;
+  }
+
+  if (file.size() + record.size() > MAX_FILE_SIZE && !startOver()) {
+    return false;
+  }
+  qint64 offset = file.size();
+  if (!file.seek(offset) || file.write(record) != record.size()) {
+    file.resize(offset);
+    return false;
+  }
+  records.insert(id, Record{offset + 4 + ID_SIZE,
+                            static_cast<quint32>(encoded.size() + TAG_SIZE)});
+  return true;
+}
+
+QImage ThumbnailCache::scaled(const QImage &image) {
+  if (image.width() <= THUMBNAIL_SIZE && image.height() <= THUMBNAIL_SIZE) {
+    return image;
+  }
+  return image.scaled(THUMBNAIL_SIZE, THUMBNAIL_SIZE, Qt::KeepAspectRatio,
+                      Qt::SmoothTransformation);
+}
+
+QImage ThumbnailCache::fromContent(const QByteArray &content,
+                                   const QString &mimeType) {
+  QByteArray data = content;
+  QBuffer buffer(&data);
+  buffer.open(QIODevice::ReadOnly);
+
+  if (mimeType.startsWith("image/")) {
+    // Decoders that support it (JPEG) scale while decoding, which is much
+    // cheaper than decoding at full size
+    QImageReader reader(&buffer);
+    QSize full = reader.size();
+    if (full.isValid() &&
+        (full.width() > THUMBNAIL_SIZE || full.height() > THUMBNAIL_SIZE)) {
+      reader.setScaledSize(full.scaled(THUMBNAIL_SIZE, THUMBNAIL_SIZE,
+                                       Qt::KeepAspectRatio));
+    }
+    return scaled(reader.read());
+  }
+
+  if (mimeType == "application/pdf") {
+    QPdfDocument document;
+    document.load(&buffer);
+    if (document.status() != QPdfDocument::Status::Ready ||
+        document.pageCount() == 0) {
+      return QImage();
+    }
+    QSize page = document.pagePointSize(0).toSize();
+    if (page.isEmpty()) {
+      return QImage();
+    }
+    QImage image = document.render(
+        0, page.scaled(THUMBNAIL_SIZE, THUMBNAIL_SIZE, Qt::KeepAspectRatio));
+    document.close();
+    return image;
+  }
+  return QImage();
+}
@@ -0,0 +1,93 @@
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+#include "SecureBuffer.h"
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QIODevice>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+#include <string>
+
+// Small previews of archive contents, kept in one append-only file that is
+// memory-mapped for reading.
+//
+// Every preview is sealed with AES-256-GCM under a key derived from the
+// password that opened its archive (PBKDF2-SHA256 over the file's own salt),
+// and filed under an HMAC of path, mtime and size, so the file reveals
+// neither contents nor paths. Previews made under another password simply
+// never match, and one belonging to an archive that has since changed is
+// never looked up again.
+//
+// Layout (little-endian):
+//   magic[8] "SVTHUMB1", salt[16], u32 kdfIterations, u32 reserved
+//   records: u32 sealedSize, id[32], nonce[12], sealed image + 16-byte tag
+//
+// Thread-safe. unlock() runs the key derivation and belongs off the GUI
+// thread.
+class ThumbnailCache {
+public:
+  static constexpr int THUMBNAIL_SIZE = 128;
+  // Past this the file starts over; previews are cheap to rebuild
+  static constexpr qint64 MAX_FILE_SIZE = 256LL * 1024 * 1024;
+  static constexpr quint32 KDF_ITERATIONS = 600000;
+
+  ThumbnailCache();
+  ~ThumbnailCache();
+  ThumbnailCache(const ThumbnailCache &) = delete;
+  ThumbnailCache &operator=(const ThumbnailCache &) = delete;
+
+  bool unlock(const std::string &password);
+  // Wipes the key; nothing can be read or added until the next unlock()
+  void lock();
+  bool isUnlocked() const;
+
+  bool find(const QString &path, qint64 lastModified, qint64 size,
+            QImage &image) const;
+  bool contains(const QString &path, qint64 lastModified, qint64 size) const;
+  // `image` is scaled down to THUMBNAIL_SIZE first if it is larger
+  bool insert(const QString &path, qint64 lastModified, qint64 size,
+              const QImage &image);
+
+  static QImage scaled(const QImage &image);
+
+  // Preview builder for images and PDFs; runs fine off the GUI thread.
+  // `content` is the decrypted file, `mimeType` picks the decoder. Videos
+  // have none: their preview is a frame from the player on screen.
+  static QImage fromContent(const QByteArray &content, const QString &mimeType);
+
+private:
+  struct Record {
+    qint64 offset; // of the nonce
+    quint32 sealedSize;
+  };
+
+  static constexpr char MAGIC[8] = {'S', 'V', 'T', 'H', 'U', 'M', 'B', '1'};
+  static constexpr qint64 HEADER_SIZE = 32;
+  static constexpr int SALT_SIZE = 16;
+  static constexpr int ID_SIZE = 32;
+  static constexpr int NONCE_SIZE = 12;
+  static constexpr int TAG_SIZE = 16;
+  static constexpr int KEY_SIZE = 32;
+
+  bool openFile();
+  bool startOver();
+  void scanRecords();
+  bool mapped(qint64 end) const;
+  QByteArray idFor(const QString &path, qint64 lastModified,
+                   qint64 size) const;
+
+  mutable QMutex mutex;
+  mutable QFile file;
+  mutable uchar *mapping = nullptr;
+  mutable qint64 mappingSize = 0;
+  QByteArray salt;
+  quint32 iterations = KDF_ITERATIONS;
+  QHash<QByteArray, Record> records;
+  // Sealing key followed by the id key
+  SecureBuffer keys;
+};
+
+#endif // THUMBNAILCACHE_H
@@ -40,6 +40,7 @@ cat >"$SCRIPTS_DIR/postinstall" <<'EOF'
 chmod -R u+w,go+r-w "/Applications/SecureViewer.app"
 chmod +x "/Applications/SecureViewer.app/Contents/MacOS/SecureViewer"
 chmod +x "/Applications/SecureViewer.app/Contents/MacOS/bin/senc"
+chmod +x "/Applications/SecureViewer.app/Contents/MacOS/bin/senc-native"
 
 # Update dynamic linker paths for Qt frameworks
 /usr/bin/install_name_tool -add_rpath "@executable_path/../Frameworks" "/Applications/SecureViewer.app/Contents/MacOS/SecureViewer"